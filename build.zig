@@ -132,6 +132,22 @@ pub fn build(b: *std.Build) void {
                         .optimize = optimize,
                     }),
                 },
+                .{
+                    .name = "gzip",
+                    .module = b.createModule(.{
+                        .root_source_file = b.path("lib/gzip.zig"),
+                        .target = target,
+                        .optimize = optimize,
+                    }),
+                },
+                .{
+                    .name = "tar",
+                    .module = b.createModule(.{
+                        .root_source_file = b.path("lib/tar.zig"),
+                        .target = target,
+                        .optimize = optimize,
+                    }),
+                },
             },
         }),
     });
@@ -159,6 +175,17 @@ pub fn build(b: *std.Build) void {
         run_cmd.addArgs(args);
     }
 
+    const bench = b.addExecutable(.{
+        .name = "sha256-bench",
+        .root_module = b.createModule(.{
+            .root_source_file = b.path("src/sha256_bench.zig"),
+            .target = target,
+            .optimize = .ReleaseFast,
+        }),
+    });
+    const bench_step = b.step("bench", "Measure the SHA256 throughput");
+    bench_step.dependOn(&b.addRunArtifact(bench).step);
+
     const exe_tests = b.addTest(.{
         .root_module = exe.root_module,
     });
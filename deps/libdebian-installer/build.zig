@@ -81,6 +81,8 @@ const debian_installer_sources = [_][]const u8{
     "package.c",
     "package_parser.c",
     "packages.c",
+    "packages_cache.c",
+    "packages_index.c",
     "packages_parser.c",
     "parser.c",
     "parser_rfc822.c",
@@ -115,6 +115,15 @@ void di_hash_table_insert (di_hash_table *hash_table, void *key, void *value);
  */
 void *di_hash_table_lookup (di_hash_table *hash_table, const void *key);
 
+/**
+ * Makes room for the given number of elements in the di_hash_table, so
+ * inserting them doesn't resize it.
+ *
+ * @param hash_table a di_hash_table.
+ * @param size the expected number of key/value pairs.
+ */
+void di_hash_table_reserve (di_hash_table *hash_table, di_ksize_t size);
+
 /**
  * Calls the given function for each of the key/value pairs in the
  * di_hash_table. The function is passed the key and value of each
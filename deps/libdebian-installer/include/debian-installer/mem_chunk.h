@@ -24,6 +24,7 @@
 #include <debian-installer/types.h>
 
 typedef struct di_mem_chunk di_mem_chunk;
+typedef struct di_mem_arena di_mem_arena;
 
 /**
  * @addtogroup di_mem_chunk
@@ -31,10 +32,20 @@ typedef struct di_mem_chunk di_mem_chunk;
  */
 
 di_mem_chunk* di_mem_chunk_new (di_ksize_t atom_size, di_ksize_t area_size);
+di_mem_chunk* di_mem_chunk_new_arena (di_ksize_t atom_size, di_mem_arena *arena);
+di_mem_chunk* di_mem_chunk_new_like (di_mem_chunk *mem_chunk);
 void *di_mem_chunk_alloc (di_mem_chunk *mem_chunk);
 void *di_mem_chunk_alloc0 (di_mem_chunk *mem_chunk);
 void di_mem_chunk_destroy (di_mem_chunk *mem_chunk);
+void di_mem_chunk_join (di_mem_chunk *mem_chunk, di_mem_chunk *other);
 size_t di_mem_chunk_size (di_mem_chunk *mem_chunk);
 
+di_mem_arena *di_mem_arena_new (di_ksize_t area_size);
+void *di_mem_arena_alloc (di_mem_arena *arena, size_t size);
+char *di_mem_arena_stradup (di_mem_arena *arena, const char *s, size_t n);
+void di_mem_arena_join (di_mem_arena *arena, di_mem_arena *other);
+size_t di_mem_arena_size (di_mem_arena *arena);
+void di_mem_arena_destroy (di_mem_arena *arena);
+
 /** @} */
 #endif
@@ -29,6 +29,7 @@ typedef struct di_package di_package;
 typedef struct di_package_dependency di_package_dependency;
 typedef struct di_package_version di_package_version;
 
+typedef enum di_package_dependency_relation di_package_dependency_relation;
 typedef enum di_package_dependency_type di_package_dependency_type;
 typedef enum di_package_priority di_package_priority;
 typedef enum di_package_status di_package_status;
@@ -116,6 +117,8 @@ struct di_package
   char *short_description;                              /**< Description field, first part*/
   char *description;                                    /**< Description field, second part */
   unsigned int resolver;                                /**< @internal */
+  char *lazy;                                           /**< @internal Package field of the entry with unread fields, see di_packages_read_file_lazy */
+  uint32_t id;                                          /**< ID in the di_packages_index */
 };
 
 /**
@@ -133,6 +136,20 @@ enum di_package_dependency_type
   di_package_dependency_type_enhances,                  /**< Enhances field */
   di_package_dependency_type_reverse_provides = 0x100,  /**< @internal */
   di_package_dependency_type_reverse_enhances,          /**< @internal */
+  di_package_dependency_type_alternative = 0x200,       /**< Alternative of the dependency before */
+};
+
+/**
+ * Version relation of a dependency
+ */
+enum di_package_dependency_relation
+{
+  di_package_dependency_relation_none = 0,              /**< No version */
+  di_package_dependency_relation_earlier,               /**< << */
+  di_package_dependency_relation_earlier_equal,         /**< <= */
+  di_package_dependency_relation_equal,                 /**< = */
+  di_package_dependency_relation_later_equal,           /**< >= */
+  di_package_dependency_relation_later,                 /**< >> */
 };
 
 /**
@@ -141,7 +158,9 @@ enum di_package_dependency_type
 struct di_package_dependency
 {
   di_package_dependency_type type;                      /**< type of dependency */
+  di_package_dependency_relation relation;              /**< version relation */
   di_package *ptr;                                      /**< the package, may be NULL */
+  char *version;                                        /**< version of the relation, may be NULL */
 };
 
 /**
@@ -170,7 +189,9 @@ void di_package_version_free (di_package_version *version);
 
 int di_package_version_compare (const di_package_version *a, const di_package_version *b);
 di_package_version *di_package_version_parse (di_package *package);
+bool di_package_version_satisfies (const char *version, di_package_dependency_relation relation, const char *reference);
 
+extern const char *const di_package_dependency_relation_text[];
 extern const char *const di_package_priority_text[];
 extern const char *const di_package_status_want_text[];
 extern const char *const di_package_status_text[];
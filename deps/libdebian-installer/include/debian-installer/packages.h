@@ -29,6 +29,9 @@
 
 typedef struct di_packages di_packages;
 typedef struct di_packages_allocator di_packages_allocator;
+typedef struct di_packages_allocator_stats di_packages_allocator_stats;
+typedef struct di_packages_index di_packages_index;
+typedef struct di_packages_index_postings di_packages_index_postings;
 
 /**
  * @addtogroup di_packages
@@ -43,6 +46,12 @@ struct di_packages
   di_hash_table *table;                                 /**< includes di_package */
   di_slist list;                                        /**< includes di_package */
   unsigned int resolver;                                /**< @internal */
+  char *map;                                            /**< @internal mapped file with unread fields, or NULL */
+  size_t map_size;                                      /**< @internal */
+  di_parser_info *lazy_info;                            /**< @internal parser info for unread fields */
+  di_packages_allocator *allocator;                     /**< @internal arena allocator owning all packages, or NULL */
+  di_packages_index *index;                             /**< @internal index of the packages, or NULL */
+  unsigned int status_changes;                          /**< number of changes by di_packages_set_status */
 };
 
 /**
@@ -54,24 +63,152 @@ struct di_packages_allocator
   di_mem_chunk *package_mem_chunk;                      /**< @internal */
   di_mem_chunk *package_dependency_mem_chunk;           /**< @internal */
   di_mem_chunk *slist_node_mem_chunk;                   /**< @internal */
+  di_mem_arena *arena;                                  /**< @internal arena of all memory, or NULL */
+  size_t string_size;                                   /**< @internal */
+};
+
+/**
+ * @brief Packages file - Allocator statistics
+ */
+struct di_packages_allocator_stats
+{
+  size_t packages;                                      /**< bytes of packages */
+  size_t dependencies;                                  /**< bytes of dependencies */
+  size_t nodes;                                         /**< bytes of list nodes */
+  size_t strings;                                       /**< bytes of strings, only known for arenas */
+  size_t total;                                         /**< all allocated bytes */
 };
 
 #include <debian-installer/package.h>
 
+/**
+ * @brief Packages file - Index - IDs by key
+ *
+ * The IDs with key k are id[start[k]] to id[start[k + 1] - 1].
+ */
+struct di_packages_index_postings
+{
+  uint32_t keys;                                        /**< number of keys */
+  uint32_t *start;                                      /**< first ID by key, keys + 1 entries */
+  uint32_t *id;                                         /**< IDs */
+};
+
+/**
+ * @brief Packages file - Index
+ *
+ * Every package has a dense ID, the fields used to select packages and to
+ * resolve dependencies are kept in arrays by ID.  The edges of a package
+ * are stored in compressed sparse row form: they are edge_target[edge[id]]
+ * to edge_target[edge[id + 1] - 1], the Depends and Pre-Depends of real
+ * packages.  The secondary indices list the packages with a given
+ * Essential field, priority or section in ID order, and the providers of
+ * every package in the order of its reverse provides.
+ */
+struct di_packages_index
+{
+  uint32_t count;                                       /**< number of packages */
+  di_package **package;                                 /**< package by ID */
+  uint8_t *type;                                        /**< di_package_type by ID */
+  uint8_t *priority;                                    /**< di_package_priority by ID */
+  uint8_t *essential;                                   /**< Essential field by ID */
+  uint8_t *status;                                      /**< di_package_status by ID */
+  uint32_t *edge;                                       /**< first edge by ID, count + 1 entries */
+  uint32_t *edge_target;                                /**< ID of the target of each edge */
+  di_packages_index_postings by_essential;              /**< packages by Essential field, 0 or 1 */
+  di_packages_index_postings by_priority;               /**< packages by di_package_priority */
+  di_packages_index_postings by_section;                /**< real packages by section, see section */
+  char **section;                                       /**< name of each section */
+  di_packages_index_postings provides;                  /**< providers by ID */
+  uint32_t *resolver;                                   /**< @internal epoch of the last resolve which saw the ID, and if it was okay */
+  uint32_t resolver_epoch;                              /**< @internal */
+  struct internal_di_packages_index_frame *resolver_stack; /**< @internal */
+  struct internal_di_packages_index_smallest *smallest; /**< @internal see di_packages_index_choose_smallest */
+};
+
 di_packages *di_packages_alloc (void);
 void di_packages_free (di_packages *packages);
 
 di_packages_allocator *di_packages_allocator_alloc (void);
+di_packages_allocator *di_packages_allocator_alloc_arena (void);
 void di_packages_allocator_free (di_packages_allocator *packages);
+void di_packages_allocator_get_stats (di_packages_allocator *allocator, di_packages_allocator_stats *stats);
 
 void di_packages_append_package (di_packages *packages, di_package *package, di_packages_allocator *allocator);
 di_package *di_packages_get_package (di_packages *packages, const char *name, size_t n);
 di_package *di_packages_get_package_new (di_packages *packages, di_packages_allocator *allocator, char *name, size_t n);
+di_packages *di_packages_compact (di_packages *packages, di_slist *list, di_packages_allocator *allocator);
 
 di_slist *di_packages_resolve_dependencies (di_packages *packages, di_slist *list, di_packages_allocator *allocator);
 di_slist *di_packages_resolve_dependencies_array (di_packages *packages, di_package **array, di_packages_allocator *allocator);
 void di_packages_resolve_dependencies_mark (di_packages *packages);
 
+void di_packages_set_status (di_packages *packages, di_package *package, di_package_status status);
+
+/**
+ * Build the index of the packages
+ *
+ * The index is kept until the packages are freed, later calls return it.
+ * Afterwards di_packages_resolve_dependencies and
+ * di_packages_resolve_dependencies_array use it.  No packages may be added
+ * after the index is built and the status of packages must only be changed
+ * with di_packages_set_status.
+ *
+ * @param packages the packages structure
+ *
+ * @return the index
+ */
+di_packages_index *di_packages_index_build (di_packages *packages);
+
+/**
+ * Resolve alternatives to the smallest closure
+ *
+ * Afterwards the resolves on the index take the alternatives of Depends
+ * and Pre-Depends and their version relations into account.  Of all real
+ * packages which satisfy a dependency, directly or by providing it, the
+ * one whose closure adds the least Size and Installed-Size to the result
+ * is chosen; packages chosen by earlier resolves cost nothing.  The
+ * closure of every option is estimated with the first options of its own
+ * dependencies.
+ *
+ * @param index the index
+ */
+void di_packages_index_choose_smallest (di_packages_index *index);
+
+/**
+ * Get the key of a section in the index
+ *
+ * @param index the index
+ * @param section name of the section
+ *
+ * @return the key in index->by_section, or UINT32_MAX if no package has
+ *         this section
+ */
+uint32_t di_packages_index_section (di_packages_index *index, const char *section);
+
+/**
+ * Get the number of IDs with a key
+ *
+ * @param postings the postings
+ * @param key the key
+ */
+static inline uint32_t di_packages_index_postings_size (const di_packages_index_postings *postings, uint32_t key)
+{
+  if (key >= postings->keys)
+    return 0;
+  return postings->start[key + 1] - postings->start[key];
+}
+
+/**
+ * Get the IDs with a key
+ *
+ * @param postings the postings
+ * @param key the key, which must be less than postings->keys
+ */
+static inline const uint32_t *di_packages_index_postings_get (const di_packages_index_postings *postings, uint32_t key)
+{
+  return &postings->id[postings->start[key]];
+}
+
 /** @} */
 
 di_parser_fields_function_read
@@ -97,6 +234,74 @@ di_parser_info *di_packages_status_parser_info (void);
  */
 di_packages *di_packages_special_read_file (const char *file, di_packages_allocator *allocator, di_parser_info *(info) (void));
 
+/**
+ * Read a special Packages file on several threads
+ *
+ * The result is the same as the one of di_packages_special_read_file.
+ *
+ * @param file file to read
+ * @param jobs number of threads, or 0 for the number of online CPUs
+ */
+di_packages *di_packages_special_read_file_parallel (const char *file, di_packages_allocator *allocator, di_parser_info *(info) (void), int jobs);
+
+/**
+ * Read a standard Packages file, leaving fields not needed for dependency
+ * resolution unread
+ *
+ * The file stays mapped until the packages are freed.  Maintainer,
+ * Architecture, Version, Filename, SHA256 and Description of a package are
+ * only read by di_packages_materialize_package.  The dependency resolver
+ * does this for all packages it returns.
+ *
+ * @param file file to read
+ * @param allocator the allocator for the packages structure
+ * @param jobs number of threads, or 0 for the number of online CPUs
+ */
+di_packages *di_packages_read_file_lazy (const char *file, di_packages_allocator *allocator, int jobs);
+
+/**
+ * Read the unread fields of a package of di_packages_read_file_lazy
+ *
+ * @param packages the packages structure
+ * @param package the package
+ */
+void di_packages_materialize_package (di_packages *packages, di_package *package);
+
+/**
+ * Read the unread fields of all packages in a list
+ *
+ * @param packages the packages structure
+ * @param list list of di_package
+ */
+void di_packages_materialize_list (di_packages *packages, di_slist *list);
+
+/**
+ * Write the packages into a cache file
+ *
+ * The cache includes the names, dependencies, type, priority, essential,
+ * section, version, filename, size, installed size and sha256 of all
+ * packages, it is written to a temporary file and then renamed.
+ *
+ * @param packages the packages structure
+ * @param file file to write
+ *
+ * @return 0 on success, -1 on error
+ */
+int di_packages_cache_write (di_packages *packages, const char *file);
+
+/**
+ * Read packages from a cache file
+ *
+ * The file stays mapped until the packages are freed, all strings of the
+ * packages point into it.
+ *
+ * @param file file to read
+ * @param allocator the allocator for the packages structure
+ *
+ * @return the packages, or NULL if the file is missing or invalid
+ */
+di_packages *di_packages_cache_read (const char *file, di_packages_allocator *allocator);
+
 /**
  * Write a special Packages file
  *
@@ -118,6 +323,18 @@ static inline di_packages *di_packages_read_file (const char *file, di_packages_
   return di_packages_special_read_file (file, allocator, di_packages_parser_info);
 }
 
+/**
+ * Read a standard Packages file on several threads
+ *
+ * @param file file to read
+ * @param allocator the allocator for the packages structure
+ * @param jobs number of threads, or 0 for the number of online CPUs
+ */
+static inline di_packages *di_packages_read_file_parallel (const char *file, di_packages_allocator *allocator, int jobs)
+{
+  return di_packages_special_read_file_parallel (file, allocator, di_packages_parser_info, jobs);
+}
+
 /**
  * Read a minimal Packages file
  *
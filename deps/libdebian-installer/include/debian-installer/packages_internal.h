@@ -32,6 +32,69 @@ typedef struct di_packages_resolve_dependencies_check di_packages_resolve_depend
  */
 
 di_packages_allocator *internal_di_packages_allocator_alloc (void);
+di_packages_allocator *internal_di_packages_allocator_alloc_like (di_packages_allocator *allocator);
+void internal_di_packages_allocator_join (di_packages_allocator *allocator, di_packages_allocator *other);
+char *internal_di_packages_allocator_stradup (di_packages_allocator *allocator, const char *s, size_t n);
+
+di_packages *internal_di_packages_alloc_unowned (void);
+di_packages *internal_di_packages_alloc_with (di_packages_allocator *allocator);
+void internal_di_packages_join (di_packages *packages, di_packages *other);
+
+/**
+ * @internal
+ * Header of a cache file
+ *
+ * It is followed by the packages, the dependencies, the indices of the
+ * package list and the string table.  References are indices or offsets
+ * into the string table, where offset 0 means NULL.
+ */
+struct internal_di_packages_cache_header
+{
+  char magic[8];
+  uint32_t byte_order;
+  uint32_t packages;
+  uint32_t dependencies;
+  uint32_t list;
+  uint32_t strings;
+  uint32_t reserved;
+};
+
+/**
+ * @internal
+ * A package in a cache file
+ */
+struct internal_di_packages_cache_package
+{
+  uint32_t package;
+  uint32_t package_size;
+  uint32_t section;
+  uint32_t version;
+  uint32_t filename;
+  uint32_t sha256;
+  uint32_t depends;                                     /**< index of the first dependency */
+  uint32_t depends_count;
+  int32_t installed_size;
+  uint8_t type;
+  uint8_t priority;
+  uint8_t essential;
+  uint8_t reserved;
+  uint64_t size;
+};
+
+/**
+ * @internal
+ * A dependency in a cache file
+ */
+struct internal_di_packages_cache_dependency
+{
+  uint32_t package;
+  uint16_t type;
+  uint16_t relation;
+  uint32_t version;
+};
+
+void internal_di_packages_index_free (di_packages_index *index);
+di_slist *internal_di_packages_index_resolve_dependencies (di_packages *packages, di_slist *list, di_package **array, di_packages_allocator *allocator);
 
 typedef bool di_packages_resolve_dependencies_check_package (di_packages_resolve_dependencies_check *r, di_package *package, di_package_dependency *d);
 typedef di_package_dependency *di_packages_resolve_dependencies_check_provide (di_package *package, di_package_dependency *best, di_package_dependency *d, void *data);
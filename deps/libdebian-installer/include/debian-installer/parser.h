@@ -25,6 +25,7 @@
 #include <debian-installer/string.h>
 
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -96,6 +97,9 @@ struct di_parser_info
   di_slist list;                                        /**< list of di_parser_fieldinfo */
   bool modifier;                                        /**< use modifier */
   bool wildcard;                                        /**< use wildcard (entry with key "") */
+  const di_parser_fieldinfo **dispatch;                 /**< @internal perfect hash of table, or NULL */
+  uint32_t dispatch_seed;                               /**< @internal multiplier of the perfect hash */
+  unsigned int dispatch_shift;                          /**< @internal shift of the perfect hash */
 };
 
 /**
@@ -0,0 +1,64 @@
+/*
+ * parser_internal.h
+ *
+ * Copyright (C) 2003 Bastian Blank <waldi@debian.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef DEBIAN_INSTALLER__PARSER_INTERNAL_H
+#define DEBIAN_INSTALLER__PARSER_INTERNAL_H
+
+#include <debian-installer/parser.h>
+
+#include <stdint.h>
+
+/**
+ * @addtogroup di_parser
+ * @{
+ */
+
+/**
+ * @internal
+ * Key of the dispatch table: the size, the first two and the last byte of
+ * the field name, folded to lower case for letters
+ */
+static inline uint32_t internal_di_parser_dispatch_key (const char *name, size_t size)
+{
+  return (uint32_t) size << 24 ^
+         (uint32_t) (name[0] | 0x20) << 16 ^
+         (uint32_t) (name[size > 1] | 0x20) << 8 ^
+         (uint32_t) (name[size - 1] | 0x20);
+}
+
+/**
+ * @internal
+ * Lookup a field by its exact name
+ */
+static inline const di_parser_fieldinfo *internal_di_parser_info_lookup (di_parser_info *info, const di_rstring *field)
+{
+  const di_parser_fieldinfo *fip;
+
+  if (!info->dispatch || !field->size)
+    return di_hash_table_lookup (info->table, field);
+
+  fip = info->dispatch[(internal_di_parser_dispatch_key (field->string, field->size) * info->dispatch_seed) >> info->dispatch_shift];
+  if (fip && fip->key.size == field->size && !strncasecmp (fip->key.string, field->string, field->size))
+    return fip;
+  return NULL;
+}
+
+/** @} */
+#endif
@@ -44,6 +44,17 @@
  */
 int di_parser_rfc822_read (char *begin, size_t size, di_parser_info *fieldinfo, di_parser_read_entry_new entry_new, di_parser_read_entry_finish entry_finish, void *user_data);
 
+/**
+ * Map a file read-only, for the parser
+ *
+ * @param file filename
+ * @param begin returns the begin of the mapping, NULL for empty files
+ * @param size returns the size of the mapping
+ *
+ * @return 0 on success, -1 on error
+ */
+int di_parser_rfc822_map_file (const char *file, char **begin, size_t *size);
+
 /**
  * Parse a rfc822 formated file
  *
@@ -57,6 +68,39 @@ int di_parser_rfc822_read (char *begin, size_t size, di_parser_info *fieldinfo,
  */
 int di_parser_rfc822_read_file (const char *file, di_parser_info *fieldinfo, di_parser_read_entry_new entry_new, di_parser_read_entry_finish entry_finish, void *user_data);
 
+/**
+ * Parse a rfc822 formated file on several threads
+ *
+ * The memory segment is split at empty lines into jobs parts of about the
+ * same size, each is parsed on its own thread with its own user_data.
+ * Parts are in the order of the segment, trailing ones may be empty.
+ *
+ * @param begin begin of memory segment
+ * @param size size of memory segment
+ * @param fieldinfo parser info, only read
+ * @param entry_new function which is called before each entry, may return the new entry or return NULL
+ * @param entry_finish function which is called after each entry, return non-0 aborts the parsing
+ * @param user_data array of jobs user_data for parser functions, one per part
+ * @param jobs number of parts
+ *
+ * @return number of parsed entries
+ */
+int di_parser_rfc822_read_parallel (char *begin, size_t size, di_parser_info *fieldinfo, di_parser_read_entry_new entry_new, di_parser_read_entry_finish entry_finish, void **user_data, int jobs);
+
+/**
+ * Parse a rfc822 formated file on several threads
+ *
+ * @param file filename
+ * @param fieldinfo parser info, only read
+ * @param entry_new function which is called before each entry, may return the new entry or return NULL
+ * @param entry_finish function which is called after each entry, return non-0 aborts the parsing
+ * @param user_data array of jobs user_data for parser functions, one per part
+ * @param jobs number of parts
+ *
+ * @return number of parsed entries
+ */
+int di_parser_rfc822_read_file_parallel (const char *file, di_parser_info *fieldinfo, di_parser_read_entry_new entry_new, di_parser_read_entry_finish entry_finish, void **user_data, int jobs);
+
 /**
  * Dump a rfc822 formated file
  *
@@ -40,8 +40,10 @@ struct di_release
   char *origin;                                 /**< Origin field */
   char *suite;                                  /**< Suite field */
   char *codename;                               /**< Codename field */
+  int acquire_by_hash;                          /**< Acquire-By-Hash field */
   di_hash_table *sha256;                        /**< checksum fields, includes di_release_file */
   di_mem_chunk *release_file_mem_chunk;         /**< @internal */
+  const char *const *filter;                    /**< @internal */
 };
 
 /**
@@ -68,6 +70,7 @@ void di_release_free (di_release *packages);
  */
 
 di_release *di_release_read_file (const char *file);
+di_release *di_release_read_file_filtered (const char *file, const char *const *filter);
 
 /** @} */
 
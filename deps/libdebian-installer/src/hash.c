@@ -23,10 +23,14 @@
 #include <debian-installer/hash.h>
 
 #include <debian-installer/mem.h>
-#include <debian-installer/mem_chunk.h>
 
+#include <stdint.h>
 #include <string.h>
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 typedef struct di_hash_node di_hash_node;
 
 /**
@@ -37,13 +41,20 @@ typedef struct di_hash_node di_hash_node;
 /**
  * @internal
  * @brief Hash table
+ *
+ * Open addressing in the style of a Swiss table: every slot has a control
+ * byte, which is either HASH_CTRL_EMPTY or the low 7 bits of the hash of
+ * its key.  A lookup compares all control bytes of a group at once and only
+ * calls the key compare function for slots with matching bits.  Entries are
+ * never removed, so a group with an empty slot ends every probe sequence.
  */
 struct di_hash_table
 {
-  size_t size;                                          /**< the overall size */
+  size_t size;                                          /**< the number of slots, a power of two */
   size_t nnodes;                                        /**< number of nodes */
-  di_hash_node **nodes;                                 /**< nodes */
-  di_mem_chunk *mem_chunk;                              /**< di_mem_chunk for allocating the nodes (di_hash_node) */
+  size_t growth_left;                                   /**< number of nodes until a resize */
+  uint8_t *ctrl;                                        /**< control bytes, followed by a copy of the first group */
+  di_hash_node *nodes;                                  /**< nodes */
   di_hash_func *hash_func;                              /**< hashing function */
   di_equal_func *key_equal_func;                        /**< key compare function */
   di_destroy_notify *key_destroy_func;                  /**< key destroy function, may NULL */
@@ -58,52 +69,189 @@ struct di_hash_node
 {
   void *key;                                            /**< key */
   void *value;                                          /**< value */
-  di_hash_node *next;                                   /**< the next node */
 };
 
 /**
  * @internal
- * Defines if a resize is necessary
- *
- * @param hash_table a di_hash_table
+ * Control byte of an empty slot
+ */
+#define HASH_CTRL_EMPTY 0x80
+
+/**
+ * @internal
+ * Number of slots compared at once
  */
-#define HASH_TABLE_RESIZE(hash_table)                   \
-if ((hash_table->size >= 3 * hash_table->nnodes &&      \
-      hash_table->size > HASH_TABLE_MIN_SIZE) ||        \
-    (3 * hash_table->size <= hash_table->nnodes &&      \
-     hash_table->size < HASH_TABLE_MAX_SIZE))           \
-     internal_di_hash_table_resize (hash_table);
+#ifdef __SSE2__
+#define HASH_GROUP_SIZE 16
+#else
+#define HASH_GROUP_SIZE 8
+#endif
 
 /**
  * @internal
  * The minimal hash table size
  */
-#define HASH_TABLE_MIN_SIZE 11
+#define HASH_TABLE_MIN_SIZE 16
+
 /**
  * @internal
- * The maximal hash table size
+ * Number of nodes a table of the given size holds, 7/8 of the slots
  */
-#define HASH_TABLE_MAX_SIZE 13845163
+#define HASH_TABLE_CAPACITY(size) ((size) - (size) / 8)
 
 /**
  * @internal
- * @param x value
- * @param low low bound
- * @param high high bound
- * 
- * @return a value between low and high
+ * Bit mask of the slots in a group
  */
-#define CLAMP(x, low, high)  (((x) > (high)) ? (high) : (((x) < (low)) ? (low) : (x)))
+#ifdef __SSE2__
+typedef uint32_t internal_di_hash_mask;
+#else
+typedef uint64_t internal_di_hash_mask;
+#endif
 
-static void internal_di_hash_table_resize (di_hash_table *hash_table);
-static di_hash_node **internal_di_hash_table_lookup_node (di_hash_table *hash_table, const void *key);
-static di_hash_node *internal_di_hash_node_new (di_hash_table *hash_table, void *key, void *value);
-static void internal_di_hash_node_destroy (di_hash_node *hash_node, di_destroy_notify key_destroy_func, di_destroy_notify value_destroy_func) __attribute__ ((unused));
-static void internal_di_hash_nodes_destroy (di_hash_node *hash_node, di_destroy_notify key_destroy_func, di_destroy_notify value_destroy_func);
+static void internal_di_hash_table_resize (di_hash_table *hash_table, size_t size);
 
 /** @} */
 
-static unsigned int internal_di_spaced_primes_closest (unsigned int num);
+/**
+ * @internal
+ * Mixes the hash, the hash functions are not required to spread their
+ * values over all bits
+ */
+static inline uint32_t internal_di_hash_mix (uint32_t hash)
+{
+  hash ^= hash >> 16;
+  hash *= 0x85ebca6bU;
+  hash ^= hash >> 13;
+  return hash;
+}
+
+/**
+ * @internal
+ * Returns a mask of the slots of the group at ctrl with the control byte c
+ */
+static inline internal_di_hash_mask internal_di_hash_group_match (const uint8_t *ctrl, uint8_t c)
+{
+#ifdef __SSE2__
+  __m128i group = _mm_loadu_si128 ((const __m128i *) ctrl);
+  return _mm_movemask_epi8 (_mm_cmpeq_epi8 (group, _mm_set1_epi8 (c)));
+#else
+  const uint64_t lsbs = 0x0101010101010101ULL, msbs = 0x8080808080808080ULL;
+  uint64_t group, x;
+
+  memcpy (&group, ctrl, sizeof (group));
+  x = group ^ (lsbs * c);
+  /* may report false positives after a true match, the caller compares keys anyway */
+  return (x - lsbs) & ~x & msbs;
+#endif
+}
+
+/**
+ * @internal
+ * Returns a mask of the empty slots of the group at ctrl
+ */
+static inline internal_di_hash_mask internal_di_hash_group_empty (const uint8_t *ctrl)
+{
+#ifdef __SSE2__
+  return _mm_movemask_epi8 (_mm_loadu_si128 ((const __m128i *) ctrl));
+#else
+  uint64_t group;
+
+  memcpy (&group, ctrl, sizeof (group));
+  return group & 0x8080808080808080ULL;
+#endif
+}
+
+/**
+ * @internal
+ * Returns the offset of the first slot in a non-empty mask
+ */
+static inline size_t internal_di_hash_mask_first (internal_di_hash_mask mask)
+{
+#ifdef __SSE2__
+  return __builtin_ctz (mask);
+#else
+  size_t bit = __builtin_ctzll (mask);
+
+  /* the group was loaded in native byte order */
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+  return 7 - bit / 8;
+#else
+  return bit / 8;
+#endif
+#endif
+}
+
+/**
+ * @internal
+ * Removes the first slot from a non-empty mask
+ */
+static inline internal_di_hash_mask internal_di_hash_mask_next (internal_di_hash_mask mask, size_t offset)
+{
+#ifdef __SSE2__
+  (void) offset;
+  return mask & (mask - 1);
+#else
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+  return mask & ~((internal_di_hash_mask) 0x80 << ((7 - offset) * 8));
+#else
+  return mask & ~((internal_di_hash_mask) 0x80 << (offset * 8));
+#endif
+#endif
+}
+
+static inline void internal_di_hash_table_set_ctrl (di_hash_table *hash_table, size_t i, uint8_t c)
+{
+  hash_table->ctrl[i] = c;
+  /* the copy of the first group lets every group be loaded at once */
+  if (i < HASH_GROUP_SIZE)
+    hash_table->ctrl[hash_table->size + i] = c;
+}
+
+/**
+ * @internal
+ * Finds the slot of key, or the empty slot it would be inserted into
+ *
+ * @return the slot
+ */
+static inline size_t internal_di_hash_table_find (di_hash_table *hash_table, const void *key, uint32_t hash, bool *found)
+{
+  size_t mask = hash_table->size - 1;
+  size_t pos = (hash >> 7) & mask, stride = 0;
+  uint8_t h2 = hash & 0x7f;
+
+  for (;;)
+  {
+    const uint8_t *group = hash_table->ctrl + pos;
+    internal_di_hash_mask match = internal_di_hash_group_match (group, h2), empty;
+
+    while (match)
+    {
+      size_t offset = internal_di_hash_mask_first (match);
+      size_t i = (pos + offset) & mask;
+      void *k = hash_table->nodes[i].key;
+
+      if (group[offset] == h2 &&
+          (hash_table->key_equal_func ? hash_table->key_equal_func (k, key) : k == key))
+      {
+        *found = true;
+        return i;
+      }
+      match = internal_di_hash_mask_next (match, offset);
+    }
+
+    empty = internal_di_hash_group_empty (group);
+    if (empty)
+    {
+      *found = false;
+      return (pos + internal_di_hash_mask_first (empty)) & mask;
+    }
+
+    /* triangular probing visits every group of a power of two table */
+    stride += HASH_GROUP_SIZE;
+    pos = (pos + stride) & mask;
+  }
+}
 
 di_hash_table *di_hash_table_new (di_hash_func hash_func, di_equal_func key_equal_func)
 {
@@ -113,20 +261,14 @@ di_hash_table *di_hash_table_new (di_hash_func hash_func, di_equal_func key_equa
 di_hash_table *di_hash_table_new_full (di_hash_func hash_func, di_equal_func key_equal_func, di_destroy_notify key_destroy_func, di_destroy_notify value_destroy_func)
 {
   di_hash_table *hash_table;
-  size_t i;
 
-  hash_table = di_new (di_hash_table, 1);
-  hash_table->size               = HASH_TABLE_MIN_SIZE;
-  hash_table->nnodes             = 0;
-  hash_table->mem_chunk          = di_mem_chunk_new (sizeof (di_hash_node), 4096);
+  hash_table = di_new0 (di_hash_table, 1);
   hash_table->hash_func          = hash_func;
   hash_table->key_equal_func     = key_equal_func;
   hash_table->key_destroy_func   = key_destroy_func;
   hash_table->value_destroy_func = value_destroy_func;
-  hash_table->nodes              = di_new (di_hash_node*, hash_table->size);
 
-  for (i = 0; i < hash_table->size; i++)
-    hash_table->nodes[i] = NULL;
+  internal_di_hash_table_resize (hash_table, HASH_TABLE_MIN_SIZE);
 
   return hash_table;
 }
@@ -135,122 +277,82 @@ void di_hash_table_destroy (di_hash_table *hash_table)
 {
   size_t i;
 
-  for (i = 0; i < hash_table->size; i++)
-    internal_di_hash_nodes_destroy (hash_table->nodes[i], hash_table->key_destroy_func, hash_table->value_destroy_func);
-
-  di_mem_chunk_destroy (hash_table->mem_chunk);
-
+  if (hash_table->key_destroy_func || hash_table->value_destroy_func)
+    for (i = 0; i < hash_table->size; i++)
+      if (hash_table->ctrl[i] != HASH_CTRL_EMPTY)
+      {
+        if (hash_table->key_destroy_func)
+          hash_table->key_destroy_func (hash_table->nodes[i].key);
+        if (hash_table->value_destroy_func)
+          hash_table->value_destroy_func (hash_table->nodes[i].value);
+      }
+
+  di_free (hash_table->ctrl);
   di_free (hash_table->nodes);
   di_free (hash_table);
 }
 
-static inline di_hash_node** internal_di_hash_table_lookup_node (di_hash_table *hash_table, const void *key)
-{
-  di_hash_node **node;
-
-  node = &hash_table->nodes
-    [hash_table->hash_func (key) % hash_table->size];
-
-  /* Hash table lookup needs to be fast.
-   * We therefore remove the extra conditional of testing
-   * whether to call the key_equal_func or not from
-   * the inner loop.
-   */
-  if (hash_table->key_equal_func)
-    while (*node && !(*hash_table->key_equal_func) ((*node)->key, key))
-      node = &(*node)->next;
-  else
-    while (*node && (*node)->key != key)
-      node = &(*node)->next;
-
-  return node;
-}
-
 void *di_hash_table_lookup (di_hash_table *hash_table, const void *key)
 {
-  di_hash_node *node;
+  bool found;
+  size_t i;
 
-  node = *internal_di_hash_table_lookup_node (hash_table, key);
+  i = internal_di_hash_table_find (hash_table, key, internal_di_hash_mix (hash_table->hash_func (key)), &found);
 
-  return node ? node->value : NULL;
+  return found ? hash_table->nodes[i].value : NULL;
 }
 
 void di_hash_table_insert (di_hash_table *hash_table, void *key, void *value)
 {
-  di_hash_node **node;
+  uint32_t hash = internal_di_hash_mix (hash_table->hash_func (key));
+  bool found;
+  size_t i;
 
-  node = internal_di_hash_table_lookup_node (hash_table, key);
+  i = internal_di_hash_table_find (hash_table, key, hash, &found);
 
-  if (*node)
+  if (found)
   {
     if (hash_table->key_destroy_func)
       hash_table->key_destroy_func (key);
 
     if (hash_table->value_destroy_func)
-      hash_table->value_destroy_func ((*node)->value);
+      hash_table->value_destroy_func (hash_table->nodes[i].value);
 
-    (*node)->value = value;
+    hash_table->nodes[i].value = value;
+    return;
   }
-  else
+
+  if (!hash_table->growth_left)
   {
-    *node = internal_di_hash_node_new (hash_table, key, value);
-    hash_table->nnodes++;
-    HASH_TABLE_RESIZE (hash_table);
+    internal_di_hash_table_resize (hash_table, hash_table->size * 2);
+    i = internal_di_hash_table_find (hash_table, key, hash, &found);
   }
-}
-
-static di_hash_node* internal_di_hash_node_new (di_hash_table *hash_table, void *key, void *value)
-{
-  di_hash_node *hash_node;
-
-  hash_node = di_mem_chunk_alloc (hash_table->mem_chunk);
 
-  hash_node->key = key;
-  hash_node->value = value;
-  hash_node->next = NULL;
-
-  return hash_node;
-}
-
-static void internal_di_hash_node_destroy (di_hash_node *hash_node, di_destroy_notify key_destroy_func, di_destroy_notify value_destroy_func)
-{
-  if (key_destroy_func)
-    key_destroy_func (hash_node->key);
-  if (value_destroy_func)
-    value_destroy_func (hash_node->value);
+  internal_di_hash_table_set_ctrl (hash_table, i, hash & 0x7f);
+  hash_table->nodes[i].key = key;
+  hash_table->nodes[i].value = value;
+  hash_table->nnodes++;
+  hash_table->growth_left--;
 }
 
-static void internal_di_hash_nodes_destroy (di_hash_node *hash_node, di_destroy_notify key_destroy_func, di_destroy_notify value_destroy_func)
+void di_hash_table_reserve (di_hash_table *hash_table, di_ksize_t size)
 {
-  if (hash_node)
-  {
-    di_hash_node *node = hash_node;
-
-    while (node->next)
-    {
-      if (key_destroy_func)
-        key_destroy_func (node->key);
-      if (value_destroy_func)
-        value_destroy_func (node->value);
+  size_t new_size = hash_table->size;
 
-      node = node->next;
-    }
+  while (HASH_TABLE_CAPACITY (new_size) < size)
+    new_size *= 2;
 
-    if (key_destroy_func)
-      key_destroy_func (node->key);
-    if (value_destroy_func)
-      value_destroy_func (node->value);
-  }
+  if (new_size != hash_table->size)
+    internal_di_hash_table_resize (hash_table, new_size);
 }
 
 void di_hash_table_foreach (di_hash_table *hash_table, di_hfunc *func, void *user_data)
 {
-  di_hash_node *node;
   size_t i;
 
   for (i = 0; i < hash_table->size; i++)
-    for (node = hash_table->nodes[i]; node; node = node->next)
-      func (node->key, node->value, user_data);
+    if (hash_table->ctrl[i] != HASH_CTRL_EMPTY)
+      func (hash_table->nodes[i].key, hash_table->nodes[i].value, user_data);
 }
 
 di_ksize_t di_hash_table_size (di_hash_table *hash_table)
@@ -258,84 +360,38 @@ di_ksize_t di_hash_table_size (di_hash_table *hash_table)
   return hash_table->nnodes;
 }
 
-static void internal_di_hash_table_resize (di_hash_table *hash_table)
+static void internal_di_hash_table_resize (di_hash_table *hash_table, size_t size)
 {
-  di_hash_node **new_nodes;
-  di_hash_node *node;
-  di_hash_node *next;
-  uint32_t hash_val;
-  size_t new_size;
+  uint8_t *old_ctrl = hash_table->ctrl;
+  di_hash_node *old_nodes = hash_table->nodes;
+  size_t old_size = hash_table->size;
   size_t i;
 
-  new_size = internal_di_spaced_primes_closest (hash_table->nnodes);
-  new_size = CLAMP (new_size, HASH_TABLE_MIN_SIZE, HASH_TABLE_MAX_SIZE);
+  hash_table->size = size;
+  hash_table->growth_left = HASH_TABLE_CAPACITY (size) - hash_table->nnodes;
+  hash_table->ctrl = di_malloc (size + HASH_GROUP_SIZE);
+  hash_table->nodes = di_new (di_hash_node, size);
+  memset (hash_table->ctrl, HASH_CTRL_EMPTY, size + HASH_GROUP_SIZE);
 
-  new_nodes = di_new0 (di_hash_node*, new_size);
-
-  for (i = 0; i < hash_table->size; i++)
-    for (node = hash_table->nodes[i]; node; node = next)
+  for (i = 0; i < old_size; i++)
+    if (old_ctrl[i] != HASH_CTRL_EMPTY)
     {
-      next = node->next;
-
-      hash_val = (* hash_table->hash_func) (node->key) % new_size;
-
-      node->next = new_nodes[hash_val];
-      new_nodes[hash_val] = node;
+      uint32_t hash = internal_di_hash_mix (hash_table->hash_func (old_nodes[i].key));
+      size_t mask = size - 1, pos = (hash >> 7) & mask, stride = 0;
+      internal_di_hash_mask empty;
+
+      /* all keys are distinct, only an empty slot is needed */
+      while (!(empty = internal_di_hash_group_empty (hash_table->ctrl + pos)))
+      {
+        stride += HASH_GROUP_SIZE;
+        pos = (pos + stride) & mask;
+      }
+      pos = (pos + internal_di_hash_mask_first (empty)) & mask;
+
+      internal_di_hash_table_set_ctrl (hash_table, pos, hash & 0x7f);
+      hash_table->nodes[pos] = old_nodes[i];
     }
 
-  di_free (hash_table->nodes);
-  hash_table->nodes = new_nodes;
-  hash_table->size = new_size;
-}
-
-static const unsigned int internal_di_primes[] =
-{
-  11,
-  19,
-  37,
-  73,
-  109,
-  163,
-  251,
-  367,
-  557,
-  823,
-  1237,
-  1861,
-  2777,
-  4177,
-  6247,
-  9371,
-  14057,
-  21089,
-  31627,
-  47431,
-  71143,
-  106721,
-  160073,
-  240101,
-  360163,
-  540217,
-  810343,
-  1215497,
-  1823231,
-  2734867,
-  4102283,
-  6153409,
-  9230113,
-  13845163,
-};
-
-static const unsigned int internal_di_nprimes = sizeof (internal_di_primes) / sizeof (internal_di_primes[0]);
-
-static unsigned int internal_di_spaced_primes_closest (unsigned int num)
-{
-  unsigned int i;
-
-  for (i = 0; i < internal_di_nprimes; i++)
-    if (internal_di_primes[i] > num)
-      return internal_di_primes[i];
-
-  return internal_di_primes[internal_di_nprimes - 1];
+  di_free (old_ctrl);
+  di_free (old_nodes);
 }
-
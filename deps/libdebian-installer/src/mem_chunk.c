@@ -26,6 +26,7 @@
 #include <debian-installer/mem.h>
 #include <debian-installer/log.h>
 
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -33,6 +34,7 @@
 #define MEM_AREA_SIZE sizeof (void *)
 
 typedef struct di_mem_area di_mem_area;
+typedef struct di_mem_arena_area di_mem_arena_area;
 
 /**
  * @addtogroup di_mem_chunk
@@ -52,6 +54,8 @@ struct di_mem_chunk
   size_t rarea_size;            /**< the size of a real memory area */
   di_mem_area *mem_area;        /**< the current memory area */
   di_mem_area *mem_areas;       /**< a list of all the mem areas owned by this chunk */
+  di_mem_arena *arena;          /**< the arena atoms are allocated from, or NULL */
+  size_t num_atoms;             /**< the number of atoms allocated from the arena */
 };
 
 /**
@@ -74,6 +78,29 @@ struct di_mem_area
                                 */
 };
 
+/**
+ * @internal
+ * @brief a memory arena
+ */
+struct di_mem_arena
+{
+  size_t area_size;             /**< the size of a memory area */
+  size_t size;                  /**< the number of allocated bytes */
+  char *next;                   /**< the free memory of the current area */
+  char *end;                    /**< the end of the current area */
+  di_mem_arena_area *areas;     /**< a list of all the areas, the current one first */
+};
+
+/**
+ * @internal
+ * @brief an area of a memory arena
+ */
+struct di_mem_arena_area
+{
+  di_mem_arena_area *next;      /**< the next area */
+  char mem[MEM_AREA_SIZE];      /**< the memory, see di_mem_area */
+};
+
 static size_t internal_di_mem_chunk_compute_size (size_t size, size_t min_size);
 
 /** @} */
@@ -94,7 +121,7 @@ di_mem_chunk* di_mem_chunk_new (di_ksize_t atom_size, di_ksize_t area_size)
   area_size = (area_size + atom_size - 1) / atom_size;
   area_size *= atom_size;
 
-  mem_chunk = di_new (di_mem_chunk, 1);
+  mem_chunk = di_new0 (di_mem_chunk, 1);
   mem_chunk->num_mem_areas = 0;
   mem_chunk->num_marked_areas = 0;
   mem_chunk->mem_area = NULL;
@@ -110,6 +137,51 @@ di_mem_chunk* di_mem_chunk_new (di_ksize_t atom_size, di_ksize_t area_size)
   return mem_chunk;
 }
 
+/**
+ * Makes a new Memory-Chunk Allocer, which takes all pieces from an arena
+ *
+ * The pieces are freed with the arena, di_mem_chunk_destroy only frees the
+ * di_mem_chunk itself.
+ *
+ * @param atom_size size of each piece
+ * @param arena a di_mem_arena
+ */
+di_mem_chunk* di_mem_chunk_new_arena (di_ksize_t atom_size, di_mem_arena *arena)
+{
+  di_mem_chunk *mem_chunk;
+
+  mem_chunk = di_new0 (di_mem_chunk, 1);
+  mem_chunk->atom_size = atom_size;
+  mem_chunk->arena = arena;
+
+  if (mem_chunk->atom_size % MEM_ALIGN)
+    mem_chunk->atom_size += MEM_ALIGN - (mem_chunk->atom_size % MEM_ALIGN);
+
+  return mem_chunk;
+}
+
+/**
+ * Makes a new, empty Memory-Chunk Allocer with the sizes of another one
+ *
+ * One taking its pieces from an arena uses the same arena.
+ *
+ * @param mem_chunk a di_mem_chunk
+ */
+di_mem_chunk* di_mem_chunk_new_like (di_mem_chunk *mem_chunk)
+{
+  di_mem_chunk *ret;
+
+  ret = di_new (di_mem_chunk, 1);
+  *ret = *mem_chunk;
+  ret->num_mem_areas = 0;
+  ret->num_marked_areas = 0;
+  ret->mem_area = NULL;
+  ret->mem_areas = NULL;
+  ret->num_atoms = 0;
+
+  return ret;
+}
+
 /**
  * Allocate a piece
  *
@@ -121,6 +193,12 @@ void *di_mem_chunk_alloc (di_mem_chunk *mem_chunk)
 {
   void *mem;
 
+  if (mem_chunk->arena)
+  {
+    mem_chunk->num_atoms += 1;
+    return di_mem_arena_alloc (mem_chunk->arena, mem_chunk->atom_size);
+  }
+
   if ((!mem_chunk->mem_area) || ((mem_chunk->mem_area->index + mem_chunk->atom_size) > mem_chunk->area_size))
   {
     mem_chunk->mem_area = di_malloc (mem_chunk->rarea_size);
@@ -180,10 +258,40 @@ void di_mem_chunk_destroy (di_mem_chunk *mem_chunk)
   di_free (mem_chunk);
 }
 
+/**
+ * Moves all pieces of a Memory-Chunk Allocer into another one and destroys it
+ *
+ * Both must have the same atom size, like one created by di_mem_chunk_new_like.
+ * The pieces of one taking them from an arena are moved with the arena, see
+ * di_mem_arena_join.
+ *
+ * @param mem_chunk a di_mem_chunk
+ * @param other the di_mem_chunk to move
+ */
+void di_mem_chunk_join (di_mem_chunk *mem_chunk, di_mem_chunk *other)
+{
+  di_mem_area *last;
+
+  if (other->mem_areas)
+  {
+    for (last = other->mem_areas; last->next; last = last->next);
+
+    /* the current area of mem_chunk stays the one allocated from */
+    last->next = mem_chunk->mem_areas;
+    if (mem_chunk->mem_areas)
+      mem_chunk->mem_areas->prev = last;
+    mem_chunk->mem_areas = other->mem_areas;
+    mem_chunk->num_mem_areas += other->num_mem_areas;
+  }
+  mem_chunk->num_atoms += other->num_atoms;
+
+  di_free (other);
+}
+
 size_t di_mem_chunk_size (di_mem_chunk *mem_chunk)
 {
   di_mem_area *mem_area;
-  size_t size = 0;
+  size_t size = mem_chunk->atom_size * mem_chunk->num_atoms;
 
   for (mem_area = mem_chunk->mem_areas; mem_area; mem_area = mem_area->next)
   {
@@ -193,6 +301,166 @@ size_t di_mem_chunk_size (di_mem_chunk *mem_chunk)
   return size;
 }
 
+/**
+ * Makes a new arena, which allocates memory of any size from large areas
+ * and frees all of it at once
+ *
+ * @param area_size size of each alloced area
+ */
+di_mem_arena *di_mem_arena_new (di_ksize_t area_size)
+{
+  di_mem_arena *arena;
+
+  arena = di_new0 (di_mem_arena, 1);
+  arena->area_size = area_size;
+
+  return arena;
+}
+
+/**
+ * @internal
+ * Allocates a new area of size bytes
+ *
+ * @param current if the area becomes the one allocated from, otherwise it
+ *   only holds a single piece
+ */
+static char *internal_di_mem_arena_area_new (di_mem_arena *arena, size_t size, bool current)
+{
+  di_mem_arena_area *area;
+
+  area = di_malloc (sizeof (di_mem_arena_area) - MEM_AREA_SIZE + size);
+
+  if (current)
+  {
+    area->next = arena->areas;
+    arena->areas = area;
+    arena->next = area->mem;
+    arena->end = area->mem + size;
+  }
+  else
+  {
+    area->next = arena->areas->next;
+    arena->areas->next = area;
+  }
+
+  return area->mem;
+}
+
+/**
+ * @internal
+ * Allocates size bytes, aligned if requested
+ */
+static inline void *internal_di_mem_arena_alloc (di_mem_arena *arena, size_t size, bool align)
+{
+  char *mem = arena->next;
+
+  if (align && (uintptr_t) mem % MEM_ALIGN)
+    mem += MEM_ALIGN - (uintptr_t) mem % MEM_ALIGN;
+
+  arena->size += size;
+
+  /* aligning may pass the end of an area of an unaligned size */
+  if (!mem || mem > arena->end || (size_t) (arena->end - mem) < size)
+  {
+    /* large pieces get an area of their own and don't waste the rest of the current one */
+    if (arena->areas && size > arena->area_size / 4)
+      return internal_di_mem_arena_area_new (arena, size, false);
+    mem = internal_di_mem_arena_area_new (arena, size > arena->area_size ? size : arena->area_size, true);
+  }
+
+  arena->next = mem + size;
+
+  return mem;
+}
+
+/**
+ * Allocate memory from an arena
+ *
+ * @param arena a di_mem_arena
+ * @param size size of the memory
+ *
+ * @return memory, aligned for any pointer
+ */
+void *di_mem_arena_alloc (di_mem_arena *arena, size_t size)
+{
+  return internal_di_mem_arena_alloc (arena, size, true);
+}
+
+/**
+ * Copy a string into an arena
+ *
+ * @param arena a di_mem_arena
+ * @param s a string
+ * @param n length of the string
+ *
+ * @return the zero terminated copy
+ */
+char *di_mem_arena_stradup (di_mem_arena *arena, const char *s, size_t n)
+{
+  char *ret;
+
+  ret = internal_di_mem_arena_alloc (arena, n + 1, false);
+  memcpy (ret, s, n);
+  ret[n] = '\0';
+
+  return ret;
+}
+
+/**
+ * Moves all memory of an arena into another one and destroys it
+ *
+ * @param arena a di_mem_arena
+ * @param other the di_mem_arena to move
+ */
+void di_mem_arena_join (di_mem_arena *arena, di_mem_arena *other)
+{
+  di_mem_arena_area *last;
+
+  if (other->areas)
+  {
+    for (last = other->areas; last->next; last = last->next);
+
+    if (arena->areas)
+    {
+      /* the current area of arena stays the one allocated from */
+      last->next = arena->areas->next;
+      arena->areas->next = other->areas;
+    }
+    else
+    {
+      arena->areas = other->areas;
+      arena->next = other->next;
+      arena->end = other->end;
+    }
+  }
+  arena->size += other->size;
+
+  di_free (other);
+}
+
+/**
+ * Returns the number of bytes allocated from an arena
+ *
+ * @param arena a di_mem_arena
+ */
+size_t di_mem_arena_size (di_mem_arena *arena)
+{
+  return arena->size;
+}
+
+void di_mem_arena_destroy (di_mem_arena *arena)
+{
+  di_mem_arena_area *area, *next;
+
+  for (area = arena->areas; area; area = next)
+  {
+    next = area->next;
+    di_free (area);
+  }
+
+  di_free (arena);
+}
+
 static size_t internal_di_mem_chunk_compute_size (size_t size, size_t min_size)
 {
   size_t power_of_2;
@@ -32,6 +32,14 @@ void internal_di_package_destroy_func (void *data)
 
 void di_package_destroy (di_package *package)
 {
+  di_slist_node *node;
+
+  for (node = package->depends.head; node; node = node->next)
+  {
+    di_package_dependency *d = node->data;
+    di_free (d->version);
+  }
+
   di_free (package->package);
   di_free (package->section);
   di_free (package->maintainer);
@@ -47,6 +55,10 @@ void di_package_destroy (di_package *package)
 
 void di_package_version_free (di_package_version *version)
 {
+  if (!version)
+    return;
+  di_free (version->upstream);
+  di_free (version->debian_revision);
   di_free (version);
 }
 
@@ -108,27 +120,28 @@ int di_package_version_compare(const di_package_version *a, const di_package_ver
   return verrevcmp(a->debian_revision, b->debian_revision);
 }
 
-di_package_version *di_package_version_parse (di_package *package)
+/**
+ * @internal
+ * Parse a version string
+ */
+static di_package_version *internal_di_package_version_parse (const char *string)
 {
   di_package_version *version;
-  char *hyphen, *colon, *eepochcolon, *string;
+  char *hyphen, *colon, *eepochcolon;
   const char *end;
   unsigned long epoch;
 
-  if (!package->version)
-    return NULL;
-
   version = di_new0 (di_package_version, 1);
 
-  string = package->version;
   end = string + strlen (string);
   colon = strchr (string, ':');
   if (colon) {
-    epoch = strtoul (package->version, &eepochcolon, 10);
-    if (colon != eepochcolon)
-      return 0;
-    if (!*++colon)
-      return 0;
+    epoch = strtoul (string, &eepochcolon, 10);
+    if (colon != eepochcolon || !*++colon)
+    {
+      di_free (version);
+      return NULL;
+    }
     string = colon;
     version->epoch = epoch;
   }
@@ -144,6 +157,77 @@ di_package_version *di_package_version_parse (di_package *package)
   return version;
 }
 
+di_package_version *di_package_version_parse (di_package *package)
+{
+  if (!package->version)
+    return NULL;
+
+  return internal_di_package_version_parse (package->version);
+}
+
+/**
+ * Check a version against the version relation of a dependency
+ *
+ * @param version the version, may be NULL
+ * @param relation the relation
+ * @param reference the version of the relation
+ *
+ * @return if version satisfies the relation
+ */
+bool di_package_version_satisfies (const char *version, di_package_dependency_relation relation, const char *reference)
+{
+  di_package_version *a, *b;
+  bool ret = false;
+  int r;
+
+  if (relation == di_package_dependency_relation_none)
+    return true;
+  if (!version || !reference)
+    return false;
+
+  a = internal_di_package_version_parse (version);
+  b = internal_di_package_version_parse (reference);
+  if (a && b)
+  {
+    r = di_package_version_compare (a, b);
+    switch (relation)
+    {
+      case di_package_dependency_relation_earlier:
+        ret = r < 0;
+        break;
+      case di_package_dependency_relation_earlier_equal:
+        ret = r <= 0;
+        break;
+      case di_package_dependency_relation_equal:
+        ret = r == 0;
+        break;
+      case di_package_dependency_relation_later_equal:
+        ret = r >= 0;
+        break;
+      case di_package_dependency_relation_later:
+        ret = r > 0;
+        break;
+      default:
+        break;
+    }
+  }
+
+  di_package_version_free (a);
+  di_package_version_free (b);
+  return ret;
+}
+
+const char *const di_package_dependency_relation_text[] =
+{
+  "",
+  "<<",                                 /* == di_package_dependency_relation_earlier */
+  "<=",                                 /* == di_package_dependency_relation_earlier_equal */
+  "=",                                  /* == di_package_dependency_relation_equal */
+  ">=",                                 /* == di_package_dependency_relation_later_equal */
+  ">>",                                 /* == di_package_dependency_relation_later */
+  NULL
+};
+
 const char *const di_package_priority_text[] =
 {
   "unspecified",
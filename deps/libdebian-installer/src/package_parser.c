@@ -26,6 +26,9 @@
 
 #include <ctype.h>
 #include <stddef.h>
+#include <string.h>
+
+static di_parser_fields_function_read internal_di_package_parser_read_string;
 
 const di_parser_fieldinfo 
   internal_di_package_parser_field_package = 
@@ -64,7 +67,7 @@ const di_parser_fieldinfo
     DI_PARSER_FIELDINFO
     (
       "Section",
-      di_parser_read_string,
+      internal_di_package_parser_read_string,
       di_parser_write_string,
       offsetof (di_package, section)
     ),
@@ -80,7 +83,7 @@ const di_parser_fieldinfo
     DI_PARSER_FIELDINFO
     (
       "Maintainer",
-      di_parser_read_string,
+      internal_di_package_parser_read_string,
       di_parser_write_string,
       offsetof (di_package, maintainer)
     ),
@@ -88,7 +91,7 @@ const di_parser_fieldinfo
     DI_PARSER_FIELDINFO
     (
       "Architecture",
-      di_parser_read_string,
+      internal_di_package_parser_read_string,
       di_parser_write_string,
       offsetof (di_package, architecture)
     ),
@@ -96,7 +99,7 @@ const di_parser_fieldinfo
     DI_PARSER_FIELDINFO
     (
       "Version",
-      di_parser_read_string,
+      internal_di_package_parser_read_string,
       di_parser_write_string,
       offsetof (di_package, version)
     ),
@@ -168,7 +171,7 @@ const di_parser_fieldinfo
     DI_PARSER_FIELDINFO
     (
       "Filename",
-      di_parser_read_string,
+      internal_di_package_parser_read_string,
       di_parser_write_string,
       offsetof (di_package, filename)
     ),
@@ -184,7 +187,7 @@ const di_parser_fieldinfo
     DI_PARSER_FIELDINFO
     (
       "SHA256",
-      di_parser_read_string,
+      internal_di_package_parser_read_string,
       di_parser_write_string,
       offsetof (di_package, sha256)
     ),
@@ -255,6 +258,56 @@ di_package *di_package_special_read_file (const char *file, di_packages *package
   return data.package;
 }
 
+static char *internal_di_package_parser_skip_space (char *cur, const char *end)
+{
+  while (cur < end && isspace (*cur))
+    cur++;
+  return cur;
+}
+
+static char *internal_di_package_parser_skip_to (char *cur, const char *end, const char *reject)
+{
+  while (cur < end && !strchr (reject, *cur))
+    cur++;
+  return cur;
+}
+
+/**
+ * @internal
+ * Read the operator of a version relation, the obsolete < and > mean <=
+ * and >=
+ */
+static di_package_dependency_relation internal_di_package_parser_read_relation (char **cur, const char *end)
+{
+  char *c = *cur;
+  di_package_dependency_relation ret = di_package_dependency_relation_none;
+
+  if (c < end && (*c == '<' || *c == '>'))
+  {
+    bool earlier = *c++ == '<';
+
+    if (c < end && *c == c[-1])
+    {
+      ret = earlier ? di_package_dependency_relation_earlier : di_package_dependency_relation_later;
+      c++;
+    }
+    else
+    {
+      ret = earlier ? di_package_dependency_relation_earlier_equal : di_package_dependency_relation_later_equal;
+      if (c < end && *c == '=')
+        c++;
+    }
+  }
+  else if (c < end && *c == '=')
+  {
+    ret = di_package_dependency_relation_equal;
+    c++;
+  }
+
+  *cur = c;
+  return ret;
+}
+
 void di_package_parser_read_dependency (
   void **data,
   const di_parser_fieldinfo *fip __attribute__ ((unused)),
@@ -265,54 +318,93 @@ void di_package_parser_read_dependency (
   internal_di_package_parser_data *parser_data = user_data;
   di_package *p = *data, *q;
   char *cur = value->string, *end = value->string + value->size;
-  char *namebegin, *fieldend;
+  char *namebegin, *versionbegin;
   size_t namelen;
+  bool alternative = false;
   di_package_dependency *d, *d1;
 
   /*
-   * basic depends line parser. can ignore versioning
-   * info since the depends are already satisfied.
+   * the first package of every group of alternatives gets the type of the
+   * field, the others follow it as di_package_dependency_type_alternative.
+   * architecture qualifiers and restrictions are ignored.
    */
   while (cur < end)
   {
-    namebegin = cur;
-    namelen = strcspn (cur, " \t\n(,|:");
+    namebegin = cur = internal_di_package_parser_skip_space (cur, end);
+    cur = internal_di_package_parser_skip_to (cur, end, " \t\n(,|:");
+    namelen = cur - namebegin;
+    cur = internal_di_package_parser_skip_to (cur, end, " \t\n(,|");
+    cur = internal_di_package_parser_skip_space (cur, end);
 
-    d = di_package_dependency_alloc (parser_data->allocator);
-
-    if (parser_data->packages)
+    if (namelen)
     {
-      q = di_packages_get_package_new (parser_data->packages, parser_data->allocator, namebegin, namelen);
-      d->ptr = q;
-    }
-    else
-      q = NULL;
+      d = di_package_dependency_alloc (parser_data->allocator);
+
+      if (parser_data->packages)
+      {
+        q = di_packages_get_package_new (parser_data->packages, parser_data->allocator, namebegin, namelen);
+        d->ptr = q;
+      }
+      else
+        q = NULL;
 
-    d->type = fip->integer;
-    di_slist_append_chunk (&p->depends, d, parser_data->allocator->slist_node_mem_chunk);
+      d->type = alternative ? di_package_dependency_type_alternative : fip->integer;
 
-    if (q && (d->type == di_package_dependency_type_provides || d->type == di_package_dependency_type_enhances))
-    {
-      if (q->type == di_package_type_non_existent)
-        q->type = di_package_type_virtual_package;
-      if (q->type == di_package_type_virtual_package && q->priority < p->priority)
-        q->priority = p->priority;
-
-      d1 = di_package_dependency_alloc (parser_data->allocator);
-      d1->ptr = p;
-      if (d->type == di_package_dependency_type_provides)
-        d1->type = di_package_dependency_type_reverse_provides;
-      else if (d->type == di_package_dependency_type_enhances)
-        d1->type = di_package_dependency_type_reverse_enhances;
-      di_slist_append_chunk (&q->depends, d1, parser_data->allocator->slist_node_mem_chunk);
+      if (cur < end && *cur == '(')
+      {
+        cur = internal_di_package_parser_skip_space (cur + 1, end);
+        d->relation = internal_di_package_parser_read_relation (&cur, end);
+        versionbegin = cur = internal_di_package_parser_skip_space (cur, end);
+        cur = internal_di_package_parser_skip_to (cur, end, " \t\n),|");
+        if (d->relation && cur > versionbegin)
+          d->version = internal_di_packages_allocator_stradup (parser_data->allocator, versionbegin, cur - versionbegin);
+        else
+          d->relation = di_package_dependency_relation_none;
+      }
+
+      di_slist_append_chunk (&p->depends, d, parser_data->allocator->slist_node_mem_chunk);
+
+      if (q && (d->type == di_package_dependency_type_provides || d->type == di_package_dependency_type_enhances))
+      {
+        if (q->type == di_package_type_non_existent)
+          q->type = di_package_type_virtual_package;
+        if (q->type == di_package_type_virtual_package && q->priority < p->priority)
+          q->priority = p->priority;
+
+        d1 = di_package_dependency_alloc (parser_data->allocator);
+        d1->ptr = p;
+        if (d->type == di_package_dependency_type_provides)
+          d1->type = di_package_dependency_type_reverse_provides;
+        else if (d->type == di_package_dependency_type_enhances)
+          d1->type = di_package_dependency_type_reverse_enhances;
+        di_slist_append_chunk (&q->depends, d1, parser_data->allocator->slist_node_mem_chunk);
+      }
     }
 
-    fieldend = cur + strcspn (cur, "\n,");
-    while (isspace(*++fieldend));
-    cur = fieldend;
+    cur = internal_di_package_parser_skip_to (cur, end, ",|");
+    alternative = cur < end && *cur == '|' && (namelen || alternative);
+    if (cur < end)
+      cur++;
   }
 }
 
+/**
+ * @internal
+ * Append to a growing field value
+ */
+static void internal_di_package_parser_append (di_rstring *value, size_t *value_size, const char *s)
+{
+  size_t n = strlen (s);
+
+  if (value->size + n + 1 > *value_size)
+  {
+    *value_size = value->size + n + 1024;
+    value->string = di_renew (char, value->string, *value_size);
+  }
+  memcpy (value->string + value->size, s, n + 1);
+  value->size += n;
+}
+
 void di_package_parser_write_dependency (
   void **data,
   const di_parser_fieldinfo *fip,
@@ -323,30 +415,35 @@ void di_package_parser_write_dependency (
   di_package *p = *data;
   di_slist_node *node;
   di_rstring value = { NULL, 0 };
-  size_t value_size = 0, value_size_needed;
+  size_t value_size = 0;
+  bool group = false;
 
   for (node = p->depends.head; node; node = node->next)
   {
     di_package_dependency *d = node->data;
 
-    if (d->type == fip->integer && d->ptr)
+    if (d->type != di_package_dependency_type_alternative)
     {
-      size_t size = strlen (d->ptr->package);
-      if (value.size)
-        value_size_needed = size + 2;
-      else
-        value_size_needed = size;
-      if (value.size + value_size_needed > value_size)
-      {
-        size_t new_value_size = value_size + 1024;
-        value.string = di_renew (char, value.string, new_value_size);
-        value.string[value_size] = 0;
-        value_size = new_value_size;
-      }
+      /* alternatives follow the group of the last written dependency */
+      group = d->type == fip->integer && d->ptr;
+      if (!group)
+        continue;
       if (value.size)
-        strcat (value.string, ", ");
-      strcat (value.string, d->ptr->package);
-      value.size += value_size_needed;
+        internal_di_package_parser_append (&value, &value_size, ", ");
+    }
+    else if (group && d->ptr)
+      internal_di_package_parser_append (&value, &value_size, " | ");
+    else
+      continue;
+
+    internal_di_package_parser_append (&value, &value_size, d->ptr->package);
+    if (d->relation && d->version)
+    {
+      internal_di_package_parser_append (&value, &value_size, " (");
+      internal_di_package_parser_append (&value, &value_size, di_package_dependency_relation_text[d->relation]);
+      internal_di_package_parser_append (&value, &value_size, " ");
+      internal_di_package_parser_append (&value, &value_size, d->version);
+      internal_di_package_parser_append (&value, &value_size, ")");
     }
   }
 
@@ -356,21 +453,47 @@ void di_package_parser_write_dependency (
   di_free (value.string);
 }
 
+/**
+ * @internal
+ * Read a string field into the memory of the allocator
+ */
+static void internal_di_package_parser_read_string (
+  void **data,
+  const di_parser_fieldinfo *fip,
+  di_rstring *field_modifier,
+  di_rstring *value,
+  void *user_data)
+{
+  internal_di_package_parser_data *parser_data = user_data;
+  char **f;
+
+  if (!parser_data->allocator || !parser_data->allocator->arena)
+  {
+    di_parser_read_string (data, fip, field_modifier, value, user_data);
+    return;
+  }
+
+  /* a previous value stays in the arena */
+  f = (char **)((char *)*data + fip->integer);
+  *f = internal_di_packages_allocator_stradup (parser_data->allocator, value->string, value->size);
+}
+
 void di_package_parser_read_description (
   void **data,
   const di_parser_fieldinfo *fip __attribute__ ((unused)),
   di_rstring *field_modifier __attribute__ ((unused)),
   di_rstring *value,
-  void *user_data __attribute__ ((unused)))
+  void *user_data)
 {
+  internal_di_package_parser_data *parser_data = user_data;
   di_package *p = *data;
   char *temp;
 
   temp = memchr (value->string, '\n', value->size);
   if (temp)
   {
-    p->short_description = di_stradup (value->string, temp - value->string);
-    p->description = di_stradup (temp + 1, value->string + value->size - temp - 1);
+    p->short_description = internal_di_packages_allocator_stradup (parser_data->allocator, value->string, temp - value->string);
+    p->description = internal_di_packages_allocator_stradup (parser_data->allocator, temp + 1, value->string + value->size - temp - 1);
 #if 0
     fwrite (value->string, value->size, 1, stdout);
     fputs ("\n-----\n", stdout);
@@ -379,7 +502,7 @@ void di_package_parser_read_description (
 #endif
   }
   else
-    p->short_description = di_stradup (value->string, value->size);
+    p->short_description = internal_di_packages_allocator_stradup (parser_data->allocator, value->string, value->size);
 }
 
 void di_package_parser_write_description (
@@ -28,6 +28,20 @@
 
 #include <ctype.h>
 #include <limits.h>
+#include <sys/mman.h>
+
+/**
+ * @addtogroup di_packages
+ * @{
+ */
+
+/**
+ * @internal
+ * Size of the areas of arena allocators
+ */
+#define PACKAGES_ARENA_AREA_SIZE (1024 * 1024)
+
+/** @} */
 
 /**
  * Allocate di_packages
@@ -55,6 +69,25 @@ di_packages_allocator *di_packages_allocator_alloc (void)
   return ret;
 }
 
+/**
+ * Allocate di_packages_allocator, which takes all memory from an arena
+ *
+ * The packages, dependencies, list nodes and strings read with it are
+ * freed all at once with the allocator, di_packages_free leaves them alone.
+ */
+di_packages_allocator *di_packages_allocator_alloc_arena (void)
+{
+  di_packages_allocator *ret;
+
+  ret = di_new0 (di_packages_allocator, 1);
+  ret->arena = di_mem_arena_new (PACKAGES_ARENA_AREA_SIZE);
+  ret->package_mem_chunk = di_mem_chunk_new_arena (sizeof (di_package), ret->arena);
+  ret->package_dependency_mem_chunk = di_mem_chunk_new_arena (sizeof (di_package_dependency), ret->arena);
+  ret->slist_node_mem_chunk = di_mem_chunk_new_arena (sizeof (di_slist_node), ret->arena);
+
+  return ret;
+}
+
 /**
  * @internal
  * Partially allocate di_packages_allocator
@@ -70,6 +103,83 @@ di_packages_allocator *internal_di_packages_allocator_alloc (void)
   return ret;
 }
 
+/**
+ * @internal
+ * Allocate di_packages_allocator with the package size of another one
+ */
+di_packages_allocator *internal_di_packages_allocator_alloc_like (di_packages_allocator *allocator)
+{
+  di_packages_allocator *ret;
+
+  if (allocator->arena)
+    return di_packages_allocator_alloc_arena ();
+
+  ret = internal_di_packages_allocator_alloc ();
+  ret->package_mem_chunk = di_mem_chunk_new_like (allocator->package_mem_chunk);
+
+  return ret;
+}
+
+/**
+ * @internal
+ * Move all memory of a di_packages_allocator into another one and free it
+ */
+void internal_di_packages_allocator_join (di_packages_allocator *allocator, di_packages_allocator *other)
+{
+  di_mem_chunk_join (allocator->package_mem_chunk, other->package_mem_chunk);
+  di_mem_chunk_join (allocator->package_dependency_mem_chunk, other->package_dependency_mem_chunk);
+  di_mem_chunk_join (allocator->slist_node_mem_chunk, other->slist_node_mem_chunk);
+  if (other->arena)
+    di_mem_arena_join (allocator->arena, other->arena);
+  allocator->string_size += other->string_size;
+  di_free (other);
+}
+
+/**
+ * @internal
+ * Copy a string, into the arena of the allocator if it has one
+ */
+char *internal_di_packages_allocator_stradup (di_packages_allocator *allocator, const char *s, size_t n)
+{
+  if (!allocator || !allocator->arena)
+    return di_stradup (s, n);
+
+  allocator->string_size += n + 1;
+  return di_mem_arena_stradup (allocator->arena, s, n);
+}
+
+/**
+ * @internal
+ * Allocate di_packages, which don't free the packages
+ */
+di_packages *internal_di_packages_alloc_unowned (void)
+{
+  di_packages *ret;
+
+  ret = di_new0 (di_packages, 1);
+  ret->table = di_hash_table_new (di_rstring_hash, di_rstring_equal);
+
+  return ret;
+}
+
+/**
+ * @internal
+ * Allocate di_packages for packages read with allocator, which own them
+ * unless they are in its arena
+ */
+di_packages *internal_di_packages_alloc_with (di_packages_allocator *allocator)
+{
+  di_packages *ret;
+
+  if (!allocator->arena)
+    return di_packages_alloc ();
+
+  ret = internal_di_packages_alloc_unowned ();
+  ret->allocator = allocator;
+
+  return ret;
+}
+
 /**
  * Free di_packages
  */
@@ -78,6 +188,11 @@ void di_packages_free (di_packages *packages)
   if (!packages)
     return;
   di_hash_table_destroy (packages->table);
+  internal_di_packages_index_free (packages->index);
+  if (packages->map)
+    munmap (packages->map, packages->map_size);
+  if (packages->lazy_info)
+    di_parser_info_free (packages->lazy_info);
   di_free (packages);
 }
 
@@ -89,9 +204,29 @@ void di_packages_allocator_free (di_packages_allocator *allocator)
   di_mem_chunk_destroy (allocator->package_mem_chunk);
   di_mem_chunk_destroy (allocator->package_dependency_mem_chunk);
   di_mem_chunk_destroy (allocator->slist_node_mem_chunk);
+  if (allocator->arena)
+    di_mem_arena_destroy (allocator->arena);
   di_free (allocator);
 }
 
+/**
+ * Get the memory used by di_packages_allocator
+ *
+ * @param allocator a di_packages_allocator
+ * @param stats returns the number of bytes per category
+ */
+void di_packages_allocator_get_stats (di_packages_allocator *allocator, di_packages_allocator_stats *stats)
+{
+  stats->packages = di_mem_chunk_size (allocator->package_mem_chunk);
+  stats->dependencies = di_mem_chunk_size (allocator->package_dependency_mem_chunk);
+  stats->nodes = di_mem_chunk_size (allocator->slist_node_mem_chunk);
+  stats->strings = allocator->string_size;
+  if (allocator->arena)
+    stats->total = di_mem_arena_size (allocator->arena);
+  else
+    stats->total = stats->packages + stats->dependencies + stats->nodes;
+}
+
 /**
  * append a package.
  *
@@ -152,7 +287,7 @@ di_package *di_packages_get_package_new (di_packages *packages, di_packages_allo
   if (!ret)
   {
     ret = di_package_alloc (allocator);
-    ret->key.string = di_stradup (name, n);
+    ret->key.string = internal_di_packages_allocator_stradup (allocator, name, n);
     ret->key.size = n;
 
     di_hash_table_insert (packages->table, &ret->key, ret);
@@ -161,6 +296,307 @@ di_package *di_packages_get_package_new (di_packages *packages, di_packages_allo
   return ret;
 }
 
+static inline di_package *internal_di_packages_lookup (di_packages *packages, di_package *package)
+{
+  return di_hash_table_lookup (packages->table, &package->key);
+}
+
+#define JOIN_STRING(field) \
+  if (other->field) \
+  { \
+    if (owned) \
+      di_free (package->field); \
+    package->field = other->field; \
+    other->field = NULL; \
+  }
+
+#define JOIN_INT(field) \
+  if (other->field) \
+    package->field = other->field;
+
+/**
+ * @internal
+ * Apply a package of a later part of the file to the one of the same name
+ *
+ * @param owned if the packages own their fields
+ */
+static void internal_di_packages_join_package (di_package *package, di_package *other, bool owned)
+{
+  if (other->type == di_package_type_real_package)
+  {
+    /*
+     * a later entry overwrites the fields it includes.
+     * the priority of a duplicate entry without Priority field may still
+     * include the one of providers of its part of the file.
+     */
+    package->type = di_package_type_real_package;
+    JOIN_INT (status_want);
+    JOIN_INT (status);
+    JOIN_INT (essential);
+    JOIN_INT (priority);
+    JOIN_STRING (section);
+    JOIN_INT (installed_size);
+    JOIN_STRING (maintainer);
+    JOIN_STRING (architecture);
+    JOIN_STRING (version);
+    JOIN_STRING (filename);
+    JOIN_INT (size);
+    JOIN_STRING (sha256);
+    JOIN_STRING (short_description);
+    JOIN_STRING (description);
+    if (other->lazy)
+      package->lazy = other->lazy;
+  }
+  else if (package->type != di_package_type_real_package && other->type == di_package_type_virtual_package)
+  {
+    package->type = di_package_type_virtual_package;
+    if (package->priority < other->priority)
+      package->priority = other->priority;
+  }
+
+  internal_di_slist_append_list (&package->depends, &other->depends);
+}
+
+#undef JOIN_STRING
+#undef JOIN_INT
+
+static void internal_di_packages_join_insert (void *key __attribute__ ((unused)), void *value, void *user_data)
+{
+  di_packages *packages = user_data;
+  di_package *p = value;
+
+  if (!internal_di_packages_lookup (packages, p))
+    di_hash_table_insert (packages->table, &p->key, p);
+}
+
+static void internal_di_packages_join_link (void *key __attribute__ ((unused)), void *value, void *user_data)
+{
+  di_packages *packages = user_data;
+  di_package *p = value, *q;
+  di_slist_node *node;
+
+  for (node = p->depends.head; node; node = node->next)
+  {
+    di_package_dependency *d = node->data;
+    d->ptr = internal_di_packages_lookup (packages, d->ptr);
+  }
+
+  q = internal_di_packages_lookup (packages, p);
+  if (q != p)
+    internal_di_packages_join_package (q, p, !packages->allocator);
+}
+
+static void internal_di_packages_join_free (void *key __attribute__ ((unused)), void *value, void *user_data)
+{
+  di_packages *packages = user_data;
+  di_package *p = value;
+
+  if (!packages->allocator && internal_di_packages_lookup (packages, p) != p)
+    di_package_destroy (p);
+}
+
+/**
+ * @internal
+ * Move the packages of a later part of a file into packages and free it
+ *
+ * Packages already known by name take the fields and dependencies of the
+ * moved ones, in the order they would get them from a single parser, and
+ * all dependencies are pointed to the packages in packages.
+ * The memory of other must be moved with internal_di_packages_allocator_join.
+ */
+void internal_di_packages_join (di_packages *packages, di_packages *other)
+{
+  di_slist_node *node;
+
+  di_hash_table_foreach (other->table, internal_di_packages_join_insert, packages);
+  /* the names of all packages in other are still valid until the last pass */
+  di_hash_table_foreach (other->table, internal_di_packages_join_link, packages);
+
+  for (node = other->list.head; node; node = node->next)
+    node->data = internal_di_packages_lookup (packages, node->data);
+  internal_di_slist_append_list (&packages->list, &other->list);
+
+  di_hash_table_foreach (other->table, internal_di_packages_join_free, packages);
+  di_hash_table_destroy (other->table);
+  di_free (other);
+}
+
+/**
+ * @internal
+ * Check if a package is copied by di_packages_compact
+ */
+static bool internal_di_packages_compact_copied (di_packages *ret, di_package *p)
+{
+  di_package *q = di_packages_get_package (ret, p->key.string, p->key.size);
+  return q && q->type == di_package_type_real_package;
+}
+
+static void internal_di_packages_compact_append (di_package *q, di_package *ptr, di_package_dependency_type type, di_package_dependency *d, di_packages_allocator *allocator)
+{
+  di_package_dependency *d1 = di_package_dependency_alloc (allocator);
+
+  d1->type = type;
+  d1->ptr = ptr;
+  if (d && d->version)
+  {
+    d1->relation = d->relation;
+    d1->version = internal_di_packages_allocator_stradup (allocator, d->version, strlen (d->version));
+  }
+  di_slist_append_chunk (&q->depends, d1, allocator->slist_node_mem_chunk);
+}
+
+/**
+ * @internal
+ * Get the copy of a dependency target, a stub if it is not copied
+ *
+ * Stubs of real packages don't exist, stubs of virtual packages are
+ * provided by the copied providers only.
+ */
+static di_package *internal_di_packages_compact_target (di_packages *ret, di_package *p, di_packages_allocator *allocator)
+{
+  di_package *q = di_packages_get_package (ret, p->key.string, p->key.size);
+  di_slist_node *node;
+
+  if (q)
+    return q;
+
+  q = di_package_alloc (allocator);
+  q->key.string = internal_di_packages_allocator_stradup (allocator, p->key.string, p->key.size);
+  q->key.size = p->key.size;
+  q->type = p->type == di_package_type_virtual_package ? p->type : di_package_type_non_existent;
+  q->priority = p->priority;
+  di_hash_table_insert (ret->table, &q->key, q);
+
+  if (q->type == di_package_type_virtual_package)
+    for (node = p->depends.head; node; node = node->next)
+    {
+      di_package_dependency *d = node->data;
+
+      if (d->type == di_package_dependency_type_reverse_provides && internal_di_packages_compact_copied (ret, d->ptr))
+        internal_di_packages_compact_append (q, di_packages_get_package (ret, d->ptr->key.string, d->ptr->key.size),
+                                             d->type, NULL, allocator);
+    }
+
+  return q;
+}
+
+/**
+ * @internal
+ * Copy the dependency groups and provides of a package
+ *
+ * Alternatives which are not copied are dropped, the first remaining one
+ * starts the group.
+ */
+static void internal_di_packages_compact_depends (di_packages *ret, di_package *p, di_package *q, di_packages_allocator *allocator)
+{
+  di_slist_node *node, *next;
+
+  for (node = p->depends.head; node; node = next)
+  {
+    di_package_dependency *head = node->data;
+    di_package_dependency_type type = head->type;
+    bool kept = false;
+
+    next = node->next;
+
+    if (type == di_package_dependency_type_provides && head->ptr && head->ptr->type == di_package_type_virtual_package)
+    {
+      internal_di_packages_compact_append (q, internal_di_packages_compact_target (ret, head->ptr, allocator), type, head, allocator);
+      continue;
+    }
+    if ((type != di_package_dependency_type_depends && type != di_package_dependency_type_pre_depends) || !head->ptr)
+      continue;
+
+    for (; node; node = node->next)
+    {
+      di_package_dependency *d = node->data;
+
+      if (d != head && d->type != di_package_dependency_type_alternative)
+        break;
+      if (!d->ptr || (d->ptr->type == di_package_type_real_package && !internal_di_packages_compact_copied (ret, d->ptr)))
+        continue;
+
+      internal_di_packages_compact_append (q, internal_di_packages_compact_target (ret, d->ptr, allocator),
+                                           kept ? di_package_dependency_type_alternative : type, d, allocator);
+      kept = true;
+    }
+    next = node;
+
+    /* unsatisfiable within the copy, like it was before */
+    if (!kept)
+      internal_di_packages_compact_append (q, internal_di_packages_compact_target (ret, head->ptr, allocator), type, head, allocator);
+  }
+}
+
+/**
+ * Copy the packages of a list into new packages
+ *
+ * The copies keep the fields needed to download and install them, and
+ * the dependencies needed to resolve them again: their Depends and
+ * Pre-Depends, without alternatives outside of the list, and their
+ * Provides.  The dependency targets which are not in the list are added
+ * as stubs.  Afterwards packages and its allocator may be freed.
+ *
+ * @param packages the packages
+ * @param list the packages to copy, which must include the packages their
+ *             dependencies were resolved with
+ * @param allocator the allocator for the copies
+ *
+ * @return the copies, with list holding the copies of list
+ */
+di_packages *di_packages_compact (di_packages *packages, di_slist *list, di_packages_allocator *allocator)
+{
+  di_packages *ret = internal_di_packages_alloc_with (allocator);
+  di_slist_node *node;
+
+#define COPY_STRING(field) \
+  if (p->field) \
+    q->field = internal_di_packages_allocator_stradup (allocator, p->field, strlen (p->field));
+
+  for (node = list->head; node; node = node->next)
+  {
+    di_package *p = node->data, *q;
+
+    if (p->type != di_package_type_real_package || di_packages_get_package (ret, p->key.string, p->key.size))
+      continue;
+    if (packages->map)
+      di_packages_materialize_package (packages, p);
+
+    q = di_package_alloc (allocator);
+    q->key.string = internal_di_packages_allocator_stradup (allocator, p->key.string, p->key.size);
+    q->key.size = p->key.size;
+    q->type = p->type;
+    q->status_want = p->status_want;
+    q->status = p->status;
+    q->essential = p->essential;
+    q->priority = p->priority;
+    q->installed_size = p->installed_size;
+    q->size = p->size;
+    COPY_STRING (version);
+    COPY_STRING (filename);
+    COPY_STRING (sha256);
+
+    di_hash_table_insert (ret->table, &q->key, q);
+    di_slist_append_chunk (&ret->list, q, allocator->slist_node_mem_chunk);
+  }
+
+#undef COPY_STRING
+
+  /* all copies exist before the first dependency is looked at */
+  for (node = list->head; node; node = node->next)
+  {
+    di_package *p = node->data, *q;
+
+    if (p->type != di_package_type_real_package)
+      continue;
+    q = di_packages_get_package (ret, p->key.string, p->key.size);
+    if (!q->depends.head)
+      internal_di_packages_compact_depends (ret, p, q, allocator);
+  }
+
+  return ret;
+}
+
 bool di_packages_resolve_dependencies_recurse (di_packages_resolve_dependencies_check *r, di_package *package, di_package *dependend_package)
 {
   di_slist_node *node;
@@ -355,11 +791,16 @@ di_slist *di_packages_resolve_dependencies_special (di_packages *packages, di_sl
       internal_di_slist_append_list (install, &data.list);
   }
 
+  di_packages_materialize_list (packages, install);
+
   return install;
 }
 
 di_slist *di_packages_resolve_dependencies (di_packages *packages, di_slist *list, di_packages_allocator *allocator)
 {
+  if (packages->index)
+    return internal_di_packages_index_resolve_dependencies (packages, list, NULL, allocator);
+
   struct di_packages_resolve_dependencies_check s =
   {
     di_packages_resolve_dependencies_check_real,
@@ -394,11 +835,16 @@ di_slist *di_packages_resolve_dependencies_array_special (di_packages *packages,
     if (di_packages_resolve_dependencies_recurse (s, *array++, NULL))
       internal_di_slist_append_list (install, &data.list);
 
+  di_packages_materialize_list (packages, install);
+
   return install;
 }
 
 di_slist *di_packages_resolve_dependencies_array (di_packages *packages, di_package **array, di_packages_allocator *allocator)
 {
+  if (packages->index)
+    return internal_di_packages_index_resolve_dependencies (packages, NULL, array, allocator);
+
   struct di_packages_resolve_dependencies_check s =
   {
     di_packages_resolve_dependencies_check_real,
@@ -445,3 +891,23 @@ void di_packages_resolve_dependencies_mark (di_packages *packages)
   di_packages_resolve_dependencies_mark_special (packages, &s);
 }
 
+/**
+ * Set the status of a package, also in the index of the packages
+ *
+ * Every change is counted in packages->status_changes, so results which
+ * depend on the status can be kept until it changes.
+ *
+ * @param packages the packages structure
+ * @param package the package
+ * @param status the new status
+ */
+void di_packages_set_status (di_packages *packages, di_package *package, di_package_status status)
+{
+  if (package->status == status)
+    return;
+
+  package->status = status;
+  packages->status_changes++;
+  if (packages->index)
+    packages->index->status[package->id] = status;
+}
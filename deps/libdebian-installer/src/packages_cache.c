@@ -0,0 +1,343 @@
+/*
+ * packages_cache.c
+ *
+ * Copyright (C) 2003 Bastian Blank <waldi@debian.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <config.h>
+
+#include <debian-installer/packages_internal.h>
+
+#include <debian-installer/package_internal.h>
+#include <debian-installer/parser_rfc822.h>
+
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+/**
+ * @addtogroup di_packages_cache
+ * @{
+ */
+
+#define CACHE_MAGIC "DIPKGIX2"
+#define CACHE_BYTE_ORDER 0x01020304
+
+/**
+ * @internal
+ * Data for writing a cache file
+ */
+struct internal_di_packages_cache_write
+{
+  di_packages *packages;
+  di_hash_table *index;                                 /**< package to index + 1 */
+  di_package **array;
+  uint32_t nr;
+  char *strings;
+  size_t strings_size;
+  size_t strings_alloc;
+};
+
+/** @} */
+
+static uint32_t internal_di_packages_cache_pointer_hash (const void *key)
+{
+  return (uintptr_t) key / sizeof (void *);
+}
+
+static bool internal_di_packages_cache_pointer_equal (const void *key1, const void *key2)
+{
+  return key1 == key2;
+}
+
+static void internal_di_packages_cache_collect (void *key __attribute__ ((unused)), void *value, void *user_data)
+{
+  struct internal_di_packages_cache_write *w = user_data;
+  di_package *p = value;
+
+  /* the written fields may be unread */
+  di_packages_materialize_package (w->packages, p);
+  w->array[w->nr++] = p;
+  di_hash_table_insert (w->index, p, (void *) (uintptr_t) w->nr);
+}
+
+static uint32_t internal_di_packages_cache_string (struct internal_di_packages_cache_write *w, const char *string)
+{
+  size_t size, ret = w->strings_size;
+
+  if (!string)
+    return 0;
+
+  size = strlen (string) + 1;
+  if (w->strings_size + size > w->strings_alloc)
+  {
+    w->strings_alloc = (w->strings_size + size) * 2;
+    w->strings = di_renew (char, w->strings, w->strings_alloc);
+  }
+  memcpy (w->strings + w->strings_size, string, size);
+  w->strings_size += size;
+
+  return ret;
+}
+
+static uint32_t internal_di_packages_cache_index (struct internal_di_packages_cache_write *w, di_package *p)
+{
+  return (uintptr_t) di_hash_table_lookup (w->index, p) - 1;
+}
+
+int di_packages_cache_write (di_packages *packages, const char *file)
+{
+  struct internal_di_packages_cache_write w = { packages, NULL, NULL, 0, NULL, 0, 0 };
+  struct internal_di_packages_cache_header header;
+  struct internal_di_packages_cache_package *records;
+  struct internal_di_packages_cache_dependency *deps = NULL;
+  uint32_t *list = NULL;
+  size_t deps_nr = 0, deps_alloc = 0, list_nr = 0, i;
+  di_slist_node *node;
+  char tmpfile[PATH_MAX];
+  FILE *f;
+  int ret = -1;
+
+  w.index = di_hash_table_new (internal_di_packages_cache_pointer_hash, internal_di_packages_cache_pointer_equal);
+  w.array = di_new (di_package *, di_hash_table_size (packages->table));
+  di_hash_table_foreach (packages->table, internal_di_packages_cache_collect, &w);
+
+  /* offset 0 is NULL */
+  internal_di_packages_cache_string (&w, "");
+
+  records = di_new0 (struct internal_di_packages_cache_package, w.nr);
+  for (i = 0; i < w.nr; i++)
+  {
+    di_package *p = w.array[i];
+    struct internal_di_packages_cache_package *r = &records[i];
+
+    r->package = internal_di_packages_cache_string (&w, p->package);
+    r->package_size = p->key.size;
+    r->section = internal_di_packages_cache_string (&w, p->section);
+    r->version = internal_di_packages_cache_string (&w, p->version);
+    r->filename = internal_di_packages_cache_string (&w, p->filename);
+    r->sha256 = internal_di_packages_cache_string (&w, p->sha256);
+    r->installed_size = p->installed_size;
+    r->type = p->type;
+    r->priority = p->priority;
+    r->essential = p->essential;
+    r->size = p->size;
+
+    r->depends = deps_nr;
+    for (node = p->depends.head; node; node = node->next)
+    {
+      di_package_dependency *d = node->data;
+
+      if (deps_nr == deps_alloc)
+      {
+        deps_alloc = deps_alloc ? deps_alloc * 2 : 4096;
+        deps = di_renew (struct internal_di_packages_cache_dependency, deps, deps_alloc);
+      }
+      deps[deps_nr].package = internal_di_packages_cache_index (&w, d->ptr);
+      deps[deps_nr].type = d->type;
+      deps[deps_nr].relation = d->relation;
+      deps[deps_nr].version = internal_di_packages_cache_string (&w, d->version);
+      deps_nr++;
+    }
+    r->depends_count = deps_nr - r->depends;
+  }
+
+  for (node = packages->list.head; node; node = node->next)
+    list_nr++;
+  list = di_new (uint32_t, list_nr ? list_nr : 1);
+  for (node = packages->list.head, i = 0; node; node = node->next, i++)
+    list[i] = internal_di_packages_cache_index (&w, node->data);
+
+  memset (&header, 0, sizeof (header));
+  memcpy (header.magic, CACHE_MAGIC, sizeof (header.magic));
+  header.byte_order = CACHE_BYTE_ORDER;
+  header.packages = w.nr;
+  header.dependencies = deps_nr;
+  header.list = list_nr;
+  header.strings = w.strings_size;
+
+  snprintf (tmpfile, sizeof (tmpfile), "%s.tmp", file);
+  if (!(f = fopen (tmpfile, "w")))
+    goto cleanup;
+
+  if (fwrite (&header, sizeof (header), 1, f) != 1 ||
+      fwrite (records, sizeof (*records), w.nr, f) != w.nr ||
+      fwrite (deps, sizeof (*deps), deps_nr, f) != deps_nr ||
+      fwrite (list, sizeof (*list), list_nr, f) != list_nr ||
+      fwrite (w.strings, 1, w.strings_size, f) != w.strings_size)
+  {
+    fclose (f);
+    unlink (tmpfile);
+    goto cleanup;
+  }
+
+  if (fclose (f) || rename (tmpfile, file))
+  {
+    unlink (tmpfile);
+    goto cleanup;
+  }
+
+  ret = 0;
+
+cleanup:
+  di_free (list);
+  di_free (deps);
+  di_free (records);
+  di_free (w.strings);
+  di_free (w.array);
+  di_hash_table_destroy (w.index);
+
+  return ret;
+}
+
+static bool internal_di_packages_cache_dependency_type (uint16_t type)
+{
+  switch (type)
+  {
+    case di_package_dependency_type_replaces:
+    case di_package_dependency_type_provides:
+    case di_package_dependency_type_depends:
+    case di_package_dependency_type_pre_depends:
+    case di_package_dependency_type_recommends:
+    case di_package_dependency_type_suggests:
+    case di_package_dependency_type_conflicts:
+    case di_package_dependency_type_enhances:
+    case di_package_dependency_type_reverse_provides:
+    case di_package_dependency_type_reverse_enhances:
+    case di_package_dependency_type_alternative:
+      return true;
+  }
+  return false;
+}
+
+di_packages *di_packages_cache_read (const char *file, di_packages_allocator *allocator)
+{
+  const struct internal_di_packages_cache_header *header;
+  const struct internal_di_packages_cache_package *records;
+  const struct internal_di_packages_cache_dependency *deps;
+  const uint32_t *list;
+  di_package **array = NULL;
+  di_packages *ret;
+  char *begin, *strings;
+  size_t size;
+  uint64_t expected;
+  uint32_t i, j;
+
+  if (di_parser_rfc822_map_file (file, &begin, &size) < 0 || !begin)
+    return NULL;
+
+  ret = internal_di_packages_alloc_unowned ();
+  if (allocator->arena)
+    ret->allocator = allocator;
+  ret->map = begin;
+  ret->map_size = size;
+
+  header = (const void *) begin;
+  if (size < sizeof (*header) ||
+      memcmp (header->magic, CACHE_MAGIC, sizeof (header->magic)) ||
+      header->byte_order != CACHE_BYTE_ORDER)
+    goto error;
+
+  expected = sizeof (*header) +
+             (uint64_t) header->packages * sizeof (*records) +
+             (uint64_t) header->dependencies * sizeof (*deps) +
+             (uint64_t) header->list * sizeof (*list) +
+             header->strings;
+  if (expected != size || !header->strings)
+    goto error;
+
+  records = (const void *) (header + 1);
+  deps = (const void *) (records + header->packages);
+  list = (const void *) (deps + header->dependencies);
+  strings = (char *) (list + header->list);
+  /* every string ends within the table */
+  if (strings[header->strings - 1])
+    goto error;
+
+#define STRING(offset) ((offset) ? strings + (offset) : NULL)
+#define CHECK(cond) if (!(cond)) goto error
+
+  array = di_new (di_package *, header->packages ? header->packages : 1);
+  for (i = 0; i < header->packages; i++)
+  {
+    const struct internal_di_packages_cache_package *r = &records[i];
+    di_package *p;
+
+    CHECK (r->package && r->package < header->strings && r->package_size < header->strings - r->package);
+    CHECK (r->section < header->strings && r->version < header->strings);
+    CHECK (r->filename < header->strings && r->sha256 < header->strings);
+    CHECK (r->depends <= header->dependencies && r->depends_count <= header->dependencies - r->depends);
+    /* the index uses them as array keys */
+    CHECK (r->type <= di_package_type_real_package && r->priority <= di_package_priority_required);
+
+    p = array[i] = di_package_alloc (allocator);
+    p->key.string = STRING (r->package);
+    p->key.size = r->package_size;
+    p->section = STRING (r->section);
+    p->version = STRING (r->version);
+    p->filename = STRING (r->filename);
+    p->sha256 = STRING (r->sha256);
+    p->installed_size = r->installed_size;
+    p->type = r->type;
+    p->priority = r->priority;
+    p->essential = r->essential;
+    p->size = r->size;
+
+    di_hash_table_insert (ret->table, &p->key, p);
+  }
+
+  for (i = 0; i < header->packages; i++)
+  {
+    const struct internal_di_packages_cache_package *r = &records[i];
+
+    for (j = r->depends; j < r->depends + r->depends_count; j++)
+    {
+      di_package_dependency *d;
+
+      CHECK (deps[j].package < header->packages && deps[j].version < header->strings);
+      CHECK (internal_di_packages_cache_dependency_type (deps[j].type));
+      CHECK (deps[j].relation <= di_package_dependency_relation_later);
+      d = di_package_dependency_alloc (allocator);
+      d->ptr = array[deps[j].package];
+      d->type = deps[j].type;
+      d->relation = deps[j].relation;
+      d->version = STRING (deps[j].version);
+      di_slist_append_chunk (&array[i]->depends, d, allocator->slist_node_mem_chunk);
+    }
+  }
+
+  for (i = 0; i < header->list; i++)
+  {
+    CHECK (list[i] < header->packages);
+    di_slist_append_chunk (&ret->list, array[list[i]], allocator->slist_node_mem_chunk);
+  }
+
+#undef STRING
+#undef CHECK
+
+  di_free (array);
+
+  return ret;
+
+error:
+  di_free (array);
+  di_packages_free (ret);
+  return NULL;
+}
@@ -0,0 +1,780 @@
+/*
+ * packages_index.c
+ *
+ * Copyright (C) 2003 Bastian Blank <waldi@debian.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+#include <debian-installer/packages_internal.h>
+
+#include <debian-installer/log.h>
+#include <debian-installer/package_internal.h>
+#include <debian-installer/slist_internal.h>
+
+#include <string.h>
+#include <strings.h>
+
+/**
+ * @addtogroup di_packages
+ * @{
+ */
+
+#define INDEX_ID_NONE UINT32_MAX
+
+/**
+ * @internal
+ * Marks of the resolver: the epoch of the resolve is stored shifted, the
+ * lowest bit is set while the package is okay
+ */
+#define INDEX_MARK_OK 1
+#define INDEX_MARK_EPOCH_MAX (UINT32_MAX >> 1)
+
+/**
+ * @internal
+ * A package on the stack of the resolver
+ */
+struct internal_di_packages_index_frame
+{
+  uint32_t id;
+  uint32_t edge;                                        /**< next edge to check */
+};
+
+/**
+ * @internal
+ * State of the resolver choosing the smallest closure, see
+ * di_packages_index_choose_smallest
+ *
+ * The alternatives of edge e are alternative_target[alternative[e]] to
+ * alternative_target[alternative[e + 1] - 1], the first is the target of
+ * the edge.
+ */
+struct internal_di_packages_index_smallest
+{
+  uint32_t *alternative;                                /**< first alternative by edge */
+  uint32_t *alternative_target;                         /**< ID of each alternative */
+  di_package_dependency **alternative_dependency;       /**< dependency of each alternative */
+  uint8_t *chosen;                                      /**< set for the packages of earlier resolves */
+  uint32_t *trial;                                      /**< epoch of the last trial which saw the ID */
+  uint32_t trial_epoch;
+  uint32_t *trial_stack;
+  uint32_t *option[2];                                  /**< options of an edge, for the resolve and the trial */
+  uint32_t option_alloc[2];
+};
+
+/**
+ * @internal
+ * State of a resolve on the index
+ */
+struct internal_di_packages_index_resolve
+{
+  di_packages *packages;
+  di_packages_index *index;
+  uint32_t epoch;                                       /**< shifted epoch of this resolve */
+  di_slist list;                                        /**< packages marked since the last root */
+  di_packages_allocator *allocator;
+};
+
+/** @} */
+
+static void internal_di_packages_index_unnumber (void *key __attribute__ ((unused)), void *value, void *user_data __attribute__ ((unused)))
+{
+  di_package *p = value;
+  p->id = INDEX_ID_NONE;
+}
+
+static void internal_di_packages_index_number (di_packages_index *index, di_package *p)
+{
+  if (p->id != INDEX_ID_NONE)
+    return;
+
+  p->id = index->count++;
+  index->package[p->id] = p;
+}
+
+static void internal_di_packages_index_number_rest (void *key __attribute__ ((unused)), void *value, void *user_data)
+{
+  internal_di_packages_index_number (user_data, value);
+}
+
+static bool internal_di_packages_index_is_edge (di_package *p, di_package_dependency *d)
+{
+  return p->type == di_package_type_real_package &&
+         (d->type == di_package_dependency_type_depends ||
+          d->type == di_package_dependency_type_pre_depends);
+}
+
+static bool internal_di_packages_index_is_provide (di_package *p __attribute__ ((unused)), di_package_dependency *d)
+{
+  return d->type == di_package_dependency_type_reverse_provides;
+}
+
+/**
+ * @internal
+ * Collect the targets of some dependencies of all packages in compressed
+ * sparse row form, in the order of the dependencies
+ */
+static void internal_di_packages_index_links (di_packages_index *index, uint32_t **start, uint32_t **target, bool (*is_link) (di_package *p, di_package_dependency *d))
+{
+  di_slist_node *node;
+  uint32_t id, links = 0;
+
+  *start = di_new (uint32_t, index->count + 1);
+  for (id = 0; id < index->count; id++)
+  {
+    di_package *p = index->package[id];
+
+    (*start)[id] = links;
+    for (node = p->depends.head; node; node = node->next)
+      if (is_link (p, node->data))
+        links++;
+  }
+  (*start)[index->count] = links;
+
+  *target = di_new (uint32_t, links ? links : 1);
+  for (id = 0, links = 0; id < index->count; id++)
+  {
+    di_package *p = index->package[id];
+
+    for (node = p->depends.head; node; node = node->next)
+    {
+      di_package_dependency *d = node->data;
+      if (is_link (p, d))
+        (*target)[links++] = d->ptr->id;
+    }
+  }
+}
+
+/**
+ * @internal
+ * Sort the IDs by key, keeping them in ID order for every key
+ */
+static void internal_di_packages_index_postings_build (di_packages_index_postings *postings, uint32_t keys, const uint32_t *key, uint32_t count)
+{
+  uint32_t k, id;
+
+  postings->keys = keys;
+  postings->start = di_new0 (uint32_t, keys + 1);
+  postings->id = di_new (uint32_t, count ? count : 1);
+
+  for (id = 0; id < count; id++)
+    postings->start[key[id] + 1]++;
+  for (k = 0; k < keys; k++)
+    postings->start[k + 1] += postings->start[k];
+
+  /* start[k] is moved to the end of key k while filling */
+  for (id = 0; id < count; id++)
+    postings->id[postings->start[key[id]]++] = id;
+  for (k = keys; k > 0; k--)
+    postings->start[k] = postings->start[k - 1];
+  postings->start[0] = 0;
+}
+
+static void internal_di_packages_index_postings_free (di_packages_index_postings *postings)
+{
+  di_free (postings->start);
+  di_free (postings->id);
+}
+
+/**
+ * @internal
+ * Build the secondary indices, real packages without a section get the
+ * key after the last section, which is not part of by_section
+ */
+static void internal_di_packages_index_secondary (di_packages_index *index)
+{
+  uint32_t *key = di_new (uint32_t, index->count ? index->count : 1);
+  di_rstring *names = di_new (di_rstring, index->count ? index->count : 1);
+  di_hash_table *sections = di_hash_table_new (di_rstring_hash, di_rstring_equal);
+  uint32_t id, count = 0;
+
+  for (id = 0; id < index->count; id++)
+    key[id] = index->essential[id];
+  internal_di_packages_index_postings_build (&index->by_essential, 2, key, index->count);
+
+  for (id = 0; id < index->count; id++)
+    key[id] = index->priority[id];
+  internal_di_packages_index_postings_build (&index->by_priority, di_package_priority_required + 1, key, index->count);
+
+  index->section = di_new (char *, index->count ? index->count : 1);
+  for (id = 0; id < index->count; id++)
+  {
+    char *section = index->package[id]->section;
+    void *value;
+
+    key[id] = UINT32_MAX;
+    if (!section || index->type[id] != di_package_type_real_package)
+      continue;
+
+    names[count].string = section;
+    names[count].size = strlen (section);
+    value = di_hash_table_lookup (sections, &names[count]);
+    if (value)
+      key[id] = (uintptr_t) value - 1;
+    else
+    {
+      index->section[count] = section;
+      di_hash_table_insert (sections, &names[count], (void *) (uintptr_t) (count + 1));
+      key[id] = count++;
+    }
+  }
+  for (id = 0; id < index->count; id++)
+    if (key[id] == UINT32_MAX)
+      key[id] = count;
+  internal_di_packages_index_postings_build (&index->by_section, count + 1, key, index->count);
+  index->by_section.keys = count;
+
+  index->provides.keys = index->count;
+  internal_di_packages_index_links (index, &index->provides.start, &index->provides.id, internal_di_packages_index_is_provide);
+
+  di_hash_table_destroy (sections);
+  di_free (names);
+  di_free (key);
+}
+
+di_packages_index *di_packages_index_build (di_packages *packages)
+{
+  di_packages_index *index;
+  di_slist_node *node;
+  uint32_t id;
+
+  if (packages->index)
+    return packages->index;
+
+  index = di_new0 (di_packages_index, 1);
+  index->package = di_new (di_package *, di_hash_table_size (packages->table));
+
+  /* packages of the file keep its order, the others follow */
+  di_hash_table_foreach (packages->table, internal_di_packages_index_unnumber, NULL);
+  for (node = packages->list.head; node; node = node->next)
+    internal_di_packages_index_number (index, node->data);
+  di_hash_table_foreach (packages->table, internal_di_packages_index_number_rest, index);
+
+  index->type = di_new (uint8_t, index->count);
+  index->priority = di_new (uint8_t, index->count);
+  index->essential = di_new (uint8_t, index->count);
+  index->status = di_new (uint8_t, index->count);
+  index->resolver = di_new0 (uint32_t, index->count);
+
+  for (id = 0; id < index->count; id++)
+  {
+    di_package *p = index->package[id];
+
+    index->type[id] = p->type;
+    index->priority[id] = p->priority;
+    index->essential[id] = p->essential != 0;
+    index->status[id] = p->status;
+  }
+
+  internal_di_packages_index_links (index, &index->edge, &index->edge_target, internal_di_packages_index_is_edge);
+  internal_di_packages_index_secondary (index);
+
+  packages->index = index;
+  return index;
+}
+
+uint32_t di_packages_index_section (di_packages_index *index, const char *section)
+{
+  uint32_t k;
+
+  for (k = 0; k < index->by_section.keys; k++)
+    /* the same comparison as di_rstring_equal, used to merge them */
+    if (!strcasecmp (index->section[k], section))
+      return k;
+
+  return UINT32_MAX;
+}
+
+/**
+ * @internal
+ * Free the index of packages
+ */
+void internal_di_packages_index_free (di_packages_index *index)
+{
+  if (!index)
+    return;
+  di_free (index->package);
+  di_free (index->type);
+  di_free (index->priority);
+  di_free (index->essential);
+  di_free (index->status);
+  di_free (index->edge);
+  di_free (index->edge_target);
+  internal_di_packages_index_postings_free (&index->by_essential);
+  internal_di_packages_index_postings_free (&index->by_priority);
+  internal_di_packages_index_postings_free (&index->by_section);
+  di_free (index->section);
+  internal_di_packages_index_postings_free (&index->provides);
+  di_free (index->resolver);
+  di_free (index->resolver_stack);
+  if (index->smallest)
+  {
+    di_free (index->smallest->alternative);
+    di_free (index->smallest->alternative_target);
+    di_free (index->smallest->alternative_dependency);
+    di_free (index->smallest->chosen);
+    di_free (index->smallest->trial);
+    di_free (index->smallest->trial_stack);
+    di_free (index->smallest->option[0]);
+    di_free (index->smallest->option[1]);
+    di_free (index->smallest);
+  }
+  di_free (index);
+}
+
+void di_packages_index_choose_smallest (di_packages_index *index)
+{
+  struct internal_di_packages_index_smallest *s;
+  di_slist_node *node;
+  uint32_t id, alternatives = 0, e = 0;
+
+  if (index->smallest)
+    return;
+
+  s = di_new0 (struct internal_di_packages_index_smallest, 1);
+  s->alternative = di_new (uint32_t, index->edge[index->count] + 1);
+
+  /* edges are numbered like in internal_di_packages_index_links */
+  for (id = 0; id < index->count; id++)
+  {
+    di_package *p = index->package[id];
+    bool group = false;
+
+    for (node = p->depends.head; node; node = node->next)
+    {
+      di_package_dependency *d = node->data;
+
+      if (internal_di_packages_index_is_edge (p, d))
+        s->alternative[e++] = alternatives;
+      else if (!group || d->type != di_package_dependency_type_alternative || !d->ptr)
+      {
+        group = false;
+        continue;
+      }
+      group = true;
+      alternatives++;
+    }
+  }
+  s->alternative[e] = alternatives;
+
+  s->alternative_target = di_new (uint32_t, alternatives ? alternatives : 1);
+  s->alternative_dependency = di_new (di_package_dependency *, alternatives ? alternatives : 1);
+  for (id = 0, alternatives = 0; id < index->count; id++)
+  {
+    di_package *p = index->package[id];
+    bool group = false;
+
+    for (node = p->depends.head; node; node = node->next)
+    {
+      di_package_dependency *d = node->data;
+
+      if (!internal_di_packages_index_is_edge (p, d) &&
+          (!group || d->type != di_package_dependency_type_alternative || !d->ptr))
+      {
+        group = false;
+        continue;
+      }
+      group = true;
+      s->alternative_target[alternatives] = d->ptr->id;
+      s->alternative_dependency[alternatives++] = d;
+    }
+  }
+
+  s->chosen = di_new0 (uint8_t, index->count ? index->count : 1);
+  s->trial = di_new0 (uint32_t, index->count ? index->count : 1);
+  s->trial_stack = di_new (uint32_t, index->count ? index->count : 1);
+
+  index->smallest = s;
+}
+
+/**
+ * @internal
+ * Start a new epoch of marks, so the marks of earlier resolves are stale
+ * without touching them
+ */
+static uint32_t internal_di_packages_index_epoch (di_packages_index *index)
+{
+  if (index->resolver_epoch >= INDEX_MARK_EPOCH_MAX)
+  {
+    memset (index->resolver, 0, index->count * sizeof (*index->resolver));
+    index->resolver_epoch = 0;
+  }
+
+  return ++index->resolver_epoch << 1;
+}
+
+/**
+ * @internal
+ * Select the provider of a virtual package, like
+ * di_packages_resolve_dependencies_check_virtual
+ */
+static uint32_t internal_di_packages_index_provider (di_packages_index *index, uint32_t id)
+{
+  const uint32_t *provider = di_packages_index_postings_get (&index->provides, id);
+  uint32_t best = INDEX_ID_NONE, i, n = di_packages_index_postings_size (&index->provides, id);
+
+  for (i = 0; i < n; i++)
+  {
+    uint32_t d = provider[i];
+
+    if (best == INDEX_ID_NONE || index->priority[best] < index->priority[d] ||
+        (index->status[d] >= di_package_status_unpacked && index->status[best] < di_package_status_unpacked))
+      best = d;
+  }
+
+  return best;
+}
+
+/**
+ * @internal
+ * Bytes to download and to install for a package, none if it is already
+ * unpacked
+ */
+static uint64_t internal_di_packages_index_cost (di_packages_index *index, uint32_t id)
+{
+  di_package *p = index->package[id];
+
+  if (index->status[id] >= di_package_status_unpacked)
+    return 0;
+  return p->size + (uint64_t) p->installed_size * 1024;
+}
+
+/**
+ * @internal
+ * Check if a provider provides a version which satisfies the dependency
+ */
+static bool internal_di_packages_index_provides_version (di_package *provider, di_package_dependency *dependency)
+{
+  di_slist_node *node;
+
+  for (node = provider->depends.head; node; node = node->next)
+  {
+    di_package_dependency *d = node->data;
+
+    if (d->type == di_package_dependency_type_provides && d->ptr == dependency->ptr &&
+        d->relation == di_package_dependency_relation_equal &&
+        di_package_version_satisfies (d->version, dependency->relation, dependency->version))
+      return true;
+  }
+
+  return false;
+}
+
+static void internal_di_packages_index_option_add (struct internal_di_packages_index_smallest *s, int which, uint32_t *n, uint32_t id)
+{
+  if (*n == s->option_alloc[which])
+  {
+    s->option_alloc[which] = s->option_alloc[which] ? s->option_alloc[which] * 2 : 16;
+    s->option[which] = di_renew (uint32_t, s->option[which], s->option_alloc[which]);
+  }
+  s->option[which][(*n)++] = id;
+}
+
+/**
+ * @internal
+ * Collect the real packages which satisfy an edge in s->option[which]:
+ * the alternatives in order, virtual ones replaced by their providers
+ *
+ * @return the number of options
+ */
+static uint32_t internal_di_packages_index_options (struct internal_di_packages_index_resolve *r, uint32_t edge, int which)
+{
+  di_packages_index *index = r->index;
+  struct internal_di_packages_index_smallest *s = index->smallest;
+  uint32_t a, i, n = 0;
+
+  for (a = s->alternative[edge]; a < s->alternative[edge + 1]; a++)
+  {
+    uint32_t id = s->alternative_target[a];
+    di_package_dependency *d = s->alternative_dependency[a];
+
+    if (index->type[id] == di_package_type_real_package)
+    {
+      if (d->relation)
+      {
+        /* Version is not read by di_packages_read_file_lazy */
+        if (r->packages->map)
+          di_packages_materialize_package (r->packages, index->package[id]);
+        if (!di_package_version_satisfies (index->package[id]->version, d->relation, d->version))
+          continue;
+      }
+      internal_di_packages_index_option_add (s, which, &n, id);
+    }
+    else if (index->type[id] == di_package_type_virtual_package)
+    {
+      const uint32_t *provider = di_packages_index_postings_get (&index->provides, id);
+
+      for (i = 0; i < di_packages_index_postings_size (&index->provides, id); i++)
+        if (!d->relation || internal_di_packages_index_provides_version (index->package[provider[i]], d))
+          internal_di_packages_index_option_add (s, which, &n, provider[i]);
+    }
+  }
+
+  return n;
+}
+
+/**
+ * @internal
+ * Check if a package is already part of the result
+ */
+static bool internal_di_packages_index_known (struct internal_di_packages_index_resolve *r, uint32_t id)
+{
+  return r->index->smallest->chosen[id] || (r->index->resolver[id] & ~INDEX_MARK_OK) == r->epoch;
+}
+
+/**
+ * @internal
+ * Sum the cost of the packages a choice of id would add to the result
+ *
+ * The closure of id is walked without further trials: every edge takes
+ * its first option which is already known, or else its first option.
+ */
+static uint64_t internal_di_packages_index_trial (struct internal_di_packages_index_resolve *r, uint32_t id)
+{
+  di_packages_index *index = r->index;
+  struct internal_di_packages_index_smallest *s = index->smallest;
+  uint32_t depth = 0, epoch, e, i, n;
+  uint64_t cost = 0;
+
+  if (s->trial_epoch == UINT32_MAX)
+  {
+    memset (s->trial, 0, index->count * sizeof (*s->trial));
+    s->trial_epoch = 0;
+  }
+  epoch = ++s->trial_epoch;
+
+  s->trial[id] = epoch;
+  s->trial_stack[depth++] = id;
+
+  while (depth)
+  {
+    id = s->trial_stack[--depth];
+    if (internal_di_packages_index_known (r, id))
+      continue;
+
+    if (index->type[id] != di_package_type_real_package)
+    {
+      id = internal_di_packages_index_provider (index, id);
+      if (id != INDEX_ID_NONE && s->trial[id] != epoch)
+      {
+        s->trial[id] = epoch;
+        s->trial_stack[depth++] = id;
+      }
+      continue;
+    }
+
+    cost += internal_di_packages_index_cost (index, id);
+
+    for (e = index->edge[id]; e < index->edge[id + 1]; e++)
+    {
+      uint32_t target = index->edge_target[e];
+
+      n = internal_di_packages_index_options (r, e, 1);
+      if (n)
+        target = s->option[1][0];
+      for (i = 0; i < n; i++)
+        if (internal_di_packages_index_known (r, s->option[1][i]))
+        {
+          target = s->option[1][i];
+          break;
+        }
+
+      if (s->trial[target] != epoch)
+      {
+        s->trial[target] = epoch;
+        s->trial_stack[depth++] = target;
+      }
+    }
+  }
+
+  return cost;
+}
+
+/**
+ * @internal
+ * Get the package an edge is resolved with
+ *
+ * Without di_packages_index_choose_smallest, this is the target.
+ * Otherwise it is the option which adds the smallest cost, the first one
+ * on ties, or the target if no option satisfies the versions.
+ */
+static uint32_t internal_di_packages_index_choose (struct internal_di_packages_index_resolve *r, uint32_t edge)
+{
+  di_packages_index *index = r->index;
+  struct internal_di_packages_index_smallest *s = index->smallest;
+  uint32_t best = index->edge_target[edge], i, n;
+  uint64_t best_cost = UINT64_MAX;
+
+  if (!s)
+    return best;
+
+  n = internal_di_packages_index_options (r, edge, 0);
+  if (n == 1)
+    return s->option[0][0];
+
+  for (i = 0; i < n && best_cost; i++)
+  {
+    uint64_t cost = internal_di_packages_index_trial (r, s->option[0][i]);
+
+    if (cost < best_cost)
+    {
+      best = s->option[0][i];
+      best_cost = cost;
+    }
+  }
+
+  if (n > 1)
+    di_log (DI_LOG_LEVEL_DEBUG, "resolver (%s): chose %s of %u options, adding %llu bytes",
+            index->package[index->edge_target[edge]]->package, index->package[best]->package,
+            n, (unsigned long long) best_cost);
+
+  return best;
+}
+
+static void internal_di_packages_index_resolve_fail (struct internal_di_packages_index_resolve *r, uint32_t id)
+{
+  di_log (DI_LOG_LEVEL_WARNING, "resolver (%s): package doesn't exist", r->index->package[id]->package);
+  r->index->resolver[id] = r->epoch;
+}
+
+/**
+ * @internal
+ * Resolve the dependencies of a package, like
+ * di_packages_resolve_dependencies_recurse with the default checks
+ *
+ * The packages in progress are kept on an explicit stack instead of the
+ * call stack, every package is entered at most once per epoch, so the
+ * stack never holds more than all packages.
+ */
+static bool internal_di_packages_index_resolve (struct internal_di_packages_index_resolve *r, uint32_t id)
+{
+  di_packages_index *index = r->index;
+  struct internal_di_packages_index_frame *stack = index->resolver_stack, *top;
+  uint32_t depth = 0, provider;
+  bool ok;
+
+enter:
+  /* did we already check this package? */
+  if ((index->resolver[id] & ~INDEX_MARK_OK) == r->epoch)
+  {
+    ok = index->resolver[id] & INDEX_MARK_OK;
+    goto leave;
+  }
+
+  index->resolver[id] = r->epoch | INDEX_MARK_OK;
+
+  switch (index->type[id])
+  {
+    case di_package_type_real_package:
+      stack[depth++] = (struct internal_di_packages_index_frame) { id, index->edge[id] };
+      goto next;
+
+    case di_package_type_virtual_package:
+      /* a failed provider is not replaced by the next best one */
+      provider = internal_di_packages_index_provider (index, id);
+      if (provider != INDEX_ID_NONE)
+      {
+        stack[depth++] = (struct internal_di_packages_index_frame) { id, 0 };
+        id = provider;
+        goto enter;
+      }
+      /* fall through */
+
+    default:
+      internal_di_packages_index_resolve_fail (r, id);
+      ok = false;
+      goto leave;
+  }
+
+next:
+  /* check the next dependency of the real package on top */
+  top = &stack[depth - 1];
+  if (top->edge < index->edge[top->id + 1])
+  {
+    id = internal_di_packages_index_choose (r, top->edge++);
+    goto enter;
+  }
+
+  di_slist_append_chunk (&r->list, index->package[top->id], r->allocator->slist_node_mem_chunk);
+  depth--;
+  ok = true;
+
+leave:
+  /* pass the result of the last package to the one on top */
+  if (!depth)
+    return ok;
+
+  top = &stack[depth - 1];
+  if (ok && index->type[top->id] == di_package_type_real_package)
+    goto next;
+
+  depth--;
+  if (!ok)
+  {
+    if (index->type[top->id] == di_package_type_real_package)
+      index->resolver[top->id] = r->epoch;
+    else
+      internal_di_packages_index_resolve_fail (r, top->id);
+  }
+  goto leave;
+}
+
+/**
+ * @internal
+ * Resolve the dependencies of the packages in list, or in the NULL
+ * terminated array if list is NULL, on the index of packages
+ */
+di_slist *internal_di_packages_index_resolve_dependencies (di_packages *packages, di_slist *list, di_package **array, di_packages_allocator *allocator)
+{
+  struct internal_di_packages_index_resolve r =
+  {
+    packages,
+    packages->index,
+    internal_di_packages_index_epoch (packages->index),
+    { NULL, NULL },
+    allocator,
+  };
+  di_slist *install = di_slist_alloc ();
+  di_slist_node *node = list ? list->head : NULL;
+
+  if (!r.index->resolver_stack)
+    r.index->resolver_stack = di_new (struct internal_di_packages_index_frame, r.index->count);
+
+  while (list ? node != NULL : *array != NULL)
+  {
+    di_package *p;
+
+    if (list)
+    {
+      p = node->data;
+      node = node->next;
+    }
+    else
+      p = *array++;
+
+    if (internal_di_packages_index_resolve (&r, p->id))
+      internal_di_slist_append_list (install, &r.list);
+  }
+
+  /* later resolves prefer the packages already chosen */
+  if (r.index->smallest)
+    for (node = install->head; node; node = node->next)
+      r.index->smallest->chosen[((di_package *) node->data)->id] = 1;
+
+  di_packages_materialize_list (packages, install);
+
+  return install;
+}
@@ -24,10 +24,20 @@
 #include <debian-installer/package_internal.h>
 #include <debian-installer/parser_rfc822.h>
 
+#include <sys/mman.h>
+#include <unistd.h>
+
 /**
  * @addtogroup di_packages_parser
  * @{
  */
+/**
+ * @internal
+ * Bytes per entry of a Packages file, used to size the package table in
+ * advance; real entries are around 1 KiB, plus the virtual packages
+ */
+#define PACKAGES_ENTRY_SIZE 512
+
 /**
  * @internal
  * parser info
@@ -114,6 +124,60 @@ const di_parser_fieldinfo *di_packages_minimal_parser_fieldinfo[] =
   NULL
 };
 
+static di_parser_fields_function_read internal_di_packages_parser_read_name_lazy;
+
+/**
+ * @internal
+ * parser info
+ */
+static const di_parser_fieldinfo
+  internal_di_packages_parser_field_package_lazy =
+    DI_PARSER_FIELDINFO
+    (
+      "Package",
+      internal_di_packages_parser_read_name_lazy,
+      di_parser_write_string,
+      offsetof (di_package, package)
+    );
+
+/**
+ * @internal
+ * Packages file, fields read by di_packages_read_file_lazy
+ */
+static const di_parser_fieldinfo *internal_di_packages_lazy_parser_fieldinfo[] =
+{
+  &internal_di_packages_parser_field_package_lazy,
+  &internal_di_package_parser_field_essential,
+  &internal_di_package_parser_field_priority,
+  &internal_di_package_parser_field_section,
+  &internal_di_package_parser_field_installed_size,
+  &internal_di_package_parser_field_replaces,
+  &internal_di_package_parser_field_provides,
+  &internal_di_package_parser_field_depends,
+  &internal_di_package_parser_field_pre_depends,
+  &internal_di_package_parser_field_recommends,
+  &internal_di_package_parser_field_suggests,
+  &internal_di_package_parser_field_conflicts,
+  &internal_di_package_parser_field_enhances,
+  &internal_di_package_parser_field_size,
+  NULL
+};
+
+/**
+ * @internal
+ * Packages file, fields read by di_packages_materialize_package
+ */
+static const di_parser_fieldinfo *internal_di_packages_materialize_parser_fieldinfo[] =
+{
+  &internal_di_package_parser_field_maintainer,
+  &internal_di_package_parser_field_architecture,
+  &internal_di_package_parser_field_version,
+  &internal_di_package_parser_field_filename,
+  &internal_di_package_parser_field_sha256,
+  &internal_di_package_parser_field_description,
+  NULL
+};
+
 /** @} */
 
 /**
@@ -158,6 +222,73 @@ di_parser_info *di_packages_status_parser_info (void)
   return info;
 }
 
+/**
+ * @internal
+ * Parse a memory segment of a Packages file
+ */
+static di_packages *internal_di_packages_read (char *begin, size_t size, di_packages_allocator *allocator, di_parser_info *info)
+{
+  internal_di_package_parser_data data = {allocator, NULL, NULL};
+
+  data.packages = internal_di_packages_alloc_with (allocator);
+  di_hash_table_reserve (data.packages->table, size / PACKAGES_ENTRY_SIZE);
+
+  if (di_parser_rfc822_read (begin, size, info, NULL, NULL, &data) < 0)
+  {
+    di_packages_free (data.packages);
+    data.packages = NULL;
+  }
+
+  return data.packages;
+}
+
+/**
+ * @internal
+ * Parse a memory segment of a Packages file on several threads
+ *
+ * Every part of the segment is parsed into packages and an allocator of
+ * its own, which are then joined in the order of the segment.
+ */
+static di_packages *internal_di_packages_read_parallel (char *begin, size_t size, di_packages_allocator *allocator, di_parser_info *info, int jobs)
+{
+  internal_di_package_parser_data *data;
+  void **user_data;
+  di_packages *ret;
+  int i, nr;
+
+  data = di_new0 (internal_di_package_parser_data, jobs);
+  user_data = di_new (void *, jobs);
+
+  for (i = 0; i < jobs; i++)
+  {
+    data[i].allocator = internal_di_packages_allocator_alloc_like (allocator);
+    data[i].packages = internal_di_packages_alloc_unowned ();
+    di_hash_table_reserve (data[i].packages->table, size / jobs / PACKAGES_ENTRY_SIZE);
+    user_data[i] = &data[i];
+  }
+
+  nr = di_parser_rfc822_read_parallel (begin, size, info, NULL, NULL, user_data, jobs);
+
+  ret = internal_di_packages_alloc_with (allocator);
+  di_hash_table_reserve (ret->table, size / PACKAGES_ENTRY_SIZE);
+  for (i = 0; i < jobs; i++)
+  {
+    internal_di_packages_join (ret, data[i].packages);
+    internal_di_packages_allocator_join (allocator, data[i].allocator);
+  }
+
+  if (nr < 0)
+  {
+    di_packages_free (ret);
+    ret = NULL;
+  }
+
+  di_free (user_data);
+  di_free (data);
+
+  return ret;
+}
+
 /**
  * Read a special Packages file
  *
@@ -166,20 +297,144 @@ di_parser_info *di_packages_status_parser_info (void)
  */
 di_packages *di_packages_special_read_file (const char *file, di_packages_allocator *allocator, di_parser_info *(get_info) (void))
 {
-  di_parser_info *info = get_info ();
-  internal_di_package_parser_data data = {allocator, NULL, NULL};
+  di_parser_info *info;
+  di_packages *ret;
+  char *begin;
+  size_t size;
+
+  if (di_parser_rfc822_map_file (file, &begin, &size) < 0)
+    return NULL;
+  if (!begin)
+    return internal_di_packages_alloc_with (allocator);
+  madvise (begin, size, MADV_SEQUENTIAL);
+
+  info = get_info ();
+  ret = internal_di_packages_read (begin, size, allocator, info);
+  di_parser_info_free (info);
+
+  munmap (begin, size);
+
+  return ret;
+}
+
+static int internal_di_packages_jobs (int jobs)
+{
+  if (jobs <= 0)
+    jobs = sysconf (_SC_NPROCESSORS_ONLN);
+  return jobs > 1 ? jobs : 1;
+}
+
+/**
+ * Read a special Packages file on several threads
+ *
+ * @param file file to read
+ * @param info parser info
+ * @param jobs number of threads, or 0 for the number of online CPUs
+ */
+di_packages *di_packages_special_read_file_parallel (const char *file, di_packages_allocator *allocator, di_parser_info *(get_info) (void), int jobs)
+{
+  di_parser_info *info;
+  di_packages *ret;
+  char *begin;
+  size_t size;
+
+  jobs = internal_di_packages_jobs (jobs);
+  if (jobs == 1)
+    return di_packages_special_read_file (file, allocator, get_info);
+
+  if (di_parser_rfc822_map_file (file, &begin, &size) < 0)
+    return NULL;
+  if (!begin)
+    return internal_di_packages_alloc_with (allocator);
+  /* every part is read sequentially, but they are read all at once */
+  madvise (begin, size, MADV_WILLNEED);
+
+  info = get_info ();
+  ret = internal_di_packages_read_parallel (begin, size, allocator, info, jobs);
+  di_parser_info_free (info);
+
+  munmap (begin, size);
+
+  return ret;
+}
 
-  data.packages = di_packages_alloc ();
+di_packages *di_packages_read_file_lazy (const char *file, di_packages_allocator *allocator, int jobs)
+{
+  di_parser_info *info;
+  di_packages *ret;
+  char *begin;
+  size_t size;
+
+  if (di_parser_rfc822_map_file (file, &begin, &size) < 0)
+    return NULL;
+  if (!begin)
+    return internal_di_packages_alloc_with (allocator);
+
+  info = di_parser_info_alloc ();
+  di_parser_info_add (info, internal_di_packages_lazy_parser_fieldinfo);
 
-  if (di_parser_rfc822_read_file (file, info, NULL, NULL, &data) < 0)
+  jobs = internal_di_packages_jobs (jobs);
+  if (jobs == 1)
+    ret = internal_di_packages_read (begin, size, allocator, info);
+  else
   {
-    di_packages_free (data.packages);
-    data.packages = NULL;
+    madvise (begin, size, MADV_WILLNEED);
+    ret = internal_di_packages_read_parallel (begin, size, allocator, info, jobs);
   }
 
   di_parser_info_free (info);
 
-  return data.packages;
+  if (!ret)
+  {
+    munmap (begin, size);
+    return NULL;
+  }
+
+  ret->map = begin;
+  ret->map_size = size;
+
+  return ret;
+}
+
+static void *internal_di_packages_parser_materialize_new (void *user_data)
+{
+  internal_di_package_parser_data *parser_data = user_data;
+  return parser_data->package;
+}
+
+void di_packages_materialize_package (di_packages *packages, di_package *package)
+{
+  internal_di_package_parser_data data = {packages->allocator, packages, package};
+  char *begin, *end, *map_end = packages->map + packages->map_size;
+
+  if (!package->lazy)
+    return;
+
+  if (!packages->lazy_info)
+  {
+    packages->lazy_info = di_parser_info_alloc ();
+    di_parser_info_add (packages->lazy_info, internal_di_packages_materialize_parser_fieldinfo);
+  }
+
+  /* the entry begins with the line of the Package field and ends with an empty line */
+  for (begin = package->lazy; begin > packages->map && begin[-1] != '\n'; begin--);
+  for (end = begin; (end = memchr (end, '\n', map_end - end)) && end + 1 < map_end && end[1] != '\n'; end++);
+  end = end ? end + 1 : map_end;
+
+  di_parser_rfc822_read (begin, end - begin, packages->lazy_info, internal_di_packages_parser_materialize_new, NULL, &data);
+
+  package->lazy = NULL;
+}
+
+void di_packages_materialize_list (di_packages *packages, di_slist *list)
+{
+  di_slist_node *node;
+
+  if (!packages->map)
+    return;
+
+  for (node = list->head; node; node = node->next)
+    di_packages_materialize_package (packages, node->data);
 }
 
 /**
@@ -245,3 +500,18 @@ void di_packages_parser_read_name (data, fip, field_modifier, value, user_data)
 }
 
 
+
+static void internal_di_packages_parser_read_name_lazy (
+  void **data,
+  const di_parser_fieldinfo *fip,
+  di_rstring *field_modifier,
+  di_rstring *value,
+  void *user_data)
+{
+  di_package *p;
+
+  di_packages_parser_read_name (data, fip, field_modifier, value, user_data);
+  p = *data;
+  /* value is in the mapped file, which stays until the packages are freed */
+  p->lazy = value->string;
+}
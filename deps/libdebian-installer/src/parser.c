@@ -19,10 +19,13 @@
 
 #include <config.h>
 
-#include <debian-installer/parser.h>
+#include <debian-installer/parser_internal.h>
 
 #include <debian-installer/mem.h>
 
+#define DISPATCH_MAX_BITS 10
+#define DISPATCH_MAX_SEEDS 256
+
 di_parser_info *di_parser_info_alloc (void)
 {
   di_parser_info *info;
@@ -35,11 +38,86 @@ di_parser_info *di_parser_info_alloc (void)
 
 void di_parser_info_free (di_parser_info *info)
 {
+  di_free (info->dispatch);
   di_hash_table_destroy (info->table);
   di_slist_destroy (&info->list, NULL);
   di_free (info);
 }
 
+/**
+ * @internal
+ * Data for building the dispatch table
+ */
+struct internal_di_parser_dispatch_build
+{
+  const di_parser_fieldinfo **fields;
+  unsigned int nr;
+};
+
+static void internal_di_parser_dispatch_collect (void *key __attribute__ ((unused)), void *value, void *user_data)
+{
+  struct internal_di_parser_dispatch_build *build = user_data;
+  const di_parser_fieldinfo *fip = value;
+
+  /* the wildcard is only used by the fallback */
+  if (fip->key.size)
+    build->fields[build->nr++] = fip;
+}
+
+/**
+ * @internal
+ * Searches a collision free multiplicative hash of the fields in the table
+ * and falls back to the table if there is none
+ */
+static void internal_di_parser_dispatch_rebuild (di_parser_info *info)
+{
+  struct internal_di_parser_dispatch_build build;
+  const di_parser_fieldinfo **dispatch;
+  unsigned int bits, i, j, size;
+  uint32_t seed;
+
+  di_free (info->dispatch);
+  info->dispatch = NULL;
+
+  build.fields = di_new (const di_parser_fieldinfo *, di_hash_table_size (info->table));
+  build.nr = 0;
+  di_hash_table_foreach (info->table, internal_di_parser_dispatch_collect, &build);
+
+  for (bits = 1; bits < DISPATCH_MAX_BITS && (1U << bits) < build.nr * 2; bits++);
+
+  for (; bits <= DISPATCH_MAX_BITS && !info->dispatch; bits++)
+  {
+    size = 1U << bits;
+    dispatch = di_new (const di_parser_fieldinfo *, size);
+
+    for (i = 0; i < DISPATCH_MAX_SEEDS && !info->dispatch; i++)
+    {
+      seed = 0x9e3779b1U * (2 * i + 1);
+      memset (dispatch, 0, size * sizeof (*dispatch));
+
+      for (j = 0; j < build.nr; j++)
+      {
+        uint32_t h = (internal_di_parser_dispatch_key (build.fields[j]->key.string, build.fields[j]->key.size) * seed) >> (32 - bits);
+        if (dispatch[h])
+          break;
+        dispatch[h] = build.fields[j];
+      }
+
+      if (j == build.nr)
+      {
+        info->dispatch = dispatch;
+        info->dispatch_seed = seed;
+        info->dispatch_shift = 32 - bits;
+      }
+    }
+
+    if (!info->dispatch)
+      di_free (dispatch);
+  }
+
+  di_free (build.fields);
+}
+
 void di_parser_info_add (di_parser_info *info, const di_parser_fieldinfo *fieldinfo[])
 {
   di_parser_fieldinfo **fip;
@@ -49,6 +127,8 @@ void di_parser_info_add (di_parser_info *info, const di_parser_fieldinfo *fieldi
     di_hash_table_insert (info->table, &(*fip)->key, *fip);
     di_slist_append (&info->list, *fip);
   }
+
+  internal_di_parser_dispatch_rebuild (info);
 }
 
 void di_parser_read_boolean (
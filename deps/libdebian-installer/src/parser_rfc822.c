@@ -21,13 +21,17 @@
 
 #include <debian-installer/parser_rfc822.h>
 
+#include <debian-installer/parser_internal.h>
+
 #include <debian-installer/log.h>
 #include <debian-installer/macros.h>
+#include <debian-installer/mem.h>
 #include <debian-installer/string.h>
 
 #include <ctype.h>
 #include <fcntl.h>
 #include <limits.h>
+#include <pthread.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/mman.h>
@@ -115,9 +119,6 @@ int di_parser_rfc822_read (char *begin, size_t size, di_parser_info *info, di_pa
       }
 #endif
 
-      value_begin = field_end + 1;
-      while (value_begin < end && (*value_begin == ' ' || *value_begin == '\t'))
-        value_begin++;
       readsize = end - field_begin;
       value_end = memchr (field_begin, '\n', readsize);
       if (!value_end)
@@ -131,6 +132,11 @@ int di_parser_rfc822_read (char *begin, size_t size, di_parser_info *info, di_pa
         return -1;
       }
 
+      field_string.string = field_begin;
+      field_string.size = field_size;
+
+      fip = internal_di_parser_info_lookup (info, &field_string);
+
       /* while (isblank (value_end[1])) FIXME: C99 */
       while (value_end[1] == ' ' || value_end[1] == '\t')
       {
@@ -141,15 +147,19 @@ int di_parser_rfc822_read (char *begin, size_t size, di_parser_info *info, di_pa
           return -1;
         }
       }
+
+      /* unknown fields are skipped with the lines of their value */
+      if (!fip && !info->modifier && !info->wildcard)
+        goto next;
+
+      value_begin = field_end + 1;
+      while (value_begin < end && (*value_begin == ' ' || *value_begin == '\t'))
+        value_begin++;
       value_size = value_end - value_begin;
 
-      field_string.string = field_begin;
-      field_string.size = field_size;
       value_string.string = value_begin;
       value_string.size = value_size;
 
-      fip = di_hash_table_lookup (info->table, &field_string);
-
       if (fip)
       {
         fip->read (&act, fip, NULL, &value_string, user_data);
@@ -208,29 +218,118 @@ next:
   return nr;
 }
 
-int di_parser_rfc822_read_file (const char *file, di_parser_info *info, di_parser_read_entry_new entry_new, di_parser_read_entry_finish entry_finish, void *user_data)
+/**
+ * @internal
+ * A part of the memory segment, parsed on its own thread
+ */
+struct internal_di_parser_rfc822_job
 {
-  struct stat statbuf;
+  pthread_t thread;
+  bool threaded;
   char *begin;
+  size_t size;
+  di_parser_info *info;
+  di_parser_read_entry_new *entry_new;
+  di_parser_read_entry_finish *entry_finish;
+  void *user_data;
+  int ret;
+};
+
+static void *internal_di_parser_rfc822_read_job (void *data)
+{
+  struct internal_di_parser_rfc822_job *job = data;
+
+  job->ret = di_parser_rfc822_read (job->begin, job->size, job->info, job->entry_new, job->entry_finish, job->user_data);
+
+  return NULL;
+}
+
+int di_parser_rfc822_read_parallel (char *begin, size_t size, di_parser_info *info, di_parser_read_entry_new entry_new, di_parser_read_entry_finish entry_finish, void **user_data, int jobs)
+{
+  struct internal_di_parser_rfc822_job *job;
+  char *cur = begin, *end = begin + size, *next;
+  int i, nr = 0;
+
+  job = di_new0 (struct internal_di_parser_rfc822_job, jobs);
+
+  for (i = 0; i < jobs; i++)
+  {
+    if (i == jobs - 1)
+      next = end;
+    else
+    {
+      /* parts end after an empty line, which always ends an entry */
+      next = begin + size / jobs * (i + 1);
+      if (next < cur)
+        next = cur;
+      while ((next = memchr (next, '\n', end - next)) && next + 1 < end && next[1] != '\n')
+        next++;
+      next = next && next + 1 < end ? next + 2 : end;
+    }
+
+    job[i].begin = cur;
+    job[i].size = next - cur;
+    job[i].info = info;
+    job[i].entry_new = entry_new;
+    job[i].entry_finish = entry_finish;
+    job[i].user_data = user_data[i];
+    cur = next;
+
+    /* the first part is parsed by the calling thread */
+    if (i && job[i].size)
+      job[i].threaded = !pthread_create (&job[i].thread, NULL, internal_di_parser_rfc822_read_job, &job[i]);
+  }
+
+  internal_di_parser_rfc822_read_job (&job[0]);
+
+  for (i = 1; i < jobs; i++)
+  {
+    if (!job[i].size)
+      continue;
+    if (job[i].threaded)
+      pthread_join (job[i].thread, NULL);
+    else
+      internal_di_parser_rfc822_read_job (&job[i]);
+  }
+
+  for (i = 0; i < jobs; i++)
+  {
+    if (job[i].ret < 0)
+    {
+      nr = -1;
+      break;
+    }
+    nr += job[i].ret;
+  }
+
+  di_free (job);
+
+  return nr;
+}
+
+int di_parser_rfc822_map_file (const char *file, char **begin, size_t *size)
+{
+  struct stat statbuf;
   int fd, ret = -1;
 
+  *begin = NULL;
+  *size = 0;
+
   if ((fd = open (file, O_RDONLY)) < 0)
     return ret;
   if (fstat (fd, &statbuf))
     goto cleanup;
+  ret = 0;
   if (!statbuf.st_size)
+    goto cleanup;
+  *begin = mmap (NULL, statbuf.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (*begin == MAP_FAILED)
   {
-    ret = 0;
+    *begin = NULL;
+    ret = -1;
     goto cleanup;
   }
-  begin = mmap (NULL, statbuf.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
-  if (begin == MAP_FAILED)
-    goto cleanup;
-  madvise (begin, statbuf.st_size, MADV_SEQUENTIAL);
-
-  ret = di_parser_rfc822_read (begin, statbuf.st_size, info, entry_new, entry_finish, user_data);
-
-  munmap (begin, statbuf.st_size);
+  *size = statbuf.st_size;
 
 cleanup:
   close (fd);
@@ -238,6 +337,45 @@ cleanup:
   return ret;
 }
 
+int di_parser_rfc822_read_file (const char *file, di_parser_info *info, di_parser_read_entry_new entry_new, di_parser_read_entry_finish entry_finish, void *user_data)
+{
+  char *begin;
+  size_t size;
+  int ret;
+
+  if (di_parser_rfc822_map_file (file, &begin, &size) < 0)
+    return -1;
+  if (!begin)
+    return 0;
+  madvise (begin, size, MADV_SEQUENTIAL);
+
+  ret = di_parser_rfc822_read (begin, size, info, entry_new, entry_finish, user_data);
+
+  munmap (begin, size);
+
+  return ret;
+}
+
+int di_parser_rfc822_read_file_parallel (const char *file, di_parser_info *info, di_parser_read_entry_new entry_new, di_parser_read_entry_finish entry_finish, void **user_data, int jobs)
+{
+  char *begin;
+  size_t size;
+  int ret;
+
+  if (di_parser_rfc822_map_file (file, &begin, &size) < 0)
+    return -1;
+  if (!begin)
+    return 0;
+  /* every part is read sequentially, but they are read all at once */
+  madvise (begin, size, MADV_WILLNEED);
+
+  ret = di_parser_rfc822_read_parallel (begin, size, info, entry_new, entry_finish, user_data, jobs);
+
+  munmap (begin, size);
+
+  return ret;
+}
+
 static void callback (const di_rstring *field, const di_rstring *value, void *data)
 {
   FILE *f = data;
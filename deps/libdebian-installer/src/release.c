@@ -25,7 +25,9 @@
 #include <debian-installer/parser_rfc822.h>
 #include <debian-installer/string.h>
 
+#include <stdbool.h>
 #include <stddef.h>
+#include <stdlib.h>
 #include <string.h>
 
 /**
@@ -61,6 +63,14 @@ const di_parser_fieldinfo
       NULL,
       offsetof (di_release, codename)
     ),
+  internal_di_release_parser_field_acquire_by_hash =
+    DI_PARSER_FIELDINFO
+    (
+      "Acquire-By-Hash",
+      di_parser_read_boolean,
+      NULL,
+      offsetof (di_release, acquire_by_hash)
+    ),
   internal_di_release_parser_field_md5sum =
     DI_PARSER_FIELDINFO
     (
@@ -86,6 +96,7 @@ const di_parser_fieldinfo *di_release_parser_fieldinfo[] =
   &internal_di_release_parser_field_origin,
   &internal_di_release_parser_field_suite,
   &internal_di_release_parser_field_codename,
+  &internal_di_release_parser_field_acquire_by_hash,
   &internal_di_release_parser_field_md5sum,
   &internal_di_release_parser_field_sha256,
   NULL
@@ -140,23 +151,83 @@ static void *parser_new (void *user_data)
  * @param file file to read
  */
 di_release *di_release_read_file (const char *file)
+{
+  return di_release_read_file_filtered (file, NULL);
+}
+
+/**
+ * Read a standard Release file, only keeping some of the checksum entries
+ *
+ * Entries of other files are skipped before anything is allocated for
+ * them, so the size of the file list does not matter.
+ *
+ * @param file file to read
+ * @param filter NULL terminated list of filename prefixes to keep, NULL keeps all
+ */
+di_release *di_release_read_file_filtered (const char *file, const char *const *filter)
 {
   di_release *release;
   di_parser_info *info;
 
   release = di_release_alloc ();
+  release->filter = filter;
   info = di_parser_info_alloc ();
   di_parser_info_add (info, di_release_parser_fieldinfo);
 
   if (di_parser_rfc822_read_file (file, info, parser_new, NULL, release) < 0)
   {
+    di_parser_info_free (info);
     di_release_free (release);
     return NULL;
   }
 
+  di_parser_info_free (info);
+
+  /* Only used while parsing, it is owned by the caller. */
+  release->filter = NULL;
+
   return release;
 }
 
+/**
+ * @internal
+ * Checks if a filename matches the filter of the release
+ */
+static bool internal_di_release_filter (const di_release *release, const char *filename, size_t size)
+{
+  const char *const *prefix;
+
+  if (!release->filter)
+    return true;
+
+  for (prefix = release->filter; *prefix; prefix++)
+  {
+    size_t len = strlen (*prefix);
+    if (len <= size && !memcmp (filename, *prefix, len))
+      return true;
+  }
+
+  return false;
+}
+
+/**
+ * @internal
+ * Returns the next whitespace separated word, which ends before end
+ */
+static const char *internal_di_release_word (const char *begin, const char *end, size_t *size)
+{
+  const char *word;
+
+  while (begin < end && (*begin == ' ' || *begin == '\t'))
+    begin++;
+  word = begin;
+  while (begin < end && *begin != ' ' && *begin != '\t')
+    begin++;
+
+  *size = begin - word;
+  return word;
+}
+
 void di_release_parser_read_file (data, fip, field_modifier, value, user_data)
   void **data;
   const di_parser_fieldinfo *fip __attribute__ ((unused));
@@ -164,39 +235,48 @@ void di_release_parser_read_file (data, fip, field_modifier, value, user_data)
   di_rstring *value;
   void *user_data __attribute__ ((unused));
 {
-  char *begin = value->string, *next = begin, *end = value->string + value->size;
-  char *buf_sum, buf_filename[129];
-  int ret;
-  size_t buf_size;
+  const char *begin = value->string, *next, *end = value->string + value->size;
   di_release *release = *data;
   di_hash_table *table = release->sha256;
 
-  while (1)
+  for (; begin < end; begin = next + 1)
   {
+    const char *sum, *size, *filename;
+    size_t sum_len, size_len, filename_len;
+    unsigned long buf_size;
+    char *size_end;
+    di_rstring key;
+    di_release_file *file;
+
     next = memchr (begin, '\n', end - begin);
     if (!next)
       next = end;
 
-    ret = sscanf (begin, "%ms %zu %128s", &buf_sum, &buf_size, buf_filename);
+    sum = internal_di_release_word (begin, next, &sum_len);
+    size = internal_di_release_word (sum + sum_len, next, &size_len);
+    filename = internal_di_release_word (size + size_len, next, &filename_len);
 
-    if (ret == 3)
+    if (!sum_len || !size_len || !filename_len)
+      continue;
+    if (!internal_di_release_filter (release, filename, filename_len))
+      continue;
+
+    buf_size = strtoul (size, &size_end, 10);
+    if (size_end != size + size_len)
+      continue;
+
+    key.string = (char *) filename;
+    key.size = filename_len;
+    file = di_hash_table_lookup (table, &key);
+    if (!file)
     {
-      di_rstring key = { buf_filename, strlen (buf_filename) };
-      di_release_file *file = di_hash_table_lookup (table, &key);
-      if (!file)
-      {
-        file = di_mem_chunk_alloc0 (release->release_file_mem_chunk);
-        file->key.string = strdup (buf_filename);
-        file->key.size = strlen (buf_filename);
-        di_hash_table_insert (table, &file->key, file);
-      }
-      file->size = buf_size;
-      file->sum[fip->integer] = buf_sum;
+      file = di_mem_chunk_alloc0 (release->release_file_mem_chunk);
+      file->key.string = di_stradup (filename, filename_len);
+      file->key.size = filename_len;
+      di_hash_table_insert (table, &file->key, file);
     }
-
-    begin = next + 1;
-    if (begin >= end)
-      break;
+    file->size = buf_size;
+    di_free (file->sum[fip->integer]);
+    file->sum[fip->integer] = di_stradup (sum, sum_len);
   }
 }
-
@@ -25,7 +25,6 @@
 #include <debian-installer/hash.h>
 #include <debian-installer/mem.h>
 
-#include <ctype.h>
 #include <stdarg.h>
 #include <string.h>
 
@@ -60,16 +59,44 @@ bool di_rstring_equal (const void *key1, const void *key2)
   return false;
 }
 
+/**
+ * @internal
+ * Converts the ASCII upper case letters of eight bytes to lower case
+ */
+static inline uint64_t internal_di_rstring_tolower (uint64_t w)
+{
+  const uint64_t ones = 0x0101010101010101ULL;
+  uint64_t heptets = w & 0x7f7f7f7f7f7f7f7fULL;
+  /* the high bit is set for bytes >= 'A', respectively > 'Z' */
+  uint64_t a = heptets + ones * (0x80 - 'A');
+  uint64_t z = heptets + ones * (0x80 - 'Z' - 1);
+  uint64_t upper = (a ^ z) & ~w & (ones * 0x80);
+
+  return w | (upper >> 2);
+}
+
 uint32_t di_rstring_hash (const void *key)
 {
   const di_rstring *rstring = key;
   const char *p = rstring->string;
-  size_t n = 0;
-  uint32_t h = 0;
-
-  for (; n < rstring->size; n++)
-    h = (h << 5) - h + tolower (*p++);
-
+  size_t n = rstring->size;
+  uint64_t h = n * 0x9e3779b97f4a7c15ULL, w;
+
+  /* hashes eight bytes at once, case insensitive */
+  for (; n >= 8; n -= 8, p += 8)
+  {
+    memcpy (&w, p, 8);
+    h = (h ^ internal_di_rstring_tolower (w)) * 0x100000001b3ULL;
+    h ^= h >> 29;
+  }
+  if (n)
+  {
+    w = 0;
+    memcpy (&w, p, n);
+    h = (h ^ internal_di_rstring_tolower (w)) * 0x100000001b3ULL;
+  }
+
+  h ^= h >> 32;
   return h;
 }
 
@@ -4,6 +4,8 @@
 
 #include "test_exec.h"
 #include "test_hash.h"
+#include "test_packages.h"
+#include "test_release.h"
 #include "test_system_packages.h"
 
 int main() {
@@ -11,6 +13,8 @@ int main() {
   SRunner *sr;
 
   sr = srunner_create(make_test_hash_suite());
+  srunner_add_suite(sr, make_test_packages_suite());
+  srunner_add_suite(sr, make_test_release_suite());
   srunner_add_suite(sr, make_test_system_packages_suite());
   srunner_add_suite(sr, make_test_exec_suite());
   srunner_run_all(sr, CK_NORMAL);
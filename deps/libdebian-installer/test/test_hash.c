@@ -42,6 +42,43 @@ START_TEST(test_hash)
 }
 END_TEST
 
+START_TEST(test_hash_lookup)
+{
+  di_hash_table *table;
+  int i, nbr_of_insert = 5000;
+  static char str[5000][STRING_MAX_LENGTH];
+  static di_rstring key[5000];
+  di_rstring lookup;
+
+  table = di_hash_table_new(di_rstring_hash, di_rstring_equal);
+  di_hash_table_reserve(table, 100);
+
+  /* grows past the reserved size */
+  for (i = 0; i < nbr_of_insert; i++) {
+    snprintf(str[i], STRING_MAX_LENGTH, "Pkg-%d", i);
+    get_key(str[i], &key[i]);
+    di_hash_table_insert(table, &key[i], str[i]);
+  }
+  ck_assert_int_eq(di_hash_table_size(table), nbr_of_insert);
+
+  for (i = 0; i < nbr_of_insert; i++)
+    ck_assert_ptr_eq(di_hash_table_lookup(table, &key[i]), str[i]);
+
+  get_key("pKG-4711", &lookup);
+  ck_assert_ptr_eq(di_hash_table_lookup(table, &lookup), str[4711]);
+  get_key("pkg-5000", &lookup);
+  ck_assert_ptr_null(di_hash_table_lookup(table, &lookup));
+
+  /* replaces the value of the existing key */
+  get_key("PKG-0", &lookup);
+  di_hash_table_insert(table, &lookup, str[1]);
+  ck_assert_int_eq(di_hash_table_size(table), nbr_of_insert);
+  ck_assert_ptr_eq(di_hash_table_lookup(table, &key[0]), str[1]);
+
+  di_hash_table_destroy(table);
+}
+END_TEST
+
 Suite* make_test_hash_suite() {
   Suite *s;
   TCase *tc_core;
@@ -49,6 +86,7 @@ Suite* make_test_hash_suite() {
   s = suite_create("test hash table");
   tc_core = tcase_create("Core");
   tcase_add_test(tc_core, test_hash);
+  tcase_add_test(tc_core, test_hash_lookup);
   suite_add_tcase(s, tc_core);
 
   return s;
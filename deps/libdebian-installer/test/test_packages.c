@@ -0,0 +1,520 @@
+#include <ctype.h>
+#include <fcntl.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+
+#include <check.h>
+
+#include <debian-installer/package.h>
+#include <debian-installer/packages.h>
+#include <debian-installer/packages_internal.h>
+
+#include "test_packages.h"
+
+#define DOWNLOAD_PACKAGES       DATADIR "/Packages"
+
+START_TEST(test_read_parallel)
+{
+  di_packages_allocator *allocator, *allocator_parallel;
+  di_packages *packages, *packages_parallel;
+  di_slist_node *node, *node_parallel, *dep, *dep_parallel;
+
+  allocator = di_packages_allocator_alloc();
+  packages = di_packages_read_file(DOWNLOAD_PACKAGES, allocator);
+  allocator_parallel = di_packages_allocator_alloc();
+  packages_parallel = di_packages_read_file_parallel(DOWNLOAD_PACKAGES, allocator_parallel, 4);
+  ck_assert_ptr_nonnull(packages);
+  ck_assert_ptr_nonnull(packages_parallel);
+
+  ck_assert_int_eq(di_hash_table_size(packages_parallel->table), di_hash_table_size(packages->table));
+
+  /* same packages in the same order, with the same dependencies */
+  for (node = packages->list.head, node_parallel = packages_parallel->list.head;
+       node && node_parallel;
+       node = node->next, node_parallel = node_parallel->next) {
+    di_package *p = node->data, *q = node_parallel->data;
+
+    ck_assert_str_eq(q->package, p->package);
+    ck_assert_str_eq(q->version, p->version);
+    ck_assert_int_eq(q->type, p->type);
+    ck_assert_int_eq(q->priority, p->priority);
+
+    for (dep = p->depends.head, dep_parallel = q->depends.head;
+         dep && dep_parallel;
+         dep = dep->next, dep_parallel = dep_parallel->next) {
+      di_package_dependency *d = dep->data, *e = dep_parallel->data;
+
+      ck_assert_int_eq(e->type, d->type);
+      ck_assert_str_eq(e->ptr->package, d->ptr->package);
+      /* links point into the joined packages */
+      ck_assert_ptr_eq(di_packages_get_package(packages_parallel, e->ptr->package, 0), e->ptr);
+    }
+    ck_assert_ptr_null(dep);
+    ck_assert_ptr_null(dep_parallel);
+  }
+  ck_assert_ptr_null(node);
+  ck_assert_ptr_null(node_parallel);
+
+  di_packages_free(packages_parallel);
+  di_packages_allocator_free(allocator_parallel);
+  di_packages_free(packages);
+  di_packages_allocator_free(allocator);
+}
+END_TEST
+
+START_TEST(test_read_lazy)
+{
+  di_packages_allocator *allocator, *allocator_lazy;
+  di_packages *packages, *packages_lazy;
+  di_slist_node *node;
+
+  allocator = di_packages_allocator_alloc();
+  packages = di_packages_read_file(DOWNLOAD_PACKAGES, allocator);
+  allocator_lazy = di_packages_allocator_alloc();
+  packages_lazy = di_packages_read_file_lazy(DOWNLOAD_PACKAGES, allocator_lazy, 1);
+  ck_assert_ptr_nonnull(packages);
+  ck_assert_ptr_nonnull(packages_lazy);
+
+  ck_assert_int_eq(di_hash_table_size(packages_lazy->table), di_hash_table_size(packages->table));
+
+  for (node = packages->list.head; node; node = node->next) {
+    di_package *p = node->data;
+    di_package *q = di_packages_get_package(packages_lazy, p->package, 0);
+
+    ck_assert_ptr_nonnull(q);
+    ck_assert_int_eq(q->priority, p->priority);
+    ck_assert_ptr_null(q->version);
+    ck_assert_ptr_null(q->filename);
+
+    di_packages_materialize_package(packages_lazy, q);
+    ck_assert_str_eq(q->version, p->version);
+    ck_assert_str_eq(q->filename, p->filename);
+    ck_assert_str_eq(q->short_description, p->short_description);
+  }
+
+  di_packages_free(packages_lazy);
+  di_packages_allocator_free(allocator_lazy);
+  di_packages_free(packages);
+  di_packages_allocator_free(allocator);
+}
+END_TEST
+
+START_TEST(test_read_arena)
+{
+  di_packages_allocator *allocator, *allocator_arena;
+  di_packages *packages, *packages_arena;
+  di_packages_allocator_stats stats;
+  di_slist_node *node;
+
+  allocator = di_packages_allocator_alloc();
+  packages = di_packages_read_file(DOWNLOAD_PACKAGES, allocator);
+  allocator_arena = di_packages_allocator_alloc_arena();
+  packages_arena = di_packages_read_file(DOWNLOAD_PACKAGES, allocator_arena);
+  ck_assert_ptr_nonnull(packages);
+  ck_assert_ptr_nonnull(packages_arena);
+
+  ck_assert_int_eq(di_hash_table_size(packages_arena->table), di_hash_table_size(packages->table));
+
+  for (node = packages->list.head; node; node = node->next) {
+    di_package *p = node->data;
+    di_package *q = di_packages_get_package(packages_arena, p->package, 0);
+
+    ck_assert_ptr_nonnull(q);
+    ck_assert_str_eq(q->version, p->version);
+    ck_assert_str_eq(q->filename, p->filename);
+    ck_assert_str_eq(q->short_description, p->short_description);
+  }
+
+  di_packages_allocator_get_stats(allocator_arena, &stats);
+  ck_assert_int_gt(stats.packages, 0);
+  ck_assert_int_gt(stats.strings, 0);
+  ck_assert_int_ge(stats.total, stats.packages + stats.dependencies + stats.nodes + stats.strings);
+
+  di_packages_free(packages_arena);
+  di_packages_allocator_free(allocator_arena);
+  di_packages_free(packages);
+  di_packages_allocator_free(allocator);
+}
+END_TEST
+
+START_TEST(test_arena_align)
+{
+  di_mem_arena *arena = di_mem_arena_new(13);
+  char *p;
+
+  /* the unaligned string leaves less than the alignment in the area */
+  ck_assert_ptr_nonnull(di_mem_arena_alloc(arena, 8));
+  ck_assert_ptr_nonnull(di_mem_arena_stradup(arena, "abc", 3));
+  p = di_mem_arena_alloc(arena, 8);
+  ck_assert_ptr_nonnull(p);
+  ck_assert_int_eq((uintptr_t) p % sizeof(void *), 0);
+  memset(p, 0, 8);
+
+  di_mem_arena_destroy(arena);
+}
+END_TEST
+
+START_TEST(test_cache)
+{
+  di_packages_allocator *allocator, *allocator_cache;
+  di_packages *packages, *packages_cache;
+  di_slist_node *node, *node_cache;
+  char file[] = "/tmp/test_packages_cache.XXXXXX";
+  int fd;
+
+  fd = mkstemp(file);
+  ck_assert_int_ge(fd, 0);
+  close(fd);
+
+  allocator = di_packages_allocator_alloc();
+  packages = di_packages_read_file(DOWNLOAD_PACKAGES, allocator);
+  ck_assert_ptr_nonnull(packages);
+  ck_assert_int_eq(di_packages_cache_write(packages, file), 0);
+
+  allocator_cache = di_packages_allocator_alloc();
+  packages_cache = di_packages_cache_read(file, allocator_cache);
+  ck_assert_ptr_nonnull(packages_cache);
+
+  /* a cache with an out of range priority in the first package is rejected */
+  {
+    unsigned char priority = 0xff;
+    off_t offset = sizeof(struct internal_di_packages_cache_header) +
+                   offsetof(struct internal_di_packages_cache_package, priority);
+    di_packages_allocator *allocator_corrupt = di_packages_allocator_alloc();
+
+    fd = open(file, O_WRONLY);
+    ck_assert_int_ge(fd, 0);
+    ck_assert_int_eq(pwrite(fd, &priority, 1, offset), 1);
+    close(fd);
+    ck_assert_ptr_null(di_packages_cache_read(file, allocator_corrupt));
+    di_packages_allocator_free(allocator_corrupt);
+  }
+  unlink(file);
+
+  ck_assert_int_eq(di_hash_table_size(packages_cache->table), di_hash_table_size(packages->table));
+
+  for (node = packages->list.head, node_cache = packages_cache->list.head; node; node = node->next, node_cache = node_cache->next) {
+    di_package *p = node->data;
+    di_package *q = di_packages_get_package(packages_cache, p->package, 0);
+    di_slist_node *d, *d_cache;
+
+    ck_assert_ptr_nonnull(node_cache);
+    ck_assert_ptr_eq(node_cache->data, q);
+    ck_assert_int_eq(q->priority, p->priority);
+    ck_assert_int_eq(q->essential, p->essential);
+    ck_assert_int_eq(q->size, p->size);
+    ck_assert_str_eq(q->version, p->version);
+    ck_assert_str_eq(q->filename, p->filename);
+    ck_assert_pstr_eq(q->sha256, p->sha256);
+
+    for (d = p->depends.head, d_cache = q->depends.head; d; d = d->next, d_cache = d_cache->next) {
+      di_package_dependency *dep = d->data, *dep_cache;
+
+      ck_assert_ptr_nonnull(d_cache);
+      dep_cache = d_cache->data;
+      ck_assert_int_eq(dep_cache->type, dep->type);
+      ck_assert_int_eq(dep_cache->relation, dep->relation);
+      ck_assert_pstr_eq(dep_cache->version, dep->version);
+      ck_assert_str_eq(dep_cache->ptr->package, dep->ptr->package);
+    }
+    ck_assert_ptr_null(d_cache);
+  }
+  ck_assert_ptr_null(node_cache);
+
+  di_packages_free(packages_cache);
+  di_packages_allocator_free(allocator_cache);
+  di_packages_free(packages);
+  di_packages_allocator_free(allocator);
+}
+END_TEST
+
+START_TEST(test_index)
+{
+  di_packages_allocator *allocator, *allocator_index;
+  di_packages *packages, *packages_index;
+  di_packages_index *index;
+  di_slist_node *node;
+  uint32_t id, key;
+
+  allocator = di_packages_allocator_alloc();
+  packages = di_packages_read_file(DOWNLOAD_PACKAGES, allocator);
+  allocator_index = di_packages_allocator_alloc();
+  packages_index = di_packages_read_file(DOWNLOAD_PACKAGES, allocator_index);
+  ck_assert_ptr_nonnull(packages);
+  ck_assert_ptr_nonnull(packages_index);
+
+  index = di_packages_index_build(packages_index);
+  ck_assert_ptr_eq(di_packages_index_build(packages_index), index);
+  ck_assert_int_eq(index->count, di_hash_table_size(packages_index->table));
+
+  for (id = 0; id < index->count; id++) {
+    di_package *p = index->package[id];
+
+    ck_assert_int_eq(p->id, id);
+    ck_assert_int_eq(index->type[id], p->type);
+    ck_assert_int_eq(index->priority[id], p->priority);
+    ck_assert_int_le(index->edge[id], index->edge[id + 1]);
+  }
+
+  /* the secondary indices list every package once, in ID order */
+  ck_assert_int_eq(index->by_essential.start[2], index->count);
+  ck_assert_int_eq(index->by_priority.start[index->by_priority.keys], index->count);
+  for (key = 0; key < index->by_priority.keys; key++) {
+    const uint32_t *ids = di_packages_index_postings_get(&index->by_priority, key);
+
+    for (id = 0; id < di_packages_index_postings_size(&index->by_priority, key); id++) {
+      ck_assert_int_eq(index->priority[ids[id]], key);
+      if (id)
+        ck_assert_int_lt(ids[id - 1], ids[id]);
+    }
+  }
+  for (id = 0; id < di_packages_index_postings_size(&index->by_essential, 1); id++)
+    ck_assert(index->package[di_packages_index_postings_get(&index->by_essential, 1)[id]]->essential);
+  for (key = 0; key < index->by_section.keys; key++) {
+    const uint32_t *ids = di_packages_index_postings_get(&index->by_section, key);
+
+    char upper[256];
+
+    ck_assert_int_eq(di_packages_index_section(index, index->section[key]), key);
+    ck_assert_int_eq(strcasecmp(index->package[ids[0]]->section, index->section[key]), 0);
+
+    /* sections differing in case are the same */
+    snprintf(upper, sizeof upper, "%s", index->section[key]);
+    for (char *ch = upper; *ch; ch++)
+      *ch = toupper((unsigned char) *ch);
+    ck_assert_int_eq(di_packages_index_section(index, upper), key);
+  }
+  ck_assert_int_eq(di_packages_index_section(index, "no-such-section"), UINT32_MAX);
+
+  /* the resolver on the index returns the same packages */
+  for (node = packages->list.head; node; node = node->next) {
+    di_package *p = node->data;
+    di_slist roots = { NULL, NULL }, roots_index = { NULL, NULL };
+    di_slist *list, *list_index;
+    di_slist_node *n, *n_index;
+
+    di_slist_append(&roots, p);
+    di_slist_append(&roots_index, di_packages_get_package(packages_index, p->package, 0));
+    list = di_packages_resolve_dependencies(packages, &roots, allocator);
+    list_index = di_packages_resolve_dependencies(packages_index, &roots_index, allocator_index);
+
+    for (n = list->head, n_index = list_index->head; n; n = n->next, n_index = n_index->next) {
+      ck_assert_ptr_nonnull(n_index);
+      ck_assert_str_eq(((di_package *) n_index->data)->package, ((di_package *) n->data)->package);
+    }
+    ck_assert_ptr_null(n_index);
+
+    di_slist_destroy(&roots, NULL);
+    di_slist_destroy(&roots_index, NULL);
+    di_slist_free(list);
+    di_slist_free(list_index);
+  }
+
+  di_packages_free(packages_index);
+  di_packages_allocator_free(allocator_index);
+  di_packages_free(packages);
+  di_packages_allocator_free(allocator);
+}
+END_TEST
+
+START_TEST(test_index_deep)
+{
+  di_packages_allocator *allocator;
+  di_packages *packages;
+  di_slist roots = { NULL, NULL };
+  di_slist *list;
+  char file[] = "/tmp/test_packages_deep.XXXXXX";
+  const int depth = 100000;
+  FILE *f;
+  int fd, i;
+
+  /* a chain far deeper than a recursive resolver could follow */
+  fd = mkstemp(file);
+  ck_assert_int_ge(fd, 0);
+  f = fdopen(fd, "w");
+  for (i = 0; i < depth; i++)
+    fprintf(f, "Package: p%d\nDepends: p%d\n\n", i, i + 1);
+  fprintf(f, "Package: p%d\n\n", depth);
+  fclose(f);
+
+  allocator = di_packages_allocator_alloc();
+  packages = di_packages_read_file(file, allocator);
+  unlink(file);
+  ck_assert_ptr_nonnull(packages);
+
+  di_packages_index_build(packages);
+  di_slist_append(&roots, di_packages_get_package(packages, "p0", 0));
+  list = di_packages_resolve_dependencies(packages, &roots, allocator);
+
+  /* dependencies come first */
+  ck_assert_str_eq(((di_package *) list->head->data)->package, "p100000");
+  ck_assert_str_eq(((di_package *) list->bottom->data)->package, "p0");
+
+  di_slist_destroy(&roots, NULL);
+  di_slist_free(list);
+  di_packages_free(packages);
+  di_packages_allocator_free(allocator);
+}
+END_TEST
+
+START_TEST(test_index_smallest)
+{
+  di_packages_allocator *allocator;
+  di_packages *packages;
+  di_package *root;
+  di_package_dependency *d;
+  di_slist roots = { NULL, NULL };
+  di_slist *list;
+  di_slist_node *node;
+  char file[] = "/tmp/test_packages_smallest.XXXXXX";
+  const char *expected[] = { "big", "postfix", "versioned", "root" };
+  FILE *f;
+  int fd, i;
+
+  fd = mkstemp(file);
+  ck_assert_int_ge(fd, 0);
+  f = fdopen(fd, "w");
+  fputs("Package: root\nDepends: big | small (>= 2) | tiny (<< 1), mail-transport-agent, libfoo (>= 1)\n\n"
+        "Package: big\nVersion: 1\nSize: 100000\nInstalled-Size: 100\n\n"
+        "Package: small\nVersion: 2\nDepends: huge\nSize: 1000\nInstalled-Size: 1\n\n"
+        "Package: tiny\nVersion: 1\nSize: 10\n\n"
+        "Package: huge\nSize: 1000000\nInstalled-Size: 1000\n\n"
+        "Package: exim\nProvides: mail-transport-agent\nSize: 50000\nInstalled-Size: 50\n\n"
+        "Package: postfix\nProvides: mail-transport-agent\nSize: 5000\nInstalled-Size: 5\n\n"
+        "Package: unversioned\nProvides: libfoo\nSize: 10\n\n"
+        "Package: versioned\nProvides: libfoo (= 2)\nSize: 20000\n\n", f);
+  fclose(f);
+
+  allocator = di_packages_allocator_alloc();
+  packages = di_packages_read_file(file, allocator);
+  unlink(file);
+  ck_assert_ptr_nonnull(packages);
+
+  /* alternatives follow the first package of their group */
+  root = di_packages_get_package(packages, "root", 0);
+  node = root->depends.head;
+  d = node->data;
+  ck_assert_int_eq(d->type, di_package_dependency_type_depends);
+  ck_assert_str_eq(d->ptr->package, "big");
+  ck_assert_int_eq(d->relation, di_package_dependency_relation_none);
+  d = (node = node->next)->data;
+  ck_assert_int_eq(d->type, di_package_dependency_type_alternative);
+  ck_assert_str_eq(d->ptr->package, "small");
+  ck_assert_int_eq(d->relation, di_package_dependency_relation_later_equal);
+  ck_assert_str_eq(d->version, "2");
+  d = (node = node->next)->data;
+  ck_assert_int_eq(d->type, di_package_dependency_type_alternative);
+  ck_assert_int_eq(d->relation, di_package_dependency_relation_earlier);
+  d = (node = node->next)->data;
+  ck_assert_int_eq(d->type, di_package_dependency_type_depends);
+  ck_assert_str_eq(d->ptr->package, "mail-transport-agent");
+
+  ck_assert(di_package_version_satisfies("1:1.0-1", di_package_dependency_relation_later, "2.0"));
+  ck_assert(!di_package_version_satisfies("1.0~rc1", di_package_dependency_relation_later_equal, "1.0"));
+  ck_assert(!di_package_version_satisfies(NULL, di_package_dependency_relation_equal, "1.0"));
+
+  di_packages_index_choose_smallest(di_packages_index_build(packages));
+  di_slist_append(&roots, root);
+  list = di_packages_resolve_dependencies(packages, &roots, allocator);
+
+  for (node = list->head, i = 0; node; node = node->next, i++) {
+    ck_assert_int_lt(i, 4);
+    ck_assert_str_eq(((di_package *) node->data)->package, expected[i]);
+  }
+  ck_assert_int_eq(i, 4);
+
+  di_slist_destroy(&roots, NULL);
+  di_slist_free(list);
+  di_packages_free(packages);
+  di_packages_allocator_free(allocator);
+}
+END_TEST
+
+START_TEST(test_compact)
+{
+  di_packages_allocator *allocator, *allocator_compact;
+  di_packages *packages, *compact;
+  di_slist roots = { NULL, NULL }, roots_compact = { NULL, NULL };
+  di_slist *list;
+  di_slist_node *node;
+  char file[] = "/tmp/test_packages_compact.XXXXXX";
+  const char *expected[] = { "postfix", "c", "a", "root" };
+  FILE *f;
+  int fd, i;
+
+  fd = mkstemp(file);
+  ck_assert_int_ge(fd, 0);
+  f = fdopen(fd, "w");
+  fputs("Package: root\nDepends: mail-transport-agent, a | b\n\n"
+        "Package: a\nVersion: 1\nDepends: c\n\n"
+        "Package: b\n\n"
+        "Package: c\n\n"
+        "Package: exim\nPriority: optional\nProvides: mail-transport-agent\n\n"
+        "Package: postfix\nPriority: important\nProvides: mail-transport-agent\n\n"
+        "Package: unrelated\nDepends: b\n\n", f);
+  fclose(f);
+
+  allocator = di_packages_allocator_alloc();
+  packages = di_packages_read_file(file, allocator);
+  unlink(file);
+  ck_assert_ptr_nonnull(packages);
+
+  di_packages_index_build(packages);
+  di_slist_append(&roots, di_packages_get_package(packages, "root", 0));
+  list = di_packages_resolve_dependencies(packages, &roots, allocator);
+  di_slist_destroy(&roots, NULL);
+
+  allocator_compact = di_packages_allocator_alloc_arena();
+  compact = di_packages_compact(packages, list, allocator_compact);
+  di_slist_free(list);
+  di_packages_free(packages);
+  di_packages_allocator_free(allocator);
+
+  /* the copies and a stub of the virtual package, provided by the copy only */
+  ck_assert_int_eq(di_hash_table_size(compact->table), 5);
+  ck_assert_ptr_null(di_packages_get_package(compact, "b", 0));
+  ck_assert_ptr_null(di_packages_get_package(compact, "exim", 0));
+  ck_assert_str_eq(di_packages_get_package(compact, "a", 0)->version, "1");
+  for (node = compact->list.head, i = 0; node; node = node->next, i++)
+    ck_assert_str_eq(((di_package *) node->data)->package, expected[i]);
+
+  /* and resolve like the original packages */
+  di_packages_index_build(compact);
+  di_slist_append(&roots_compact, di_packages_get_package(compact, "root", 0));
+  list = di_packages_resolve_dependencies(compact, &roots_compact, allocator_compact);
+  for (node = list->head, i = 0; node; node = node->next, i++) {
+    ck_assert_int_lt(i, 4);
+    ck_assert_str_eq(((di_package *) node->data)->package, expected[i]);
+  }
+  ck_assert_int_eq(i, 4);
+
+  di_slist_destroy(&roots_compact, NULL);
+  di_slist_free(list);
+  di_packages_free(compact);
+  di_packages_allocator_free(allocator_compact);
+}
+END_TEST
+
+Suite* make_test_packages_suite() {
+  Suite *s;
+  TCase *tc_core;
+
+  s = suite_create("test packages");
+  tc_core = tcase_create("Core");
+  tcase_add_test(tc_core, test_read_parallel);
+  tcase_add_test(tc_core, test_read_lazy);
+  tcase_add_test(tc_core, test_read_arena);
+  tcase_add_test(tc_core, test_arena_align);
+  tcase_add_test(tc_core, test_cache);
+  tcase_add_test(tc_core, test_index);
+  tcase_add_test(tc_core, test_index_deep);
+  tcase_add_test(tc_core, test_index_smallest);
+  tcase_add_test(tc_core, test_compact);
+  suite_add_tcase(s, tc_core);
+
+  return s;
+}
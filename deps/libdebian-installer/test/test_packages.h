@@ -0,0 +1,6 @@
+#ifndef TEST_PACKAGES_H
+#define TEST_PACKAGES_H
+
+Suite* make_test_packages_suite();
+
+#endif
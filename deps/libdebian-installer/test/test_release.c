@@ -0,0 +1,122 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <check.h>
+
+#include <debian-installer/release.h>
+
+#include "test_release.h"
+
+/* Extra whitespace, a malformed size, a missing filename and a repeated
+ * entry for main/binary-amd64/Packages, whose last one counts. */
+static const char release_data[] =
+  "Origin: Debian\n"
+  "Suite: stable\n"
+  "Codename: trixie\n"
+  "Acquire-By-Hash: yes\n"
+  "MD5Sum:\n"
+  " 11111111 100 main/binary-amd64/Packages\n"
+  "   22222222 \t 200   main/binary-amd64/Packages.gz  \n"
+  " 33333333 3x0 main/binary-amd64/Packages.xz\n"
+  " 44444444 400\n"
+  " 55555555 500 main/binary-i386/Packages\n"
+  " 66666666 600 main/binary-amd64/Packages\n"
+  "SHA256:\n"
+  " aaaaaaaa 600 main/binary-amd64/Packages\n"
+  " bbbbbbbb 200 main/binary-amd64/Packages.gz\n"
+  " cccccccc 500 main/binary-i386/Packages\n";
+
+static di_release_file *get_file(di_release *release, const char *name) {
+  di_rstring key;
+
+  key.string = (char *) name;
+  key.size = strlen(name);
+  return di_hash_table_lookup(release->sha256, &key);
+}
+
+static void write_release(char *file) {
+  int fd;
+
+  fd = mkstemp(file);
+  ck_assert_int_ge(fd, 0);
+  ck_assert_int_eq(write(fd, release_data, sizeof release_data - 1), sizeof release_data - 1);
+  close(fd);
+}
+
+static void check_amd64(di_release *release) {
+  di_release_file *file;
+
+  ck_assert_str_eq(release->suite, "stable");
+  ck_assert_str_eq(release->codename, "trixie");
+  ck_assert(release->acquire_by_hash);
+
+  file = get_file(release, "main/binary-amd64/Packages");
+  ck_assert_ptr_nonnull(file);
+  ck_assert_int_eq(file->size, 600);
+  ck_assert_str_eq(file->sum[0], "66666666");
+  ck_assert_str_eq(file->sum[1], "aaaaaaaa");
+
+  file = get_file(release, "main/binary-amd64/Packages.gz");
+  ck_assert_ptr_nonnull(file);
+  ck_assert_int_eq(file->size, 200);
+  ck_assert_str_eq(file->sum[0], "22222222");
+  ck_assert_str_eq(file->sum[1], "bbbbbbbb");
+
+  ck_assert_ptr_null(get_file(release, "main/binary-amd64/Packages.xz"));
+}
+
+START_TEST(test_release)
+{
+  char file[] = "/tmp/test_release.XXXXXX";
+  di_release *release;
+  di_release_file *i386;
+
+  write_release(file);
+  release = di_release_read_file(file);
+  unlink(file);
+  ck_assert_ptr_nonnull(release);
+
+  check_amd64(release);
+  i386 = get_file(release, "main/binary-i386/Packages");
+  ck_assert_ptr_nonnull(i386);
+  ck_assert_int_eq(i386->size, 500);
+  ck_assert_pstr_eq(i386->sum[1], "cccccccc");
+  ck_assert_int_eq(di_hash_table_size(release->sha256), 3);
+
+  di_release_free(release);
+}
+END_TEST
+
+START_TEST(test_release_filtered)
+{
+  char file[] = "/tmp/test_release.XXXXXX";
+  const char *const filter[] = { "main/binary-amd64/", NULL };
+  di_release *release;
+
+  write_release(file);
+  release = di_release_read_file_filtered(file, filter);
+  unlink(file);
+  ck_assert_ptr_nonnull(release);
+
+  check_amd64(release);
+  ck_assert_ptr_null(get_file(release, "main/binary-i386/Packages"));
+  ck_assert_int_eq(di_hash_table_size(release->sha256), 2);
+
+  di_release_free(release);
+}
+END_TEST
+
+Suite* make_test_release_suite() {
+  Suite *s;
+  TCase *tc_core;
+
+  s = suite_create("test release");
+  tc_core = tcase_create("Core");
+  tcase_add_test(tc_core, test_release);
+  tcase_add_test(tc_core, test_release_filtered);
+  suite_add_tcase(s, tc_core);
+
+  return s;
+}
@@ -0,0 +1,6 @@
+#ifndef TEST_RELEASE_H
+#define TEST_RELEASE_H
+
+Suite* make_test_release_suite();
+
+#endif
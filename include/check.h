@@ -24,6 +24,7 @@
 #include <debian-installer.h>
 
 int check_deb (const char *target, di_package *package, const char *message);
+void check_debs (const char *const *targets, di_package *const *packages, bool *valid, size_t count);
 int check_packages (const char *target, const char *ext, di_release *rel);
 
 #endif
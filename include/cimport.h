@@ -6,6 +6,9 @@
 #include "download.h"
 #include "target.h"
 #include "execute.h"
+#include "path_filter.h"
 
 #include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
 #include <sys/mount.h>
@@ -27,21 +27,25 @@
 struct decompress_bz;
 struct decompress_gz;
 struct decompress_xz;
+struct decompress_zst;
 struct decompress_null;
 
 struct decompress_bz *decompress_bz_new (int fd, size_t len);
 struct decompress_gz *decompress_gz_new (int fd, size_t len);
 struct decompress_xz *decompress_xz_new (int fd, size_t len);
+struct decompress_zst *decompress_zst_new (int fd, size_t len);
 struct decompress_null *decompress_null_new (int fd, size_t len);
 
 void decompress_bz_free (struct decompress_bz *);
 void decompress_gz_free (struct decompress_gz *);
 void decompress_xz_free (struct decompress_xz *);
+void decompress_zst_free (struct decompress_zst *);
 void decompress_null_free (struct decompress_null *);
 
 ssize_t decompress_bz (struct decompress_bz *, int fd);
 ssize_t decompress_gz (struct decompress_gz *, int fd);
 ssize_t decompress_xz (struct decompress_xz *, int fd);
+ssize_t decompress_zst (struct decompress_zst *, int fd);
 ssize_t decompress_null (struct decompress_null *, int fd);
 
 static inline void decompress_bz_handler (FILE *f, void *c)
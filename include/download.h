@@ -46,5 +46,6 @@ int download(struct suite_packages *install);
 int download_file_target(const char *source, const char *target, const char *message);
 
 int download_init (const char *suite, const char *arch, bool authentication);
+int download_index_cache_init (const char *dir);
 
 #endif
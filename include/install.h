@@ -40,7 +40,9 @@ int install_extract (di_slist *install);
 di_slist *install_list_priority(di_packages *packages, di_packages_allocator *allocator, di_slist *install, di_package_priority min_priority, di_package_status max_status);
 di_slist *install_list_package(di_packages *packages, di_packages_allocator *allocator, char *package, di_package_status max_status);
 di_slist *install_list_package_only(di_packages *packages, char *package, di_package_status max_status);
+void install_list_cache_free(void);
 
+void install_helper_file (char *buf, size_t size, const char *name);
 int install_helper_install (const char *name);
 int install_helper_remove (const char *name);
 
@@ -0,0 +1,30 @@
+/*
+ * stage_cache.h
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef STAGE_CACHE_H
+#define STAGE_CACHE_H
+
+#include <debian-installer.h>
+
+#include "suite_packages.h"
+
+int stage_cache_init (const char *dir);
+int stage_cache_restore (struct suite_packages *packages);
+void stage_cache_save (void);
+
+#endif
@@ -34,5 +34,6 @@ extern const char *suite_release_codename;
 int suite_init (const char *origin, const char *codename, const char *suite_config_name, const char *arch, const char *flavour, di_slist *include, di_slist *exclude, const char *configdir);
 int suite_install (di_packages *packages, di_packages_allocator *allocator, di_slist *install);
 int suite_select (const di_release *release);
+const char *suite_get_flavour (void);
 
 #endif
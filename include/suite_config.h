@@ -33,6 +33,7 @@ typedef struct suites_config_entry suites_config_entry;
 struct suite_config
 {
   char *name;
+  char *dir;
   di_slist actions;
   di_hash_table *sections;
   bool flavour_valid;
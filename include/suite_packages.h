@@ -35,6 +35,7 @@ struct suite_packages {
 };
 
 void suite_packages_init(di_slist *include, di_slist *exclude);
+void suite_packages_choose_smallest(void);
 void suite_packages_list(struct suite_packages *packages);
 
 #endif
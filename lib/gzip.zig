@@ -0,0 +1,762 @@
+//! Gzip compression, split into independent members which are compressed in
+//! parallel.
+//!
+//! Concatenated gzip members form a valid gzip file (RFC 1952, section 2.2),
+//! which is understood by all common decompressors.  Each member holds one
+//! chunk of input, compressed with deflate (RFC 1951) using hash chained
+//! LZ77 with lazy matching and length limited Huffman codes.  The window is
+//! not shared between chunks, which costs a few bytes per chunk compared to
+//! a single stream.
+
+const std = @import("std");
+const mem = std.mem;
+const assert = std.debug.assert;
+
+/// Size of the input compressed into one gzip member.
+pub const chunk_len = 1024 * 1024;
+
+const window_len = 32 * 1024;
+const window_mask = window_len - 1;
+const hash_bits = 15;
+const max_chain = 64;
+/// Matches at least this long are taken without looking for a better match
+/// at the next position.
+const lazy_limit = 32;
+const min_match = 3;
+const max_match = 258;
+/// Number of tokens collected before a block is emitted.
+const block_tokens = 16 * 1024;
+const max_stored_len = 65535;
+
+const none = std.math.maxInt(u32);
+
+/// Member header: no name, no modification time, Unix.
+const header = [_]u8{ 0x1f, 0x8b, 8, 0, 0, 0, 0, 0, 0, 3 };
+
+const len_base = [29]u16{ 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+const len_extra = [29]u8{ 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+const dist_base = [30]u16{ 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+const dist_extra = [30]u8{ 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+/// Order in which the code length code lengths are transmitted.
+const cl_order = [19]u8{ 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+
+const fixed_lit_lens: [288]u8 = [_]u8{8} ** 144 ++ [_]u8{9} ** 112 ++ [_]u8{7} ** 24 ++ [_]u8{8} ** 8;
+const fixed_dist_lens: [30]u8 = [_]u8{5} ** 30;
+const fixed_lit_codes = blk: {
+    @setEvalBranchQuota(10000);
+    var codes: [288]u16 = undefined;
+    buildCodes(&fixed_lit_lens, &codes);
+    break :blk codes;
+};
+const fixed_dist_codes = blk: {
+    @setEvalBranchQuota(10000);
+    var codes: [30]u16 = undefined;
+    buildCodes(&fixed_dist_lens, &codes);
+    break :blk codes;
+};
+
+/// Returns the length code (0-28) of a match length.
+fn lengthCode(len: u16) u8 {
+    if (len == max_match) return 28;
+    const x = len - min_match;
+    if (x < 8) return @intCast(x);
+    const bits: u4 = @intCast(15 - @clz(x));
+    return @intCast(4 * (@as(u16, bits) - 1) + ((x >> (bits - 2)) & 3));
+}
+
+/// Returns the distance code (0-29) of a match distance.
+fn distCode(dist: u16) u8 {
+    const x = dist - 1;
+    if (x < 4) return @intCast(x);
+    const bits: u4 = @intCast(15 - @clz(x));
+    return @intCast(2 * @as(u16, bits) + ((x >> (bits - 1)) & 1));
+}
+
+/// A literal if `dist` is 0, a match otherwise.
+const Token = struct {
+    value: u16,
+    dist: u16,
+};
+
+const Match = struct {
+    len: u16 = 0,
+    dist: u16 = 0,
+};
+
+/// Code length code with its repeat count.
+const ClToken = struct {
+    symbol: u8,
+    extra: u8 = 0,
+};
+
+const BitWriter = struct {
+    out: *std.ArrayList(u8),
+    bits: u64 = 0,
+    count: u8 = 0,
+
+    /// Appends the `n` low bits of `value`.  Capacity of `out` has to be
+    /// reserved beforehand.
+    fn put(w: *BitWriter, value: u32, n: u8) void {
+        assert(n <= 16);
+        w.bits |= @as(u64, value) << @intCast(w.count);
+        w.count += n;
+        while (w.count >= 8) {
+            w.out.appendAssumeCapacity(@truncate(w.bits));
+            w.bits >>= 8;
+            w.count -= 8;
+        }
+    }
+
+    fn alignByte(w: *BitWriter) void {
+        if (w.count > 0) {
+            w.out.appendAssumeCapacity(@truncate(w.bits));
+            w.bits = 0;
+            w.count = 0;
+        }
+    }
+};
+
+const Deflate = struct {
+    gpa: mem.Allocator,
+    input: []const u8,
+    out: *std.ArrayList(u8),
+    bit_writer: BitWriter,
+    /// Most recent position for each hash value.
+    head: []u32,
+    /// Previous position with the same hash, indexed by position in the
+    /// window.
+    prev: []u32,
+    tokens: std.ArrayList(Token),
+    final_written: bool = false,
+
+    fn init(gpa: mem.Allocator, input: []const u8, out: *std.ArrayList(u8)) !Deflate {
+        assert(input.len < none);
+        const head = try gpa.alloc(u32, 1 << hash_bits);
+        errdefer gpa.free(head);
+        const prev = try gpa.alloc(u32, window_len);
+        errdefer gpa.free(prev);
+        var tokens: std.ArrayList(Token) = try .initCapacity(gpa, block_tokens);
+        errdefer tokens.deinit(gpa);
+        @memset(head, none);
+        @memset(prev, none);
+        return .{
+            .gpa = gpa,
+            .input = input,
+            .out = out,
+            .bit_writer = .{ .out = out },
+            .head = head,
+            .prev = prev,
+            .tokens = tokens,
+        };
+    }
+
+    fn deinit(d: *Deflate) void {
+        d.gpa.free(d.head);
+        d.gpa.free(d.prev);
+        d.tokens.deinit(d.gpa);
+    }
+
+    fn hash(bytes: *const [3]u8) u32 {
+        const v = @as(u32, bytes[0]) | @as(u32, bytes[1]) << 8 | @as(u32, bytes[2]) << 16;
+        return (v *% 2654435761) >> (32 - hash_bits);
+    }
+
+    fn insert(d: *Deflate, pos: usize) void {
+        if (pos + min_match > d.input.len) return;
+        const h = hash(d.input[pos..][0..3]);
+        d.prev[pos & window_mask] = d.head[h];
+        d.head[h] = @intCast(pos);
+    }
+
+    fn findMatch(d: *Deflate, pos: usize) Match {
+        const input = d.input;
+        if (pos + min_match > input.len) return .{};
+        const max_len = @min(max_match, input.len - pos);
+
+        var best: Match = .{};
+        var candidate = d.head[hash(input[pos..][0..3])];
+        var chain: usize = max_chain;
+        while (candidate != none and chain > 0) : (chain -= 1) {
+            const cand: usize = candidate;
+            if (pos - cand > window_len) break;
+            if (input[cand + best.len] == input[pos + best.len]) {
+                const len = mem.indexOfDiff(u8, input[cand..][0..max_len], input[pos..][0..max_len]) orelse max_len;
+                if (len > best.len) {
+                    best = .{ .len = @intCast(len), .dist = @intCast(pos - cand) };
+                    if (len == max_len) break;
+                }
+            }
+            // Entries older than the window have been overwritten by newer
+            // positions.
+            const next = d.prev[cand & window_mask];
+            if (next == none or next >= candidate) break;
+            candidate = next;
+        }
+        if (best.len < min_match) return .{};
+        return best;
+    }
+
+    fn run(d: *Deflate) !void {
+        const input = d.input;
+        var pos: usize = 0;
+        var block_start: usize = 0;
+        while (pos < input.len) {
+            var m = d.findMatch(pos);
+            if (m.len >= min_match) {
+                d.insert(pos);
+                if (m.len < lazy_limit and pos + 1 < input.len) {
+                    const next = d.findMatch(pos + 1);
+                    if (next.len > m.len) {
+                        d.tokens.appendAssumeCapacity(.{ .value = input[pos], .dist = 0 });
+                        pos += 1;
+                        m = next;
+                        d.insert(pos);
+                    }
+                }
+                d.tokens.appendAssumeCapacity(.{ .value = m.len, .dist = m.dist });
+                for (1..m.len) |i| d.insert(pos + i);
+                pos += m.len;
+            } else {
+                d.insert(pos);
+                d.tokens.appendAssumeCapacity(.{ .value = input[pos], .dist = 0 });
+                pos += 1;
+            }
+
+            if (d.tokens.items.len + 2 > block_tokens) {
+                try d.writeBlock(input[block_start..pos], pos == input.len);
+                block_start = pos;
+            }
+        }
+        if (!d.final_written) try d.writeBlock(input[block_start..], true);
+        d.bit_writer.alignByte();
+    }
+
+    fn tokenCost(d: *const Deflate, lit_lens: []const u8, dist_lens: []const u8) u64 {
+        var cost: u64 = lit_lens[256];
+        for (d.tokens.items) |t| {
+            if (t.dist == 0) {
+                cost += lit_lens[t.value];
+            } else {
+                const lc = lengthCode(t.value);
+                const dc = distCode(t.dist);
+                cost += lit_lens[257 + @as(usize, lc)] + len_extra[lc] + dist_lens[dc] + dist_extra[dc];
+            }
+        }
+        return cost;
+    }
+
+    fn writeBlock(d: *Deflate, raw: []const u8, final: bool) !void {
+        var lit_freqs = [_]u32{0} ** 286;
+        var dist_freqs = [_]u32{0} ** 30;
+        for (d.tokens.items) |t| {
+            if (t.dist == 0) {
+                lit_freqs[t.value] += 1;
+            } else {
+                lit_freqs[257 + @as(usize, lengthCode(t.value))] += 1;
+                dist_freqs[distCode(t.dist)] += 1;
+            }
+        }
+        lit_freqs[256] = 1;
+
+        var lit_lens = [_]u8{0} ** 288;
+        var dist_lens: [30]u8 = undefined;
+        buildLengths(&lit_freqs, lit_lens[0..286], 15);
+        buildLengths(&dist_freqs, &dist_lens, 15);
+
+        var hlit: usize = 286;
+        while (hlit > 257 and lit_lens[hlit - 1] == 0) hlit -= 1;
+        var hdist: usize = 30;
+        while (hdist > 1 and dist_lens[hdist - 1] == 0) hdist -= 1;
+
+        var all_lens: [286 + 30]u8 = undefined;
+        @memcpy(all_lens[0..hlit], lit_lens[0..hlit]);
+        @memcpy(all_lens[hlit..][0..hdist], dist_lens[0..hdist]);
+        var cl_tokens: [286 + 30]ClToken = undefined;
+        const cl = runLength(all_lens[0 .. hlit + hdist], &cl_tokens);
+
+        var cl_freqs = [_]u32{0} ** 19;
+        for (cl) |t| cl_freqs[t.symbol] += 1;
+        var cl_lens: [19]u8 = undefined;
+        buildLengths(&cl_freqs, &cl_lens, 7);
+        var hclen: usize = 19;
+        while (hclen > 4 and cl_lens[cl_order[hclen - 1]] == 0) hclen -= 1;
+
+        var dynamic_cost: u64 = 3 + 14 + 3 * hclen + d.tokenCost(&lit_lens, &dist_lens);
+        for (cl) |t| dynamic_cost += cl_lens[t.symbol] + clExtraBits(t.symbol);
+        const fixed_cost: u64 = 3 + d.tokenCost(&fixed_lit_lens, &fixed_dist_lens);
+        const stored_blocks = @max(1, std.math.divCeil(usize, raw.len, max_stored_len) catch unreachable);
+        const stored_cost: u64 = (raw.len + 5 * stored_blocks) * 8 + 3 + 7;
+
+        const w = &d.bit_writer;
+        const final_bit: u32 = @intFromBool(final);
+        if (stored_cost <= @min(dynamic_cost, fixed_cost)) {
+            try d.out.ensureUnusedCapacity(d.gpa, raw.len + 5 * stored_blocks + 8);
+            var rest = raw;
+            for (0..stored_blocks) |i| {
+                const part = rest[0..@min(rest.len, max_stored_len)];
+                rest = rest[part.len..];
+                w.put(final_bit & @intFromBool(i == stored_blocks - 1), 1);
+                w.put(0, 2);
+                w.alignByte();
+                w.put(@intCast(part.len), 16);
+                w.put(@intCast(part.len ^ 0xffff), 16);
+                d.out.appendSliceAssumeCapacity(part);
+            }
+        } else if (fixed_cost <= dynamic_cost) {
+            try d.out.ensureUnusedCapacity(d.gpa, fixed_cost / 8 + 8);
+            w.put(final_bit, 1);
+            w.put(1, 2);
+            d.writeTokens(&fixed_lit_lens, &fixed_lit_codes, &fixed_dist_lens, &fixed_dist_codes);
+        } else {
+            try d.out.ensureUnusedCapacity(d.gpa, dynamic_cost / 8 + 8);
+            w.put(final_bit, 1);
+            w.put(2, 2);
+            w.put(@intCast(hlit - 257), 5);
+            w.put(@intCast(hdist - 1), 5);
+            w.put(@intCast(hclen - 4), 4);
+            for (cl_order[0..hclen]) |symbol| w.put(cl_lens[symbol], 3);
+            var cl_codes: [19]u16 = undefined;
+            buildCodes(&cl_lens, &cl_codes);
+            for (cl) |t| {
+                w.put(cl_codes[t.symbol], cl_lens[t.symbol]);
+                const extra = clExtraBits(t.symbol);
+                if (extra > 0) w.put(t.extra, extra);
+            }
+            var lit_codes: [288]u16 = undefined;
+            var dist_codes: [30]u16 = undefined;
+            buildCodes(&lit_lens, &lit_codes);
+            buildCodes(&dist_lens, &dist_codes);
+            d.writeTokens(&lit_lens, &lit_codes, &dist_lens, &dist_codes);
+        }
+
+        d.tokens.clearRetainingCapacity();
+        if (final) d.final_written = true;
+    }
+
+    fn writeTokens(
+        d: *Deflate,
+        lit_lens: []const u8,
+        lit_codes: []const u16,
+        dist_lens: []const u8,
+        dist_codes: []const u16,
+    ) void {
+        const w = &d.bit_writer;
+        for (d.tokens.items) |t| {
+            if (t.dist == 0) {
+                w.put(lit_codes[t.value], lit_lens[t.value]);
+                continue;
+            }
+            const lc = lengthCode(t.value);
+            const symbol = 257 + @as(usize, lc);
+            w.put(lit_codes[symbol], lit_lens[symbol]);
+            if (len_extra[lc] > 0) w.put(t.value - len_base[lc], len_extra[lc]);
+            const dc = distCode(t.dist);
+            w.put(dist_codes[dc], dist_lens[dc]);
+            if (dist_extra[dc] > 0) w.put(t.dist - dist_base[dc], dist_extra[dc]);
+        }
+        w.put(lit_codes[256], lit_lens[256]);
+    }
+};
+
+fn clExtraBits(symbol: u8) u8 {
+    return switch (symbol) {
+        16 => 2,
+        17 => 3,
+        18 => 7,
+        else => 0,
+    };
+}
+
+/// Encodes code lengths with the run length codes 16, 17 and 18.
+fn runLength(lens: []const u8, out: []ClToken) []ClToken {
+    var n: usize = 0;
+    var i: usize = 0;
+    while (i < lens.len) {
+        const len = lens[i];
+        var run: usize = 1;
+        while (i + run < lens.len and lens[i + run] == len) run += 1;
+        i += run;
+
+        if (len == 0) {
+            while (run >= 11) {
+                const r = @min(run, 138);
+                out[n] = .{ .symbol = 18, .extra = @intCast(r - 11) };
+                n += 1;
+                run -= r;
+            }
+            if (run >= 3) {
+                out[n] = .{ .symbol = 17, .extra = @intCast(run - 3) };
+                n += 1;
+                run = 0;
+            }
+        } else {
+            out[n] = .{ .symbol = len };
+            n += 1;
+            run -= 1;
+            while (run >= 3) {
+                const r = @min(run, 6);
+                out[n] = .{ .symbol = 16, .extra = @intCast(r - 3) };
+                n += 1;
+                run -= r;
+            }
+        }
+        for (0..run) |_| {
+            out[n] = .{ .symbol = len };
+            n += 1;
+        }
+    }
+    return out[0..n];
+}
+
+/// Computes Huffman code lengths of at most `limit` bits for `freqs`.
+///
+/// Uses the in-place algorithm of Moffat and Katajainen, followed by the
+/// length limiting of the JPEG specification (annex K.2).  At least two
+/// symbols get a code, so the code is always complete.
+fn buildLengths(freqs: []const u32, lengths: []u8, limit: u8) void {
+    const max_symbols = 288;
+    assert(freqs.len == lengths.len and freqs.len <= max_symbols);
+
+    var symbols: [max_symbols]u16 = undefined;
+    var n: usize = 0;
+    for (freqs, 0..) |f, s| {
+        if (f > 0) {
+            symbols[n] = @intCast(s);
+            n += 1;
+        }
+    }
+    var s: u16 = 0;
+    while (n < 2) : (s += 1) {
+        if (freqs[s] == 0) {
+            symbols[n] = s;
+            n += 1;
+        }
+    }
+    std.sort.pdq(u16, symbols[0..n], freqs, struct {
+        fn lessThan(f: []const u32, a: u16, b: u16) bool {
+            return f[a] < f[b] or (f[a] == f[b] and a < b);
+        }
+    }.lessThan);
+
+    var a: [max_symbols]u32 = undefined;
+    for (symbols[0..n], a[0..n]) |symbol, *weight| weight.* = freqs[symbol];
+
+    // Build the tree, internal nodes store their parent.
+    a[0] += a[1];
+    var root: usize = 0;
+    var leaf: usize = 2;
+    for (1..n - 1) |next| {
+        if (leaf >= n or a[root] < a[leaf]) {
+            a[next] = a[root];
+            a[root] = @intCast(next);
+            root += 1;
+        } else {
+            a[next] = a[leaf];
+            leaf += 1;
+        }
+        if (leaf >= n or (root < next and a[root] < a[leaf])) {
+            a[next] += a[root];
+            a[root] = @intCast(next);
+            root += 1;
+        } else {
+            a[next] += a[leaf];
+            leaf += 1;
+        }
+    }
+
+    // Depths of the internal nodes.
+    a[n - 2] = 0;
+    var node = n - 2;
+    while (node > 0) {
+        node -= 1;
+        a[node] = a[a[node]] + 1;
+    }
+
+    // Depths of the leaves.
+    var avail: usize = 1;
+    var used: usize = 0;
+    var depth: u32 = 0;
+    var internal: isize = @intCast(n - 2);
+    var leaf_pos: isize = @intCast(n - 1);
+    while (avail > 0) {
+        while (internal >= 0 and a[@intCast(internal)] == depth) {
+            used += 1;
+            internal -= 1;
+        }
+        while (avail > used) {
+            a[@intCast(leaf_pos)] = depth;
+            leaf_pos -= 1;
+            avail -= 1;
+        }
+        avail = 2 * used;
+        depth += 1;
+        used = 0;
+    }
+
+    var counts = [_]u32{0} ** (max_symbols + 1);
+    for (a[0..n]) |d| counts[d] += 1;
+    var len: usize = a[0];
+    while (len > limit) : (len -= 1) {
+        while (counts[len] > 0) {
+            var j = len - 2;
+            while (counts[j] == 0) j -= 1;
+            counts[len] -= 2;
+            counts[len - 1] += 1;
+            counts[j + 1] += 2;
+            counts[j] -= 1;
+        }
+    }
+
+    @memset(lengths, 0);
+    var i: usize = 0;
+    len = limit;
+    while (len > 0) : (len -= 1) {
+        for (0..counts[len]) |_| {
+            lengths[symbols[i]] = @intCast(len);
+            i += 1;
+        }
+    }
+}
+
+/// Assigns canonical codes to `lengths`, bit reversed for output.
+fn buildCodes(lengths: []const u8, codes: []u16) void {
+    var counts = [_]u16{0} ** 16;
+    for (lengths) |len| counts[len] += 1;
+    counts[0] = 0;
+
+    var next_code: [16]u16 = undefined;
+    var code: u16 = 0;
+    for (1..16) |bits| {
+        code = (code + counts[bits - 1]) << 1;
+        next_code[bits] = code;
+    }
+    for (lengths, codes) |len, *c| {
+        if (len == 0) continue;
+        c.* = @bitReverse(next_code[len]) >> @intCast(16 - @as(u8, len));
+        next_code[len] += 1;
+    }
+}
+
+/// Compresses `input` into a single gzip member appended to `out`.
+pub fn compressMember(gpa: mem.Allocator, input: []const u8, out: *std.ArrayList(u8)) !void {
+    try out.appendSlice(gpa, &header);
+
+    var deflate: Deflate = try .init(gpa, input, out);
+    defer deflate.deinit();
+    try deflate.run();
+
+    var trailer: [8]u8 = undefined;
+    mem.writeInt(u32, trailer[0..4], std.hash.Crc32.hash(input), .little);
+    mem.writeInt(u32, trailer[4..8], @truncate(input.len), .little);
+    try out.appendSlice(gpa, &trailer);
+}
+
+/// Writer compressing chunks of `chunk_len` bytes on worker threads.  The
+/// members are written to `out` in order.  `flush` has to be called after
+/// the last write.
+pub const ParallelWriter = struct {
+    gpa: mem.Allocator,
+    out: *std.Io.Writer,
+    slots: []Slot,
+    inputs: []u8,
+    /// Slot used as buffer of `writer`.
+    current: usize = 0,
+    /// Slot with the oldest running job.
+    oldest: usize = 0,
+    running: usize = 0,
+    writer: std.Io.Writer,
+
+    const Slot = struct {
+        input: []u8,
+        len: usize = 0,
+        output: std.ArrayList(u8) = .empty,
+        thread: ?std.Thread = null,
+        err: ?anyerror = null,
+
+        fn compress(slot: *Slot, gpa: mem.Allocator) void {
+            slot.output.clearRetainingCapacity();
+            compressMember(gpa, slot.input[0..slot.len], &slot.output) catch |err| {
+                slot.err = err;
+            };
+        }
+    };
+
+    /// Uses up to `jobs` threads for compression.
+    pub fn init(gpa: mem.Allocator, out: *std.Io.Writer, jobs: usize) !ParallelWriter {
+        // One slot more than jobs, to be filled while the others run.
+        const slots = try gpa.alloc(Slot, @max(jobs, 1) + 1);
+        errdefer gpa.free(slots);
+        const inputs = try gpa.alloc(u8, slots.len * chunk_len);
+        for (slots, 0..) |*slot, i| slot.* = .{ .input = inputs[i * chunk_len ..][0..chunk_len] };
+
+        return .{
+            .gpa = gpa,
+            .out = out,
+            .slots = slots,
+            .inputs = inputs,
+            .writer = .{
+                .buffer = slots[0].input,
+                .vtable = &.{ .drain = drain, .flush = flush },
+            },
+        };
+    }
+
+    pub fn deinit(pw: *ParallelWriter) void {
+        for (pw.slots) |*slot| {
+            if (slot.thread) |thread| thread.join();
+            slot.output.deinit(pw.gpa);
+        }
+        pw.gpa.free(pw.inputs);
+        pw.gpa.free(pw.slots);
+    }
+
+    /// Starts compression of the buffered chunk and switches to the next
+    /// slot, waiting for its job if all slots are in use.
+    fn submit(pw: *ParallelWriter) !void {
+        const slot = &pw.slots[pw.current];
+        slot.len = pw.writer.end;
+        if (slot.len > 0) {
+            slot.thread = try std.Thread.spawn(.{}, Slot.compress, .{ slot, pw.gpa });
+            pw.running += 1;
+            pw.current = (pw.current + 1) % pw.slots.len;
+            if (pw.slots[pw.current].thread != null) try pw.retire();
+        }
+        pw.writer.buffer = pw.slots[pw.current].input;
+        pw.writer.end = 0;
+    }
+
+    /// Waits for the oldest job and writes its output.
+    fn retire(pw: *ParallelWriter) !void {
+        const slot = &pw.slots[pw.oldest];
+        slot.thread.?.join();
+        slot.thread = null;
+        pw.running -= 1;
+        pw.oldest = (pw.oldest + 1) % pw.slots.len;
+        if (slot.err) |err| return err;
+        try pw.out.writeAll(slot.output.items);
+    }
+
+    fn drain(w: *std.Io.Writer, data: []const []const u8, splat: usize) std.Io.Writer.Error!usize {
+        const pw: *ParallelWriter = @alignCast(@fieldParentPtr("writer", w));
+        pw.submit() catch return error.WriteFailed;
+
+        // Fill the fresh buffer, the rest is drained by the next call.
+        var n: usize = 0;
+        for (data[0 .. data.len - 1]) |bytes| {
+            const len = fill(w, bytes);
+            n += len;
+            if (len < bytes.len) return n;
+        }
+        const pattern = data[data.len - 1];
+        for (0..splat) |_| {
+            const len = fill(w, pattern);
+            n += len;
+            if (len < pattern.len) return n;
+        }
+        return n;
+    }
+
+    fn fill(w: *std.Io.Writer, bytes: []const u8) usize {
+        const dest = w.unusedCapacitySlice();
+        const len = @min(dest.len, bytes.len);
+        @memcpy(dest[0..len], bytes[0..len]);
+        w.end += len;
+        return len;
+    }
+
+    fn flush(w: *std.Io.Writer) std.Io.Writer.Error!void {
+        const pw: *ParallelWriter = @alignCast(@fieldParentPtr("writer", w));
+        pw.submit() catch return error.WriteFailed;
+        while (pw.running > 0) pw.retire() catch return error.WriteFailed;
+        try pw.out.flush();
+    }
+};
+
+fn testRoundTrip(input: []const u8) !void {
+    const gpa = std.testing.allocator;
+    var compressed: std.ArrayList(u8) = .empty;
+    defer compressed.deinit(gpa);
+    try compressMember(gpa, input, &compressed);
+
+    var reader: std.Io.Reader = .fixed(compressed.items);
+    var window: [std.compress.flate.max_window_len]u8 = undefined;
+    var decompress: std.compress.flate.Decompress = .init(&reader, .gzip, &window);
+    const result = try decompress.reader.allocRemaining(gpa, .unlimited);
+    defer gpa.free(result);
+    try std.testing.expectEqualSlices(u8, input, result);
+}
+
+test compressMember {
+    try testRoundTrip("");
+    try testRoundTrip("a");
+    try testRoundTrip("abababababababababababababababab" ** 100);
+    try testRoundTrip(@embedFile("gzip.zig"));
+
+    var prng: std.Random.DefaultPrng = .init(0);
+    const random = try std.testing.allocator.alloc(u8, 3 * max_stored_len);
+    defer std.testing.allocator.free(random);
+    prng.random().bytes(random);
+    try testRoundTrip(random);
+    for (random) |*b| b.* = "ab"[b.* & 1];
+    try testRoundTrip(random);
+}
+
+test buildLengths {
+    var freqs: [286]u32 = undefined;
+    // Fibonacci frequencies give the deepest possible tree.
+    var x: u32 = 1;
+    var y: u32 = 1;
+    for (&freqs, 0..) |*f, i| {
+        if (i >= 30) {
+            f.* = 1;
+            continue;
+        }
+        f.* = x;
+        const z = x + y;
+        x = y;
+        y = z;
+    }
+    var lengths: [286]u8 = undefined;
+    buildLengths(&freqs, &lengths, 15);
+
+    var kraft: u64 = 0;
+    for (lengths) |len| {
+        try std.testing.expect(len >= 1 and len <= 15);
+        kraft += @as(u64, 1) << @intCast(15 - len);
+    }
+    try std.testing.expectEqual(@as(u64, 1 << 15), kraft);
+}
+
+test lengthCode {
+    for (len_base, 0..) |base, code| try std.testing.expectEqual(code, lengthCode(base));
+    for (dist_base, 0..) |base, code| try std.testing.expectEqual(code, distCode(base));
+    try std.testing.expectEqual(@as(u8, 27), lengthCode(257));
+    try std.testing.expectEqual(@as(u8, 29), distCode(32768));
+}
+
+test ParallelWriter {
+    const gpa = std.testing.allocator;
+    const input = try gpa.alloc(u8, 2 * chunk_len + 1000);
+    defer gpa.free(input);
+    for (input, 0..) |*b, i| b.* = @truncate((i *% 7) ^ (i >> 9));
+
+    var out: std.Io.Writer.Allocating = .init(gpa);
+    defer out.deinit();
+    var pw: ParallelWriter = try .init(gpa, &out.writer, 2);
+    defer pw.deinit();
+    try pw.writer.writeAll(input);
+    try pw.writer.flush();
+
+    // Each member is decompressed on its own.
+    var reader: std.Io.Reader = .fixed(out.written());
+    var result: std.Io.Writer.Allocating = .init(gpa);
+    defer result.deinit();
+    var window: [std.compress.flate.max_window_len]u8 = undefined;
+    var members: usize = 0;
+    while (reader.bufferedLen() > 0) : (members += 1) {
+        var decompress: std.compress.flate.Decompress = .init(&reader, .gzip, &window);
+        _ = try decompress.reader.streamRemaining(&result.writer);
+    }
+    try std.testing.expectEqual(@as(usize, 3), members);
+    try std.testing.expectEqualSlices(u8, input, result.written());
+}
@@ -4,7 +4,9 @@ const mem = std.mem;
 const Sha256 = std.crypto.hash.sha2.Sha256;
 const assert = std.debug.assert;
 const c = @import("c");
-const buf_size = 4 * 1024;
+const sha256 = @import("sha256.zig");
+
+const gpa = std.heap.c_allocator;
 
 fn checkSum(
     target_maybe: ?[*:0]const u8,
@@ -17,6 +19,133 @@ fn checkSum(
     };
 }
 
+const Hex = [2 * Sha256.digest_length]u8;
+
+fn matches(hash_hex: *const Hex, sum: []const u8) bool {
+    return sum.len >= hash_hex.len and mem.eql(u8, hash_hex, sum[0..hash_hex.len]);
+}
+
+/// Status of a file, any change of its content changes at least one of
+/// the fields.
+const Stamp = struct {
+    dev: u64,
+    ino: u64,
+    size: u64,
+    mtime_ns: i64,
+    ctime_ns: i64,
+
+    fn nanos(ts: c.struct_timespec) i64 {
+        return @as(i64, ts.tv_sec) * std.time.ns_per_s + ts.tv_nsec;
+    }
+
+    fn of(file: std.fs.File) !Stamp {
+        var st: c.struct_stat = undefined;
+        if (c.fstat(file.handle, &st) != 0) return error.StatFailed;
+        return .{
+            .dev = st.st_dev,
+            .ino = st.st_ino,
+            .size = @intCast(st.st_size),
+            .mtime_ns = nanos(st.st_mtim),
+            .ctime_ns = nanos(st.st_ctim),
+        };
+    }
+};
+
+/// Checksums verified by earlier runs, keyed by the status of the file at
+/// the time.  It is stored as text lines in the download cache and only
+/// ever appended to; an entry is trusted only if all of the status still
+/// matches.
+const verified_name = "var/cache/bootstrap/.verified";
+/// Timestamps are coarse, so files changed this recently may change again
+/// without a visible change of their status.
+const racy_ns = 2 * std.time.ns_per_s;
+
+var verified: std.AutoHashMapUnmanaged(Stamp, Hex) = .empty;
+var verified_loaded = false;
+
+fn verifiedPath(buf: []u8) ![]const u8 {
+    return std.fmt.bufPrint(buf, "{s}/" ++ verified_name, .{mem.span(c.target_root)});
+}
+
+fn parseVerified(line: []const u8) !struct { Stamp, Hex } {
+    var it = mem.tokenizeScalar(u8, line, ' ');
+    var stamp: Stamp = undefined;
+    inline for (@typeInfo(Stamp).@"struct".fields) |field| {
+        const value = it.next() orelse return error.InvalidEntry;
+        @field(stamp, field.name) = try std.fmt.parseInt(field.type, value, 10);
+    }
+    const sum = it.next() orelse return error.InvalidEntry;
+    if (sum.len != @sizeOf(Hex)) return error.InvalidEntry;
+    return .{ stamp, sum[0..@sizeOf(Hex)].* };
+}
+
+fn loadVerified() !void {
+    var path_buf: [std.fs.max_path_bytes]u8 = undefined;
+    var file = try std.fs.cwd().openFile(try verifiedPath(&path_buf), .{});
+    defer file.close();
+
+    var buf: [64 * 1024]u8 = undefined;
+    var reader = file.reader(&buf);
+    const data = try reader.interface.allocRemaining(gpa, .unlimited);
+    defer gpa.free(data);
+
+    var lines = mem.splitScalar(u8, data, '\n');
+    while (lines.next()) |line| {
+        const stamp, const hash_hex = parseVerified(line) catch continue;
+        try verified.put(gpa, stamp, hash_hex);
+    }
+}
+
+/// Loads the verified checksums once, before any lookup.  Lookups may run
+/// concurrently, as the table is only changed by recordVerified.
+fn loadVerifiedOnce() void {
+    if (verified_loaded) return;
+    verified_loaded = true;
+    loadVerified() catch |err| switch (err) {
+        error.FileNotFound => {},
+        else => log.warn("can't read verified checksums: {t}", .{err}),
+    };
+}
+
+fn appendVerified(stamp: Stamp, hash_hex: *const Hex) !void {
+    var path_buf: [std.fs.max_path_bytes]u8 = undefined;
+    var file = try std.fs.cwd().createFile(try verifiedPath(&path_buf), .{ .truncate = false });
+    defer file.close();
+    try file.seekFromEnd(0);
+
+    var line_buf: [256]u8 = undefined;
+    const line = try std.fmt.bufPrint(&line_buf, "{d} {d} {d} {d} {d} {s}\n", .{
+        stamp.dev,
+        stamp.ino,
+        stamp.size,
+        stamp.mtime_ns,
+        stamp.ctime_ns,
+        hash_hex,
+    });
+    try file.writeAll(line);
+}
+
+/// Not thread safe, see loadVerifiedOnce.
+fn recordVerified(stamp: Stamp, hash_hex: *const Hex) void {
+    if (std.time.nanoTimestamp() - stamp.ctime_ns < racy_ns) return;
+    verified.put(gpa, stamp, hash_hex.*) catch return;
+    appendVerified(stamp, hash_hex) catch |err| log.warn("can't record verified checksum: {t}", .{err});
+}
+
+const Checksum = struct {
+    stamp: Stamp,
+    hash_hex: Hex,
+    /// Taken from the verified checksums, instead of hashing the file.
+    cached: bool,
+
+    fn of(file: std.fs.File, hasher: *sha256.FileHasher) !Checksum {
+        const stamp = try Stamp.of(file);
+        if (verified.get(stamp)) |hash_hex| return .{ .stamp = stamp, .hash_hex = hash_hex, .cached = true };
+        const digest = try hasher.hash(file);
+        return .{ .stamp = stamp, .hash_hex = std.fmt.bytesToHex(digest, .lower), .cached = false };
+    }
+};
+
 fn checkSumAllowFail(
     target_maybe: ?[*:0]const u8,
     sum_maybe: ?[*:0]const u8,
@@ -28,21 +157,97 @@ fn checkSumAllowFail(
     const target = mem.span(target_maybe.?);
     c.log_message(c.LOG_MESSAGE_INFO_DOWNLOAD_VALIDATE, message);
 
+    loadVerifiedOnce();
     var file = try std.fs.cwd().openFile(target, .{});
     defer file.close();
 
-    var buf_reader: [buf_size]u8 = undefined;
-    var buf_hasher: [buf_size]u8 = undefined;
-
-    var reader = file.reader(&buf_reader);
-    var sha256_writer: std.Io.Writer.Hashing(Sha256) = .init(&buf_hasher);
-    _ = try reader.interface.streamRemaining(&sha256_writer.writer);
-    sha256_writer.writer.flush() catch unreachable;
-    const target_hash = sha256_writer.hasher.finalResult();
-    const hash_hex = std.fmt.bytesToHex(target_hash, .lower);
-    return mem.eql(u8, &hash_hex, sum[0..hash_hex.len]);
+    var hasher: sha256.FileHasher = try .init();
+    defer hasher.deinit();
+    const checksum = try Checksum.of(file, &hasher);
+    if (!matches(&checksum.hash_hex, sum)) return false;
+    if (!checksum.cached) recordVerified(checksum.stamp, &checksum.hash_hex);
+    return true;
 }
 
+/// Small files of a worker, hashed together once there is one per lane.
+const Batch = struct {
+    index: [sha256.lanes]usize = undefined,
+    stamp: [sha256.lanes]Stamp = undefined,
+    data: [sha256.lanes][]const u8 = undefined,
+    len: usize = 0,
+};
+
+/// Verifies cached packages on all CPUs.  Nothing is logged or recorded
+/// from the workers, missing files and errors just fail the check.
+const Verifier = struct {
+    targets: []const [*:0]const u8,
+    packages: []const *c.di_package,
+    /// Only ever set by the workers, it starts cleared.
+    valid: []bool,
+    /// Checksums to record, after the workers are done.
+    fresh: []?Checksum,
+    next: std.atomic.Value(usize) = .init(0),
+
+    fn verify(v: *Verifier, i: usize, hasher: *sha256.FileHasher, batch: *Batch) !void {
+        const sum_maybe = v.packages[i].sha256;
+        if (sum_maybe == null) return;
+        const sum = mem.span(sum_maybe);
+
+        var file = try std.fs.cwd().openFile(mem.span(v.targets[i]), .{});
+        defer file.close();
+
+        const stamp = try Stamp.of(file);
+        if (verified.get(stamp)) |hash_hex| {
+            v.valid[i] = matches(&hash_hex, sum);
+            return;
+        }
+
+        if (sha256.multi_buffer and stamp.size <= sha256.small_max) {
+            var buf: [4096]u8 = undefined;
+            var reader = file.reader(&buf);
+            batch.data[batch.len] = try reader.interface.allocRemaining(gpa, .limited(sha256.small_max + 1));
+            batch.index[batch.len] = i;
+            batch.stamp[batch.len] = stamp;
+            batch.len += 1;
+            return;
+        }
+
+        const hash_hex = std.fmt.bytesToHex(try hasher.hash(file), .lower);
+        if (!matches(&hash_hex, sum)) return;
+        v.fresh[i] = .{ .stamp = stamp, .hash_hex = hash_hex, .cached = false };
+        v.valid[i] = true;
+    }
+
+    fn flush(v: *Verifier, batch: *Batch) void {
+        if (batch.len == 0) return;
+        var digests: [sha256.lanes]sha256.Digest = undefined;
+        sha256.hashLanes(batch.data[0..batch.len], digests[0..batch.len]);
+
+        for (batch.index[0..batch.len], batch.stamp[0..batch.len], batch.data[0..batch.len], digests[0..batch.len]) |i, stamp, data, digest| {
+            gpa.free(data);
+            const hash_hex = std.fmt.bytesToHex(digest, .lower);
+            if (!matches(&hash_hex, mem.span(v.packages[i].sha256))) continue;
+            v.fresh[i] = .{ .stamp = stamp, .hash_hex = hash_hex, .cached = false };
+            v.valid[i] = true;
+        }
+        batch.len = 0;
+    }
+
+    fn run(v: *Verifier) void {
+        var hasher: sha256.FileHasher = sha256.FileHasher.init() catch return;
+        defer hasher.deinit();
+        var batch: Batch = .{};
+
+        while (true) {
+            const i = v.next.fetchAdd(1, .monotonic);
+            if (i >= v.valid.len) break;
+            v.verify(i, &hasher, &batch) catch {};
+            if (batch.len == sha256.lanes) v.flush(&batch);
+        }
+        v.flush(&batch);
+    }
+};
+
 export fn check_deb(
     target: ?[*:0]const u8,
     package: ?*c.di_package,
@@ -52,6 +257,48 @@ export fn check_deb(
     return @intFromBool(!checkSum(target, package.?.sha256, message));
 }
 
+/// Sets `valid[i]` if `targets[i]` exists and matches the checksum of
+/// `packages[i]`.
+export fn check_debs(
+    targets: [*]const [*:0]const u8,
+    packages: [*]const *c.di_package,
+    valid: [*]bool,
+    count: usize,
+) void {
+    loadVerifiedOnce();
+    @memset(valid[0..count], false);
+    const fresh = gpa.alloc(?Checksum, count) catch return;
+    defer gpa.free(fresh);
+    @memset(fresh, null);
+
+    var verifier: Verifier = .{
+        .targets = targets[0..count],
+        .packages = packages[0..count],
+        .valid = valid[0..count],
+        .fresh = fresh,
+    };
+
+    var threads: [64]std.Thread = undefined;
+    const jobs = @min(std.Thread.getCpuCount() catch 1, threads.len, count);
+    var spawned: usize = 0;
+    while (spawned + 1 < jobs) : (spawned += 1) {
+        threads[spawned] = std.Thread.spawn(.{}, Verifier.run, .{&verifier}) catch break;
+    }
+    verifier.run();
+    for (threads[0..spawned]) |thread| thread.join();
+
+    var valid_count: usize = 0;
+    var hashed_count: usize = 0;
+    for (verifier.valid, fresh) |v, f| {
+        valid_count += @intFromBool(v);
+        if (f) |checksum| {
+            recordVerified(checksum.stamp, &checksum.hash_hex);
+            hashed_count += 1;
+        }
+    }
+    c.log_text(c.DI_LOG_LEVEL_DEBUG, "Verified %zu of %zu cached packages, %zu hashed with %zu threads", valid_count, count, hashed_count, @max(jobs, 1));
+}
+
 export fn check_packages(
     target: ?[*:0]const u8,
     ext: ?[*:0]const u8,
@@ -89,3 +336,13 @@ export fn check_packages(
 
     return 1;
 }
+
+test parseVerified {
+    const stamp, const hash_hex = try parseVerified("2049 131 4096 1700000000000000001 -5 " ++ "ab" ** 32);
+    try std.testing.expectEqual(@as(u64, 131), stamp.ino);
+    try std.testing.expectEqual(@as(i64, 1700000000000000001), stamp.mtime_ns);
+    try std.testing.expectEqual(@as(i64, -5), stamp.ctime_ns);
+    try std.testing.expectEqualStrings("ab" ** 32, &hash_hex);
+    try std.testing.expectError(error.InvalidEntry, parseVerified("2049 131 4096 1 2"));
+    try std.testing.expectError(error.InvalidEntry, parseVerified("2049 131 4096 1 2 abcd"));
+}
@@ -23,7 +23,7 @@ const Context = struct {
         gpa.destroy(self);
     }
 
-    pub fn decompressGz(self: *Context, file_out: std.fs.File) !c_int {
+    pub fn decompressGz(self: *Context, file_out: std.fs.File) !isize {
         const data = try self.decompress.reader.allocRemaining(gpa, self.limit);
         defer gpa.free(data);
         try file_out.writeAll(data);
@@ -39,7 +39,7 @@ export fn decompress_gz_new(fd: c_int, len: usize) ?*c.struct_decompress_gz {
     return @ptrCast(ctx);
 }
 
-export fn decompress_gz(gz_ctx: ?*c.struct_decompress_gz, fd: c_int) c_int {
+export fn decompress_gz(gz_ctx: ?*c.struct_decompress_gz, fd: c_int) isize {
     var ctx: *Context = @ptrCast(@alignCast(gz_ctx));
     const amt = ctx.decompressGz(.{ .handle = fd }) catch return -1;
     return amt;
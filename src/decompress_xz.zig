@@ -24,7 +24,7 @@ const Context = struct {
         gpa.destroy(self);
     }
 
-    pub fn decompressXz(self: *Context, file_out: std.fs.File) !c_int {
+    pub fn decompressXz(self: *Context, file_out: std.fs.File) !isize {
         const data = try self.decompress.reader.allocRemaining(gpa, self.limit);
         defer gpa.free(data);
         try file_out.writeAll(data);
@@ -43,7 +43,7 @@ export fn decompress_xz_new(fd: c_int, len: usize) ?*c.struct_decompress_xz {
     return @ptrCast(ctx);
 }
 
-export fn decompress_xz(xz_ctx: ?*c.struct_decompress_xz, fd: c_int) c_int {
+export fn decompress_xz(xz_ctx: ?*c.struct_decompress_xz, fd: c_int) isize {
     var ctx: *Context = @ptrCast(@alignCast(xz_ctx));
     const amt = ctx.decompressXz(.{ .handle = fd }) catch return -1;
     return amt;
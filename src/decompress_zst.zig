@@ -0,0 +1,57 @@
+const std = @import("std");
+const c = @import("c");
+const zstd = std.compress.zstd;
+
+const gpa = std.heap.c_allocator;
+
+const Context = struct {
+    limit: std.Io.Limit,
+    read_buffer: [8 * 1024]u8 = undefined,
+    window: []u8,
+    reader: std.fs.File.Reader,
+    decompress: zstd.Decompress,
+
+    pub fn init(file: std.fs.File, limit: std.Io.Limit) !*Context {
+        const context = try gpa.create(Context);
+        errdefer gpa.destroy(context);
+        context.window = try gpa.alloc(u8, zstd.default_window_len + zstd.block_size_max);
+        context.reader = file.reader(&context.read_buffer);
+        context.decompress = .init(&context.reader.interface, context.window, .{});
+        context.limit = limit;
+        return context;
+    }
+
+    pub fn deinit(self: *Context) void {
+        gpa.free(self.window);
+        gpa.destroy(self);
+    }
+
+    pub fn decompressZst(self: *Context, file_out: std.fs.File) !isize {
+        const data = try self.decompress.reader.allocRemaining(gpa, self.limit);
+        defer gpa.free(data);
+        try file_out.writeAll(data);
+        return @intCast(data.len);
+    }
+};
+
+export fn decompress_zst_new(fd: c_int, len: usize) ?*c.struct_decompress_zst {
+    const ctx = Context.init(
+        .{ .handle = fd },
+        if (len > 0) .limited(len) else .unlimited,
+    ) catch |err| {
+        std.log.err("failed to init zst ctx: {t}", .{err});
+        return null;
+    };
+    return @ptrCast(ctx);
+}
+
+export fn decompress_zst(zst_ctx: ?*c.struct_decompress_zst, fd: c_int) isize {
+    var ctx: *Context = @ptrCast(@alignCast(zst_ctx));
+    const amt = ctx.decompressZst(.{ .handle = fd }) catch return -1;
+    return amt;
+}
+
+export fn decompress_zst_free(zst_ctx: ?*c.struct_decompress_zst) void {
+    var ctx: *Context = @ptrCast(@alignCast(zst_ctx));
+    ctx.deinit();
+}
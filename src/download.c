@@ -20,10 +20,12 @@
 
 #include <config.h>
 
+#include <errno.h>
 #include <fcntl.h>
 #include <limits.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <time.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -36,12 +38,16 @@
 #include "frontend.h"
 #include "gpg.h"
 #include "package.h"
+#include "pdiff.h"
 #include "suite_packages.h"
 #include "target.h"
 
 static const char *download_suite;
 static const char *download_arch;
 static bool download_authentication = true;
+static const char *download_index_cache;
+/* bytes per second, measured while retrieving Release */
+static double download_throughput = 1e6;
 
 static inline void build_indices (const char *file, char *source, size_t source_size, char *target, size_t target_size)
 {
@@ -55,20 +61,47 @@ static inline void build_indices_arch (const char *file, char *source, size_t so
   snprintf (target, target_size, "%s/var/cache/bootstrap/_dists_._main_binary-%s_%s", target_root, arch, file);
 }
 
+/* Immutable name of an index, if the Release file advertises them. */
+static bool build_indices_arch_by_hash (const char *file, di_release *rel, char *source, size_t source_size)
+{
+  di_release_file *item;
+  di_rstring key;
+  char name[256];
+
+  if (!rel->acquire_by_hash)
+    return false;
+
+  snprintf (name, sizeof name, "main/binary-%s/%s", download_arch, file);
+  key.string = name;
+  key.size = strlen (name);
+
+  item = di_hash_table_lookup (rel->sha256, &key);
+  if (!item || !item->sum[1])
+    return false;
+
+  snprintf (source, source_size, "dists/%s/main/binary-%s/by-hash/SHA256/%s", download_suite, download_arch, item->sum[1]);
+  return true;
+}
+
 static bool decompress_file_gz(const char *file_in, const char *file_out)
 {
   int fd_in, fd_out;
   bool ret = false;
 
   fd_in = open (file_in, O_RDONLY);
-  fd_out = open (file_out, O_WRONLY | O_CREAT, 0644);
+  fd_out = open (file_out, O_WRONLY | O_CREAT | O_TRUNC, 0644);
 
   if (fd_in >= 0 && fd_out >= 0)
   {
     struct decompress_gz *c = decompress_gz_new (fd_in, 0);
-    while (decompress_gz (c, fd_out) > 0);
-    decompress_gz_free (c);
-    ret = true;
+    ssize_t r = -1;
+
+    if (c)
+    {
+      while ((r = decompress_gz (c, fd_out)) > 0);
+      decompress_gz_free (c);
+    }
+    ret = r == 0;
   }
 
   close (fd_in);
@@ -83,14 +116,46 @@ static bool decompress_file_xz(const char *file_in, const char *file_out)
   bool ret = false;
 
   fd_in = open (file_in, O_RDONLY);
-  fd_out = open (file_out, O_WRONLY | O_CREAT, 0644);
+  fd_out = open (file_out, O_WRONLY | O_CREAT | O_TRUNC, 0644);
 
   if (fd_in >= 0 && fd_out >= 0)
   {
     struct decompress_xz *c = decompress_xz_new (fd_in, 0);
-    while (decompress_xz (c, fd_out) > 0);
-    decompress_xz_free (c);
-    ret = true;
+    ssize_t r = -1;
+
+    if (c)
+    {
+      while ((r = decompress_xz (c, fd_out)) > 0);
+      decompress_xz_free (c);
+    }
+    ret = r == 0;
+  }
+
+  close (fd_in);
+  close (fd_out);
+
+  return ret;
+}
+
+static bool decompress_file_zst(const char *file_in, const char *file_out)
+{
+  int fd_in, fd_out;
+  bool ret = false;
+
+  fd_in = open (file_in, O_RDONLY);
+  fd_out = open (file_out, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+  if (fd_in >= 0 && fd_out >= 0)
+  {
+    struct decompress_zst *c = decompress_zst_new (fd_in, 0);
+    ssize_t r = -1;
+
+    if (c)
+    {
+      while ((r = decompress_zst (c, fd_out)) > 0);
+      decompress_zst_free (c);
+    }
+    ret = r == 0;
   }
 
   close (fd_in);
@@ -114,11 +179,29 @@ int download_file_target(const char *source, const char *_target, const char *me
   return frontend_download (source, target);
 }
 
+/* Estimates the link throughput from a retrieved file. */
+static void download_measure (const char *target, const struct timespec *start)
+{
+  struct stat statbuf;
+  struct timespec end;
+  double elapsed;
+
+  clock_gettime (CLOCK_MONOTONIC, &end);
+  elapsed = (end.tv_sec - start->tv_sec) + (end.tv_nsec - start->tv_nsec) / 1e9;
+  if (stat (target, &statbuf) || elapsed <= 0 || !statbuf.st_size)
+    return;
+
+  download_throughput = statbuf.st_size / elapsed;
+  log_text (DI_LOG_LEVEL_DEBUG, "Measured throughput: %.0f bytes/s", download_throughput);
+}
+
 static di_release *download_release (void)
 {
   char source[256];
   char target[4096], sig_target[4096];
+  char filter_arch[64];
   const char *message = "InRelease";
+  struct timespec start;
   di_release *ret;
 
 #if 0
@@ -137,8 +220,10 @@ static di_release *download_release (void)
     message = "Release";
 
     build_indices ("Release", source, sizeof (source), target, sizeof (target));
+    clock_gettime (CLOCK_MONOTONIC, &start);
     if (download_file (source, target, "Release"))
       log_message (LOG_MESSAGE_ERROR_DOWNLOAD_RETRIEVE, "Release");
+    download_measure (target, &start);
 
     build_indices ("Release.gpg", source, sizeof (source), sig_target, sizeof (sig_target));
 
@@ -155,7 +240,11 @@ static di_release *download_release (void)
 
   log_message (LOG_MESSAGE_INFO_DOWNLOAD_PARSE, message);
 
-  if (!(ret = di_release_read_file (target)))
+  /* Only the indices of the architecture are ever looked up. */
+  snprintf (filter_arch, sizeof filter_arch, "main/binary-%s/", download_arch);
+  const char *const filter[] = { filter_arch, NULL };
+
+  if (!(ret = di_release_read_file_filtered (target, filter)))
     log_message (LOG_MESSAGE_ERROR_DOWNLOAD_PARSE, message);
 
   if (suite_select (ret))
@@ -164,11 +253,53 @@ static di_release *download_release (void)
   return ret;
 }
 
-static di_packages *download_packages_parse (const char *target, di_packages_allocator *allocator)
+static bool build_index_cache (char *buf, size_t size, di_release *rel)
+{
+  di_release_file *item;
+  di_rstring key;
+  char file[256];
+
+  if (!download_index_cache)
+    return false;
+
+  snprintf (file, sizeof file, "main/binary-%s/Packages", arch);
+  key.string = file;
+  key.size = strlen (file);
+
+  /* the cache is keyed by the checksum of the uncompressed index */
+  item = di_hash_table_lookup (rel->sha256, &key);
+  if (!item || !item->sum[1])
+    return false;
+
+  snprintf (buf, size, "%s/%s.idx", download_index_cache, item->sum[1]);
+  return true;
+}
+
+static di_packages *download_packages_parse (const char *target, const char *cache, di_packages_allocator *allocator)
 {
+  di_packages *ret;
+
   log_message (LOG_MESSAGE_INFO_DOWNLOAD_PARSE, "Packages");
 
-  return di_packages_read_file(target, allocator);
+  ret = di_packages_read_file_lazy(target, allocator, 0);
+
+  if (ret && cache && di_packages_cache_write (ret, cache))
+    log_text (DI_LOG_LEVEL_WARNING, "Failed to write cached index %s", cache);
+
+  return ret;
+}
+
+/* Patches an outdated uncompressed index with Packages.diff. */
+static bool download_packages_pdiff(const char *target_plain, di_release *rel)
+{
+  char source[256], target[4096];
+  char unused_source[256], unused_target[4096];
+
+  /* the patches are stored next to the index as Packages.diff_<name> */
+  build_indices_arch("Packages.diff/", source, sizeof source, unused_target, sizeof unused_target);
+  build_indices_arch("Packages.diff_", unused_source, sizeof unused_source, target, sizeof target);
+
+  return !pdiff_update(target_plain, source, target, rel);
 }
 
 static bool download_packages_check(const char *ext, const char *target, di_release *rel)
@@ -180,6 +311,9 @@ static bool download_packages_check(const char *ext, const char *target, di_rele
     if (!check_packages(target, ext, rel))
       return true;
 
+    if (!*ext && download_packages_pdiff(target, rel))
+      return true;
+
     /* if it is invalid, unlink them */
     unlink (target);
   }
@@ -190,8 +324,17 @@ static bool download_packages_check(const char *ext, const char *target, di_rele
 static bool download_packages_retrieve(const char *ext, const char *source, const char *target, di_release *rel)
 {
   char file[256];
+  char source_by_hash[256];
   snprintf(file, sizeof file, "Packages%s", ext);
 
+  if (build_indices_arch_by_hash(file, rel, source_by_hash, sizeof source_by_hash))
+  {
+    if (!download_file(source_by_hash, target, file))
+      return download_packages_check(ext, target, rel);
+    /* mirrors may lag behind, fall back to the name */
+    log_text(DI_LOG_LEVEL_DEBUG, "Download failed: %s", source_by_hash);
+  }
+
   if (download_file(source, target, file))
   {
     log_text(DI_LOG_LEVEL_DEBUG, "Download failed: %s", source);
@@ -200,48 +343,130 @@ static bool download_packages_retrieve(const char *ext, const char *source, cons
   return download_packages_check(ext, target, rel);
 }
 
-static bool download_packages_retrieve_gz(const char *target_plain, di_release *rel)
+/* Decoding speed of the index formats, in bytes of output per second. */
+static const struct download_packages_format
 {
-  char source[256];
-  char target[4096];
+  const char *ext;
+  double decode_speed;
+  bool (*decompress) (const char *file_in, const char *file_out);
+} download_packages_formats[] =
+{
+  { "", 0, NULL },
+  { ".zst", 400e6, decompress_file_zst },
+  { ".gz", 250e6, decompress_file_gz },
+  { ".xz", 60e6, decompress_file_xz },
+};
 
-  build_indices_arch("Packages.gz", source, sizeof source, target, sizeof target);
+#define DOWNLOAD_PACKAGES_FORMATS (sizeof download_packages_formats / sizeof *download_packages_formats)
 
-  if (!download_packages_retrieve(".gz", source, target, rel))
-    return false;
+static di_release_file *download_packages_lookup (di_release *rel, const char *ext)
+{
+  char file[256];
+  di_rstring key;
 
-  if (!decompress_file_gz(target, target_plain))
-    return false;
-  return true;
+  snprintf (file, sizeof file, "main/binary-%s/Packages%s", download_arch, ext);
+  key.string = file;
+  key.size = strlen (file);
+  return di_hash_table_lookup (rel->sha256, &key);
 }
 
-static bool download_packages_retrieve_xz(const char *target_plain, di_release *rel)
+static bool download_packages_retrieve_format(const struct download_packages_format *format, const char *target_plain, di_release *rel)
 {
+  char file[64];
   char source[256];
   char target[4096];
 
-  build_indices_arch("Packages.xz", source, sizeof source, target, sizeof target);
+  snprintf(file, sizeof file, "Packages%s", format->ext);
+  build_indices_arch(file, source, sizeof source, target, sizeof target);
 
-  if (!download_packages_retrieve(".xz", source, target, rel))
+  if (!download_packages_retrieve(format->ext, source, target, rel))
     return false;
 
-  if (!decompress_file_xz(target, target_plain))
-    return false;
-  return true;
+  if (!format->decompress)
+    return true;
+
+  /* a corrupt or unsupported file falls back to the next format */
+  if (format->decompress(target, target_plain) &&
+      (!download_packages_lookup(rel, "") || !check_packages(target_plain, "", rel)))
+    return true;
+
+  log_text(DI_LOG_LEVEL_DEBUG, "Failed to decompress %s", file);
+  unlink(target_plain);
+  return false;
+}
+
+/*
+ * Sorts the formats listed in Release by the estimated time to retrieve
+ * and decode them, returns the number of them.  Mirrors rarely serve the
+ * uncompressed index, even if Release lists it, so it is always tried
+ * last instead of costing a failed request on fast links.
+ */
+static size_t download_packages_order (di_release *rel, const struct download_packages_format **order)
+{
+  double cost[DOWNLOAD_PACKAGES_FORMATS];
+  di_release_file *plain = download_packages_lookup (rel, "");
+  double size_plain = plain ? plain->size : 0;
+  size_t n = 0;
+
+  for (size_t i = 0; i < DOWNLOAD_PACKAGES_FORMATS; i++)
+  {
+    const struct download_packages_format *format = &download_packages_formats[i];
+    di_release_file *item = download_packages_lookup (rel, format->ext);
+    double c;
+    size_t j;
+
+    if (!item || !item->sum[1] || !format->decompress)
+      continue;
+
+    c = item->size / download_throughput + size_plain / format->decode_speed;
+    log_text (DI_LOG_LEVEL_DEBUG, "Estimated time for Packages%s: %.3f s", format->ext, c);
+
+    for (j = n; j > 0 && cost[j - 1] > c; j--)
+    {
+      cost[j] = cost[j - 1];
+      order[j] = order[j - 1];
+    }
+    cost[j] = c;
+    order[j] = format;
+    n++;
+  }
+
+  if (plain && plain->sum[1])
+    order[n++] = &download_packages_formats[0];
+
+  return n;
 }
 
 static di_packages *download_packages (di_release *rel, di_packages_allocator *allocator)
 {
   char target_plain[4096];
+  char cache[4096];
+  const struct download_packages_format *order[DOWNLOAD_PACKAGES_FORMATS];
+  bool cached = build_index_cache (cache, sizeof cache, rel);
+  di_packages *ret;
+  size_t n, i;
+
+  /* a cached index needs no Packages file at all */
+  if (cached && (ret = di_packages_cache_read (cache, allocator)))
+  {
+    log_text (DI_LOG_LEVEL_DEBUG, "Using cached index %s", cache);
+    return ret;
+  }
 
   build_indices_arch("Packages", 0, 0, target_plain, sizeof target_plain);
-  if (!download_packages_check("", target_plain, rel) &&
-      !download_packages_retrieve_xz(target_plain, rel) &&
-      !download_packages_retrieve_gz(target_plain, rel))
-    log_message (LOG_MESSAGE_ERROR_DOWNLOAD_RETRIEVE, "Packages");
+  if (!download_packages_check("", target_plain, rel))
+  {
+    /* unavailable formats fall back to the next cheapest one */
+    n = download_packages_order (rel, order);
+    for (i = 0; i < n; i++)
+      if (download_packages_retrieve_format (order[i], target_plain, rel))
+        break;
+    if (i == n)
+      log_message (LOG_MESSAGE_ERROR_DOWNLOAD_RETRIEVE, "Packages");
+  }
 
   /* ... and parse them */
-  return download_packages_parse (target_plain, allocator);
+  return download_packages_parse (target_plain, cached ? cache : NULL, allocator);
 }
 
 static di_packages *download_indices (di_packages_allocator *allocator)
@@ -263,11 +488,13 @@ static di_packages *download_indices (di_packages_allocator *allocator)
 
 static int download_debs (di_slist *install)
 {
-  int count = 0, ret, size = 0, size_done = 0, progress;
-  struct stat statbuf;
+  int count = 0, size = 0, size_done = 0, progress, i;
   di_slist_node *node;
   di_package *p;
   char target[4096];
+  char **targets;
+  di_package **packages;
+  bool *valid;
 
   for (node = install->head; node; node = node->next)
   {
@@ -276,36 +503,55 @@ static int download_debs (di_slist *install)
     size += p->size;
   }
 
-  for (node = install->head; node; node = node->next)
+  targets = di_new (char *, count);
+  packages = di_new (di_package *, count);
+  valid = di_new (bool, count);
+
+  for (node = install->head, i = 0; node; node = node->next, i++)
   {
     p = node->data;
-    size_done += p->size;
-    progress = ((float) size_done/size) * 350 + 50;
-
     build_target_deb (target, sizeof (target), package_get_local_filename (p));
+    targets[i] = strdup (target);
+    packages[i] = p;
+  }
 
-    if (!stat (target, &statbuf))
-    {
-      ret = check_deb (target, p, p->package);
-      if (!ret)
-      {
-        frontend_progress_set (progress);
-        continue;
-      }
-    }
+  /* cached packages are verified up front, in parallel */
+  check_debs ((const char *const *) targets, packages, valid, count);
+
+  for (i = 0; i < count; i++)
+  {
+    p = packages[i];
+    size_done += p->size;
+    progress = ((float) size_done/size) * 350 + 50;
 
-    if (download_file (p->filename, target, p->package) || check_deb (target, p, p->package))
+    if (!valid[i] &&
+        (download_file (p->filename, targets[i], p->package) || check_deb (targets[i], p, p->package)))
       log_message (LOG_MESSAGE_ERROR_DOWNLOAD_RETRIEVE, p->filename);
 
     frontend_progress_set (progress);
+    free (targets[i]);
   }
 
+  di_free (targets);
+  di_free (packages);
+  di_free (valid);
+
   return 0;
 }
 
+static void download_log_allocator (di_packages_allocator *allocator)
+{
+  di_packages_allocator_stats stats;
+
+  di_packages_allocator_get_stats (allocator, &stats);
+  log_text (DI_LOG_LEVEL_DEBUG, "Package index: %zu bytes, packages %zu, dependencies %zu, list nodes %zu, strings %zu",
+            stats.total, stats.packages, stats.dependencies, stats.nodes, stats.strings);
+}
+
 int download(struct suite_packages *install)
 {
-  install->allocator = di_packages_allocator_alloc();
+  /* the index is freed all at once, so it can live in a single arena */
+  install->allocator = di_packages_allocator_alloc_arena();
   if (!install->allocator)
     return 1;
 
@@ -313,6 +559,8 @@ int download(struct suite_packages *install)
   if (!install->packages)
     return 1;
 
+  download_log_allocator (install->allocator);
+
   suite_packages_list(install);
 
   return download_debs(install->essential_include);
@@ -328,3 +576,16 @@ int download_init (const char *suite, const char *arch, bool authentication)
   return 0;
 }
 
+int download_index_cache_init (const char *dir)
+{
+  struct stat statbuf;
+
+  if (mkdir (dir, 0755) && errno != EEXIST)
+    return -1;
+  if (stat (dir, &statbuf) || !S_ISDIR (statbuf.st_mode))
+    return -1;
+
+  download_index_cache = dir;
+  return 0;
+}
+
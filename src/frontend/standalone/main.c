@@ -29,7 +29,13 @@
 #include "install.h"
 #include "message.h"
 #include "log.h"
+#include "output_oci.h"
+#include "output_tar.h"
+#include "package_store.h"
+#include "stage_cache.h"
+#include "path_filter.h"
 #include "suite.h"
+#include "suite_packages.h"
 #include "target.h"
 
 #ifdef HAVE_LIBCURL
@@ -79,6 +85,14 @@ enum
   GETOPT_EXCLUDE,
   GETOPT_FOREIGN,
   GETOPT_INCLUDE,
+  GETOPT_INDEX_CACHE,
+  GETOPT_OUTPUT_OCI,
+  GETOPT_OUTPUT_TAR,
+  GETOPT_PACKAGE_STORE,
+  GETOPT_PATH_EXCLUDE,
+  GETOPT_PATH_INCLUDE,
+  GETOPT_SMALLEST_CLOSURE,
+  GETOPT_STAGE_CACHE,
   GETOPT_SUITE_CONFIG,
   GETOPT_VARIANT,
   GETOPT_VERSION,
@@ -96,7 +110,15 @@ static struct option const long_opts[] =
   {"flavour", required_argument, 0, 'f'},
   {"helperdir", required_argument, 0, 'H'},
   {"include", required_argument, 0, GETOPT_INCLUDE},
+  {"index-cache", required_argument, 0, GETOPT_INDEX_CACHE},
   {"keyring", required_argument, 0, 'k'},
+  {"output-oci", required_argument, 0, GETOPT_OUTPUT_OCI},
+  {"output-tar", required_argument, 0, GETOPT_OUTPUT_TAR},
+  {"package-store", required_argument, 0, GETOPT_PACKAGE_STORE},
+  {"path-exclude", required_argument, 0, GETOPT_PATH_EXCLUDE},
+  {"path-include", required_argument, 0, GETOPT_PATH_INCLUDE},
+  {"smallest-closure", no_argument, 0, GETOPT_SMALLEST_CLOSURE},
+  {"stage-cache", required_argument, 0, GETOPT_STAGE_CACHE},
   {"quiet", no_argument, 0, 'q'},
   {"suite-config", required_argument, 0, GETOPT_SUITE_CONFIG},
   {"variant", required_argument, 0, GETOPT_VARIANT},
@@ -426,6 +448,16 @@ Mandatory arguments to long options are mandatory for short options too.\n\
   -k, --keyring=KEYRING        Use given keyring.\n\
   -H, --helperdir=DIR          Set the helper directory.\n\
       --include=A,B,C          Install extra packages.\n\
+      --index-cache=DIR        Cache the parsed package index.\n\
+      --output-oci=DIR         Write the essential packages as OCI image layout,\n\
+                               instead of installing them.\n\
+      --output-tar=FILE        Write the essential packages into a tar archive,\n\
+                               instead of installing them.\n\
+      --package-store=DIR      Extract packages via a store of extracted packages.\n\
+      --path-exclude=GLOB      Don't install files matching GLOB.\n\
+      --path-include=GLOB      Install files matching GLOB, even if excluded.\n\
+      --smallest-closure       Choose the alternatives with the smallest closure.\n\
+      --stage-cache=DIR        Save and restore the target after the essential stages.\n\
   -q, --quiet                  Be quiet.\n\
       --suite-config\n\
   -v, --verbose                Be verbose,\n\
@@ -457,7 +489,12 @@ int frontend_main (int argc, char **argv, char **envp __attribute((unused)))
     *flavour = default_flavour,
     *keyring = NULL,
     *helperdir = configdir,
+    *index_cache = NULL,
     *origin = "Undefined",
+    *output_oci = NULL,
+    *output_tar = NULL,
+    *package_store = NULL,
+    *stage_cache = NULL,
     *suite_config = NULL,
     *target = NULL;
   bool authentication = true, download_only = false, foreign = false;
@@ -531,6 +568,32 @@ int frontend_main (int argc, char **argv, char **envp __attribute((unused)))
             di_slist_append (&include, i);
         }
         break;
+      case GETOPT_INDEX_CACHE:
+        index_cache = optarg;
+        break;
+      case GETOPT_OUTPUT_OCI:
+        output_oci = optarg;
+        break;
+      case GETOPT_OUTPUT_TAR:
+        output_tar = optarg;
+        break;
+      case GETOPT_PACKAGE_STORE:
+        package_store = optarg;
+        break;
+      case GETOPT_PATH_EXCLUDE:
+        if (path_filter_add (PATH_FILTER_EXCLUDE, optarg))
+          log_text (DI_LOG_LEVEL_ERROR, "Invalid path filter: %s", optarg);
+        break;
+      case GETOPT_PATH_INCLUDE:
+        if (path_filter_add (PATH_FILTER_INCLUDE, optarg))
+          log_text (DI_LOG_LEVEL_ERROR, "Invalid path filter: %s", optarg);
+        break;
+      case GETOPT_SMALLEST_CLOSURE:
+        suite_packages_choose_smallest ();
+        break;
+      case GETOPT_STAGE_CACHE:
+        stage_cache = optarg;
+        break;
       case GETOPT_SUITE_CONFIG:
         suite_config = optarg;
         break;
@@ -594,8 +657,25 @@ warranty; not even for MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.\n\
 
   log_init ();
 
-  check_permission(download_only);
-  check_target(target, download_only);
+  check_permission(download_only || output_oci || output_tar);
+  check_target(target, download_only || output_oci || output_tar);
+
+  if (output_oci && output_tar)
+    log_text (DI_LOG_LEVEL_ERROR, "--output-oci and --output-tar are mutually exclusive");
+
+  if (output_oci && output_oci_open (output_oci))
+    log_text (DI_LOG_LEVEL_ERROR, "Failed to open output image");
+  if (output_tar && output_tar_open (output_tar))
+    log_text (DI_LOG_LEVEL_ERROR, "Failed to open output archive");
+
+  if (package_store && package_store_init (package_store))
+    log_text (DI_LOG_LEVEL_ERROR, "Failed to open package store");
+
+  if (stage_cache && stage_cache_init (stage_cache))
+    log_text (DI_LOG_LEVEL_ERROR, "Failed to open stage cache");
+
+  if (index_cache && download_index_cache_init (index_cache))
+    log_text (DI_LOG_LEVEL_ERROR, "Failed to open index cache");
 
   if (suite_init (origin, codename, suite_config, arch, flavour, &include, &exclude, configdir))
     log_text (DI_LOG_LEVEL_ERROR, "Internal error: suite init");
@@ -610,6 +690,20 @@ warranty; not even for MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.\n\
   if (download (&packages))
     log_text (DI_LOG_LEVEL_ERROR, "Internal error: download");
 
+  if (output_oci)
+  {
+    if (output_oci_write (packages.essential_include))
+      log_text (DI_LOG_LEVEL_ERROR, "Internal error: output oci");
+    return 0;
+  }
+
+  if (output_tar)
+  {
+    if (output_tar_write (packages.essential_include))
+      log_text (DI_LOG_LEVEL_ERROR, "Internal error: output tar");
+    return 0;
+  }
+
   if (download_only)
   {
     log_text (DI_LOG_LEVEL_INFO, "Download-only mode, not installing anything");
@@ -72,7 +72,7 @@ static void install_execute_progress_io_handler (FILE *f, void *user_data)
           continue;
 
         log_text (DI_LOG_LEVEL_DEBUG, "Updating %s to status %d", package->key.string, status);
-        package->status = status;
+        di_packages_set_status (packages, package, status);
       }
     }
   }
@@ -114,8 +114,112 @@ static int install_execute_target_progress (const char *const command[], di_pack
   return execute_target_full (command, io_info, NELEMS (io_info));
 }
 
+/* Closures of earlier calls, they only change with the status of packages.
+ * Lists of roots are compared by content, they are copied into the cache. */
+#define INSTALL_LIST_CACHE_SIZE 8
+
+static struct install_list_cache
+{
+  di_slist *list;
+  di_packages *packages;
+  di_slist *install;
+  char *package;
+  di_package_priority min_priority;
+  di_package_status max_status;
+  unsigned int status_changes;
+} install_list_cache[INSTALL_LIST_CACHE_SIZE];
+static unsigned int install_list_cache_next;
+
+static di_slist *install_list_copy(di_slist *list)
+{
+  di_slist *ret = di_slist_alloc();
+
+  for (di_slist_node *node = list->head; node; node = node->next)
+    di_slist_append(ret, node->data);
+
+  return ret;
+}
+
+static bool install_list_equal(di_slist *a, di_slist *b)
+{
+  di_slist_node *node_a, *node_b;
+
+  if (!a || !b)
+    return a == b;
+
+  for (node_a = a->head, node_b = b->head; node_a && node_b; node_a = node_a->next, node_b = node_b->next)
+    if (node_a->data != node_b->data)
+      return false;
+
+  return !node_a && !node_b;
+}
+
+static void install_list_cache_clear(struct install_list_cache *e)
+{
+  if (e->list)
+  {
+    di_slist_destroy(e->list, NULL);
+    di_slist_free(e->list);
+  }
+  if (e->install)
+  {
+    di_slist_destroy(e->install, NULL);
+    di_slist_free(e->install);
+  }
+  di_free(e->package);
+  *e = (struct install_list_cache) { 0 };
+}
+
+void install_list_cache_free(void)
+{
+  for (unsigned int i = 0; i < INSTALL_LIST_CACHE_SIZE; i++)
+    install_list_cache_clear(&install_list_cache[i]);
+}
+
+static struct install_list_cache *install_list_cache_lookup(di_packages *packages, di_slist *install, const char *package, di_package_priority min_priority, di_package_status max_status)
+{
+  for (unsigned int i = 0; i < INSTALL_LIST_CACHE_SIZE; i++)
+  {
+    struct install_list_cache *e = &install_list_cache[i];
+
+    if (e->list && e->packages == packages && e->status_changes == packages->status_changes &&
+        install_list_equal(e->install, install) && e->min_priority == min_priority && e->max_status == max_status &&
+        (e->package == package || (e->package && package && !strcmp(e->package, package))))
+      return e;
+  }
+
+  return NULL;
+}
+
+static di_slist *install_list_cache_insert(di_packages *packages, di_slist *install, const char *package, di_package_priority min_priority, di_package_status max_status, di_slist *list)
+{
+  struct install_list_cache *e = &install_list_cache[install_list_cache_next++ % INSTALL_LIST_CACHE_SIZE];
+
+  install_list_cache_clear(e);
+
+  *e = (struct install_list_cache)
+  {
+    .list = install_list_copy(list),
+    .packages = packages,
+    .install = install ? install_list_copy(install) : NULL,
+    .package = package ? di_stradup(package, strlen(package)) : NULL,
+    .min_priority = min_priority,
+    .max_status = max_status,
+    .status_changes = packages->status_changes,
+  };
+
+  return list;
+}
+
 di_slist *install_list_priority(di_packages *packages, di_packages_allocator *allocator, di_slist *install, di_package_priority min_priority, di_package_status max_status)
 {
+  struct install_list_cache *cached = install_list_cache_lookup(packages, install, NULL, min_priority, max_status);
+  if (cached)
+  {
+    log_text(DI_LOG_LEVEL_DEBUG, "Using cached package list");
+    return install_list_copy(cached->list);
+  }
+
   di_slist *list1 = di_slist_alloc();
 
   for (di_slist_node *node = install->head; node; node = node->next)
@@ -140,7 +244,7 @@ di_slist *install_list_priority(di_packages *packages, di_packages_allocator *al
 
   di_slist_free(list2);
 
-  return list1;
+  return install_list_cache_insert(packages, install, NULL, min_priority, max_status, list1);
 }
 
 di_slist *install_list_package (di_packages *packages, di_packages_allocator *allocator, char *package, di_package_status status)
@@ -148,6 +252,14 @@ di_slist *install_list_package (di_packages *packages, di_packages_allocator *al
   di_slist *list1, *list2;
   di_slist_node *node;
   di_package *p;
+  struct install_list_cache *cached;
+
+  cached = install_list_cache_lookup (packages, NULL, package, 0, status);
+  if (cached)
+  {
+    log_text (DI_LOG_LEVEL_DEBUG, "Using cached package list");
+    return install_list_copy (cached->list);
+  }
 
   list1 = di_slist_alloc ();
 
@@ -172,7 +284,7 @@ di_slist *install_list_package (di_packages *packages, di_packages_allocator *al
 
   di_slist_free (list2);
 
-  return list1;
+  return install_list_cache_insert (packages, NULL, package, 0, status, list1);
 }
 
 di_slist *install_list_package_only (di_packages *packages, char *package, di_package_status status)
@@ -185,7 +297,10 @@ di_slist *install_list_package_only (di_packages *packages, char *package, di_pa
   p = di_packages_get_package (packages, package, 0);
 
   if (p && p->status < status)
+  {
+    di_packages_materialize_package (packages, p);
     di_slist_append (list, p);
+  }
 
   return list;
 }
@@ -372,6 +487,11 @@ int install_mount (const char *what)
 }
 #endif
 
+void install_helper_file (char *buf, size_t size, const char *name)
+{
+  snprintf (buf, size, "%s/%s.deb", helperdir, name);
+}
+
 int install_helper_install (const char *name)
 {
   char file_source[4096];
@@ -380,7 +500,7 @@ int install_helper_install (const char *name)
   int ret;
   struct stat s;
 
-  snprintf (file_source, sizeof file_source, "%s/%s.deb", helperdir, name);
+  install_helper_file (file_source, sizeof file_source, name);
   snprintf (file_dest_target, sizeof file_dest_target, "/var/cache/bootstrap/%s.deb", name);
   snprintf (file_dest, sizeof file_dest, "%s/%s", target_root, file_dest_target);
 
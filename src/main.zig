@@ -4,9 +4,17 @@ const posix = std.posix;
 comptime {
     _ = @import("decompress_gz.zig");
     _ = @import("decompress_xz.zig");
+    _ = @import("decompress_zst.zig");
     _ = @import("package.zig");
+    _ = @import("package_store.zig");
     _ = @import("install.zig");
     _ = @import("check.zig");
+    _ = @import("output_oci.zig");
+    _ = @import("output_tar.zig");
+    _ = @import("path_filter.zig");
+    _ = @import("pdiff.zig");
+    _ = @import("stage_cache.zig");
+    _ = @import("tar_stream.zig");
 }
 
 pub fn main() !void {
@@ -0,0 +1,252 @@
+//! Writes the contents of packages as single layer OCI image layout,
+//! instead of extracting them into the target.
+//!
+//! The layer is compressed in parallel, while the digests of both the
+//! uncompressed and the compressed stream are computed as it is written, so
+//! the layer is never read back.
+
+const std = @import("std");
+const mem = std.mem;
+const Sha256 = std.crypto.hash.sha2.Sha256;
+const log = std.log.scoped(.output_oci);
+const c = @import("c");
+const gzip = @import("gzip");
+const output_tar = @import("output_tar.zig");
+
+const gpa = std.heap.c_allocator;
+
+const index_type = "application/vnd.oci.image.index.v1+json";
+const manifest_type = "application/vnd.oci.image.manifest.v1+json";
+const config_type = "application/vnd.oci.image.config.v1+json";
+const layer_type = "application/vnd.oci.image.layer.v1.tar+gzip";
+
+const blob_dir = "blobs/sha256";
+
+const json_options: std.json.Stringify.Options = .{ .emit_null_optional_fields = false };
+
+var output: ?std.fs.Dir = null;
+
+const Descriptor = struct {
+    /// Digest in the form "sha256:<hex>".
+    digest: [7 + 2 * Sha256.digest_length]u8,
+    size: u64,
+
+    fn init(hasher: Sha256, size: u64) Descriptor {
+        var h = hasher;
+        var d: Descriptor = .{ .digest = undefined, .size = size };
+        @memcpy(d.digest[0..7], "sha256:");
+        d.digest[7..].* = std.fmt.bytesToHex(h.finalResult(), .lower);
+        return d;
+    }
+
+    fn path(d: *const Descriptor, buf: []u8) ![]const u8 {
+        return std.fmt.bufPrint(buf, "{s}/{s}", .{ blob_dir, d.digest[7..] });
+    }
+};
+
+/// Forwards everything written to `out`, while computing its digest.
+const DigestWriter = struct {
+    out: *std.Io.Writer,
+    hasher: Sha256 = .init(.{}),
+    len: u64 = 0,
+    writer: std.Io.Writer,
+
+    fn init(out: *std.Io.Writer, buffer: []u8) DigestWriter {
+        return .{
+            .out = out,
+            .writer = .{ .buffer = buffer, .vtable = &.{ .drain = drain } },
+        };
+    }
+
+    fn update(dw: *DigestWriter, bytes: []const u8) std.Io.Writer.Error!void {
+        dw.hasher.update(bytes);
+        dw.len += bytes.len;
+        try dw.out.writeAll(bytes);
+    }
+
+    fn drain(w: *std.Io.Writer, data: []const []const u8, splat: usize) std.Io.Writer.Error!usize {
+        const dw: *DigestWriter = @alignCast(@fieldParentPtr("writer", w));
+        try dw.update(w.buffered());
+        w.end = 0;
+
+        var n: usize = 0;
+        for (data[0 .. data.len - 1]) |bytes| {
+            try dw.update(bytes);
+            n += bytes.len;
+        }
+        const pattern = data[data.len - 1];
+        for (0..splat) |_| {
+            try dw.update(pattern);
+            n += pattern.len;
+        }
+        return n;
+    }
+
+    fn descriptor(dw: *DigestWriter) Descriptor {
+        return .init(dw.hasher, dw.len);
+    }
+};
+
+const Platform = struct {
+    architecture: []const u8,
+    os: []const u8 = "linux",
+    variant: ?[]const u8 = null,
+};
+
+/// Maps Debian architectures to the Go names used by OCI.
+fn platform(arch: []const u8) Platform {
+    const map: std.StaticStringMap(Platform) = .initComptime(.{
+        .{ "amd64", .{ .architecture = "amd64" } },
+        .{ "arm64", .{ .architecture = "arm64", .variant = "v8" } },
+        .{ "armel", .{ .architecture = "arm", .variant = "v5" } },
+        .{ "armhf", .{ .architecture = "arm", .variant = "v7" } },
+        .{ "i386", .{ .architecture = "386" } },
+        .{ "mips64el", .{ .architecture = "mips64le" } },
+        .{ "ppc64el", .{ .architecture = "ppc64le" } },
+        .{ "riscv64", .{ .architecture = "riscv64" } },
+        .{ "s390x", .{ .architecture = "s390x" } },
+    });
+    return map.get(arch) orelse .{ .architecture = arch };
+}
+
+fn open(path: []const u8) !void {
+    var dir = try std.fs.cwd().makeOpenPath(path, .{});
+    errdefer dir.close();
+    try dir.makePath(blob_dir);
+    output = dir;
+}
+
+/// Writes the layer blob, returns its descriptor and the digest of the
+/// uncompressed archive.
+fn writeLayer(dir: std.fs.Dir, list: *c.di_slist, diff_id: *Descriptor) !Descriptor {
+    const tmp_name = blob_dir ++ "/.layer.tmp";
+    var file = try dir.createFile(tmp_name, .{});
+    errdefer dir.deleteFile(tmp_name) catch {};
+    defer file.close();
+
+    var file_buf: [64 * 1024]u8 = undefined;
+    var file_writer = file.writer(&file_buf);
+    var blob_buf: [64 * 1024]u8 = undefined;
+    var blob: DigestWriter = .init(&file_writer.interface, &blob_buf);
+    var compress: gzip.ParallelWriter = try .init(gpa, &blob.writer, std.Thread.getCpuCount() catch 1);
+    defer compress.deinit();
+    var diff_buf: [64 * 1024]u8 = undefined;
+    var diff: DigestWriter = .init(&compress.writer, &diff_buf);
+
+    try output_tar.writeArchive(list, &diff.writer);
+    try diff.writer.flush();
+    try compress.writer.flush();
+    try blob.writer.flush();
+    try file_writer.interface.flush();
+
+    diff_id.* = diff.descriptor();
+    const layer = blob.descriptor();
+    var path_buf: [128]u8 = undefined;
+    try dir.rename(tmp_name, try layer.path(&path_buf));
+    log.debug("layer {s}: {d} bytes, uncompressed {d} bytes", .{ layer.digest, layer.size, diff_id.size });
+    return layer;
+}
+
+fn writeBlob(dir: std.fs.Dir, data: []const u8) !Descriptor {
+    var hasher: Sha256 = .init(.{});
+    hasher.update(data);
+    const d: Descriptor = .init(hasher, data.len);
+    var path_buf: [128]u8 = undefined;
+    try dir.writeFile(.{ .sub_path = try d.path(&path_buf), .data = data });
+    return d;
+}
+
+fn writeJsonBlob(dir: std.fs.Dir, value: anytype) !Descriptor {
+    const json = try std.json.Stringify.valueAlloc(gpa, value, json_options);
+    defer gpa.free(json);
+    return writeBlob(dir, json);
+}
+
+fn writeJsonFile(dir: std.fs.Dir, name: []const u8, value: anytype) !void {
+    const json = try std.json.Stringify.valueAlloc(gpa, value, json_options);
+    defer gpa.free(json);
+    try dir.writeFile(.{ .sub_path = name, .data = json });
+}
+
+fn write(list: *c.di_slist) !void {
+    var dir = output orelse return error.NotOpen;
+    defer {
+        dir.close();
+        output = null;
+    }
+
+    var diff_id: Descriptor = undefined;
+    const layer = try writeLayer(dir, list, &diff_id);
+    const plat = platform(mem.span(c.arch));
+
+    const config = try writeJsonBlob(dir, .{
+        .architecture = plat.architecture,
+        .os = plat.os,
+        .variant = plat.variant,
+        .rootfs = .{
+            .type = "layers",
+            .diff_ids = .{&diff_id.digest},
+        },
+        .history = .{.{ .created_by = "cdebootstrap" }},
+    });
+
+    const manifest = try writeJsonBlob(dir, .{
+        .schemaVersion = 2,
+        .mediaType = manifest_type,
+        .config = .{ .mediaType = config_type, .digest = &config.digest, .size = config.size },
+        .layers = .{.{ .mediaType = layer_type, .digest = &layer.digest, .size = layer.size }},
+    });
+
+    const ref_name: ?[]const u8 = if (c.suite_release_codename != null) mem.span(c.suite_release_codename) else null;
+    try writeJsonFile(dir, "oci-layout", .{ .imageLayoutVersion = "1.0.0" });
+    try writeJsonFile(dir, "index.json", .{
+        .schemaVersion = 2,
+        .mediaType = index_type,
+        .manifests = .{.{
+            .mediaType = manifest_type,
+            .digest = &manifest.digest,
+            .size = manifest.size,
+            .platform = plat,
+            .annotations = .{ .@"org.opencontainers.image.ref.name" = ref_name },
+        }},
+    });
+}
+
+export fn output_oci_open(path: ?[*:0]const u8) c_int {
+    open(mem.span(path.?)) catch |err| {
+        c.log_text(c.DI_LOG_LEVEL_WARNING, "Failed to open %s: %s", path, @errorName(err).ptr);
+        return -1;
+    };
+    return 0;
+}
+
+export fn output_oci_write(list: ?*c.di_slist) c_int {
+    write(list.?) catch |err| {
+        c.log_text(c.DI_LOG_LEVEL_WARNING, "Failed to write image: %s", @errorName(err).ptr);
+        return -1;
+    };
+    return 0;
+}
+
+test DigestWriter {
+    var out: std.Io.Writer.Allocating = .init(std.testing.allocator);
+    defer out.deinit();
+    var buf: [4]u8 = undefined;
+    var dw: DigestWriter = .init(&out.writer, &buf);
+    try dw.writer.writeAll("hello ");
+    try dw.writer.splatByteAll('x', 10);
+    try dw.writer.flush();
+
+    try std.testing.expectEqualStrings("hello xxxxxxxxxx", out.written());
+    var hasher: Sha256 = .init(.{});
+    hasher.update("hello xxxxxxxxxx");
+    const expected: Descriptor = .init(hasher, 16);
+    try std.testing.expectEqualStrings(&expected.digest, &dw.descriptor().digest);
+    try std.testing.expectEqual(@as(u64, 16), dw.descriptor().size);
+}
+
+test platform {
+    try std.testing.expectEqualStrings("arm", platform("armhf").architecture);
+    try std.testing.expectEqualStrings("v7", platform("armhf").variant.?);
+    try std.testing.expectEqualStrings("ppc64le", platform("ppc64el").architecture);
+}
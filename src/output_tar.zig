@@ -0,0 +1,169 @@
+//! Writes the contents of packages into a single tar archive, instead of
+//! extracting them into the target.
+
+const std = @import("std");
+const mem = std.mem;
+const log = std.log.scoped(.output_tar);
+const c = @import("c");
+const package = @import("package.zig");
+const path_filter = @import("path_filter.zig");
+const tar_stream = @import("tar_stream.zig");
+
+const gpa = std.heap.c_allocator;
+
+var output: ?std.fs.File = null;
+
+const Archive = struct {
+    writer: *std.Io.Writer,
+    filter: path_filter.Filter,
+    /// Paths already written to the archive.
+    seen: std.StringHashMapUnmanaged(void) = .empty,
+    /// Backing memory for the keys of `seen`.
+    arena: std.heap.ArenaAllocator = .init(gpa),
+    entries: usize = 0,
+    duplicates: usize = 0,
+
+    fn deinit(archive: *Archive) void {
+        archive.seen.deinit(gpa);
+        archive.arena.deinit();
+    }
+
+    /// Copies all entries of a data.tar, skipping excluded paths and paths
+    /// already written.
+    pub fn consume(archive: *Archive, reader: *std.Io.Reader) !void {
+        var it: tar_stream.Iterator = .init(gpa, reader);
+        defer it.deinit();
+
+        while (try it.next()) |entry| {
+            if (entry.kind == .pax_global) continue;
+            if (archive.filter.excludesEntry(entry)) continue;
+
+            var buf: [std.fs.max_path_bytes]u8 = undefined;
+            const path = try tar_stream.normalizePath(&buf, entry.name);
+            const gop = try archive.seen.getOrPut(gpa, path);
+            if (gop.found_existing) {
+                archive.duplicates += 1;
+                continue;
+            }
+            gop.key_ptr.* = try archive.arena.allocator().dupe(u8, path);
+
+            try archive.writer.writeAll(entry.header);
+            try it.streamData(archive.writer);
+            archive.entries += 1;
+        }
+    }
+};
+
+fn open(path: []const u8) !void {
+    if (mem.eql(u8, path, "-")) {
+        // The archive takes over stdout, messages go to stderr instead.
+        const fd = try std.posix.dup(std.posix.STDOUT_FILENO);
+        try std.posix.dup2(std.posix.STDERR_FILENO, std.posix.STDOUT_FILENO);
+        output = .{ .handle = fd };
+    } else {
+        output = try std.fs.cwd().createFile(path, .{});
+    }
+}
+
+/// Writes the contents of all packages in `list` as tar archive.
+pub fn writeArchive(list: *c.di_slist, writer: *std.Io.Writer) !void {
+    var packages: std.ArrayList(*c.di_package) = .empty;
+    defer packages.deinit(gpa);
+
+    var node: ?*c.di_slist_node = list.head;
+    while (node) |n| : (node = n.next) {
+        try packages.append(gpa, @ptrCast(@alignCast(n.data)));
+    }
+
+    var archive: Archive = .{
+        .writer = writer,
+        .filter = path_filter.get(),
+    };
+    defer archive.deinit();
+
+    // Files of later packages replace the ones of earlier packages.  So the
+    // packages are processed in reverse and only the first occurrence of a
+    // path is written.
+    var i = packages.items.len;
+    while (i > 0) {
+        i -= 1;
+        const p = packages.items[i];
+        c.log_message(c.LOG_MESSAGE_INFO_INSTALL_PACKAGE_EXTRACT, p.package);
+
+        var deb = try package.packageOpen(p);
+        defer deb.close();
+        package.packageDataTar(deb, &archive) catch |err| {
+            log.err("failed to extract package '{s}': {t}", .{ p.package, err });
+            return err;
+        };
+    }
+
+    try tar_stream.finish(archive.writer);
+    try archive.writer.flush();
+
+    log.debug("wrote {d} entries, skipped {d} duplicates", .{ archive.entries, archive.duplicates });
+}
+
+fn write(list: *c.di_slist) !void {
+    const file = output orelse return error.NotOpen;
+    defer {
+        file.close();
+        output = null;
+    }
+
+    var write_buf: [64 * 1024]u8 = undefined;
+    var file_writer = file.writer(&write_buf);
+    try writeArchive(list, &file_writer.interface);
+}
+
+export fn output_tar_open(path: ?[*:0]const u8) c_int {
+    open(mem.span(path.?)) catch |err| {
+        c.log_text(c.DI_LOG_LEVEL_WARNING, "Failed to open %s: %s", path, @errorName(err).ptr);
+        return -1;
+    };
+    return 0;
+}
+
+export fn output_tar_write(list: ?*c.di_slist) c_int {
+    write(list.?) catch |err| {
+        c.log_text(c.DI_LOG_LEVEL_WARNING, "Failed to write archive: %s", @errorName(err).ptr);
+        return -1;
+    };
+    return 0;
+}
+
+test Archive {
+    const tar = @import("tar");
+    const testing = std.testing;
+
+    var inputs: [2]std.Io.Writer.Allocating = .{ .init(testing.allocator), .init(testing.allocator) };
+    defer for (&inputs) |*input| input.deinit();
+    for (&inputs, [_][]const u8{ "new", "old" }) |*input, content| {
+        var writer: tar.Writer = .{ .underlying_writer = &input.writer };
+        try writer.writeDir("./etc", .{});
+        try writer.writeFileBytes("./etc/f", content, .{});
+        try writer.finishPedantically();
+    }
+
+    var out: std.Io.Writer.Allocating = .init(testing.allocator);
+    defer out.deinit();
+    var archive: Archive = .{ .writer = &out.writer, .filter = .{ .rules = &.{} } };
+    defer archive.deinit();
+    for (&inputs) |*input| {
+        var reader: std.Io.Reader = .fixed(input.written());
+        try archive.consume(&reader);
+    }
+    try testing.expectEqual(@as(usize, 2), archive.entries);
+    try testing.expectEqual(@as(usize, 2), archive.duplicates);
+
+    var reader: std.Io.Reader = .fixed(out.written());
+    var it: tar_stream.Iterator = .init(testing.allocator, &reader);
+    defer it.deinit();
+    _ = (try it.next()).?;
+    const file = (try it.next()).?;
+    try testing.expectEqualStrings("./etc/f", file.name);
+    var data: [tar_stream.block_len]u8 = undefined;
+    var data_writer: std.Io.Writer = .fixed(&data);
+    try it.streamData(&data_writer);
+    try testing.expectEqualStrings("new", data[0..3]);
+}
@@ -4,26 +4,98 @@ const log = std.log.scoped(.package);
 const native_endian = @import("builtin").cpu.arch.endian();
 const ar = @import("ar");
 const c = @import("c");
+const package_store = @import("package_store.zig");
+const path_filter = @import("path_filter.zig");
 
 const gpa = std.heap.c_allocator;
 
 extern const execute_io_log_handler: fn (file: ?*c.FILE, user_data: ?*anyopaque) callconv(.c) void;
 
-fn packageExtractSelfBz(reader: *std.Io.Reader, len: usize) !void {
-    const command: []const ?[*:0]const u8 = &.{ "tar", "-x", "-C", c.target_root, "-f", "-", null };
+/// Where the data.tar of a package is extracted to.
+pub const Destination = struct {
+    root: [*:0]const u8,
+    /// Entries excluded by this filter are dropped.
+    filter: ?path_filter.Filter,
+
+    /// The target, with the configured path filters.
+    pub fn target() Destination {
+        return .{
+            .root = mem.span(c.target_root).ptr,
+            .filter = if (path_filter.active()) path_filter.get() else null,
+        };
+    }
+};
+
+/// Copies the decompressed data.tar to tar, dropping the entries excluded by
+/// `filter`.
+fn streamDataTar(reader: *std.Io.Reader, writer: *std.Io.Writer, limit: std.Io.Limit, filter: ?path_filter.Filter) !void {
+    if (filter) |f| {
+        try f.streamTar(reader, writer);
+    } else if (limit.toInt()) |size| {
+        try reader.streamExact(writer, size);
+    } else {
+        _ = try reader.streamRemaining(writer);
+    }
+    try writer.flush();
+}
+
+/// The bzip2 decompressor only writes to file descriptors, so it is run in a
+/// separate thread feeding a pipe, whose read end is passed to
+/// `consumer.consume`.
+fn consumeBz(decomp: *c.struct_decompress_bz, consumer: anytype) !void {
+    const Feeder = struct {
+        fn run(d: *c.struct_decompress_bz, fd: std.posix.fd_t) void {
+            defer std.posix.close(fd);
+            while (c.decompress_bz(d, fd) > 0) {}
+        }
+    };
+
+    const fds = try std.posix.pipe2(.{ .CLOEXEC = true });
+    const pipe_in: std.fs.File = .{ .handle = fds[0] };
+    const thread = std.Thread.spawn(.{}, Feeder.run, .{ decomp, fds[1] }) catch |err| {
+        std.posix.close(fds[0]);
+        std.posix.close(fds[1]);
+        return err;
+    };
+    defer thread.join();
+    defer pipe_in.close();
+
+    var read_buf: [4 * 1024]u8 = undefined;
+    var pipe_reader = pipe_in.reader(&read_buf);
+    try consumer.consume(&pipe_reader.interface);
+}
+
+fn packageExtractSelfBz(reader: *std.Io.Reader, len: usize, dest: Destination) !void {
+    const command: []const ?[*:0]const u8 = &.{ "tar", "-x", "-C", dest.root, "-f", "-", null };
 
     const Context = struct {
         decomp: *c.struct_decompress_bz,
+        filter: ?path_filter.Filter,
         err: ?anyerror = null,
+        done: bool = false,
         file_out: std.fs.File = .{ .handle = -1 },
 
         fn handler(file: ?*c.FILE, user_data: ?*anyopaque) callconv(.c) void {
             const context: *@This() = @ptrCast(@alignCast(user_data));
             context.file_out = .{ .handle = c.fileno(file) };
+            if (context.filter != null) {
+                if (context.done) return;
+                context.done = true;
+                consumeBz(context.decomp, context) catch |err| {
+                    context.err = err;
+                };
+                return;
+            }
             const r = c.decompress_bz(context.decomp, c.fileno(file));
             if (r <= 0) context.err = error.DecompressXz;
         }
 
+        pub fn consume(context: *@This(), reader: *std.Io.Reader) !void {
+            var write_buf: [4 * 1024]u8 = undefined;
+            var file_out_writer = context.file_out.writer(&write_buf);
+            try streamDataTar(reader, &file_out_writer.interface, .unlimited, context.filter);
+        }
+
         pub fn deinit(self: *@This()) void {
             c.decompress_bz_free(self.decomp);
         }
@@ -33,6 +105,7 @@ fn packageExtractSelfBz(reader: *std.Io.Reader, len: usize) !void {
 
     var context: Context = .{
         .decomp = c.decompress_bz_new(file_reader.file.handle, len) orelse return error.NotBzStream,
+        .filter = dest.filter,
     };
     defer context.deinit();
 
@@ -71,12 +144,13 @@ fn packageExtractSelfBz(reader: *std.Io.Reader, len: usize) !void {
     };
 }
 
-fn packageExtractSelfGz(reader: *std.Io.Reader, len: usize) !void {
-    const command: []const ?[*:0]const u8 = &.{ "tar", "-x", "-C", c.target_root, "-f", "-", null };
+fn packageExtractSelfGz(reader: *std.Io.Reader, len: usize, dest: Destination) !void {
+    const command: []const ?[*:0]const u8 = &.{ "tar", "-x", "-C", dest.root, "-f", "-", null };
 
     const Context = struct {
         reader: *std.Io.Reader,
         limit: std.Io.Limit,
+        filter: ?path_filter.Filter,
         err: ?anyerror = null,
         file_out: std.fs.File = .{ .handle = -1 },
 
@@ -87,7 +161,7 @@ fn packageExtractSelfGz(reader: *std.Io.Reader, len: usize) !void {
             context.file_out = .{ .handle = c.fileno(file) };
             var file_out_writer = context.file_out.writer(&write_buf);
             var decompress: std.compress.flate.Decompress = .init(context.reader, .gzip, &flate_buffer);
-            _ = decompress.reader.streamRemaining(&file_out_writer.interface) catch |err| {
+            streamDataTar(&decompress.reader, &file_out_writer.interface, .unlimited, context.filter) catch |err| {
                 context.err = err;
                 return;
             };
@@ -98,7 +172,7 @@ fn packageExtractSelfGz(reader: *std.Io.Reader, len: usize) !void {
         }
     };
 
-    var context: Context = .{ .reader = reader, .limit = .limited(len) };
+    var context: Context = .{ .reader = reader, .limit = .limited(len), .filter = dest.filter };
     defer context.deinit();
 
     const io_info: []const c.execute_io_info = &.{
@@ -136,12 +210,13 @@ fn packageExtractSelfGz(reader: *std.Io.Reader, len: usize) !void {
     };
 }
 
-fn packageExtractSelfXz(reader: *std.Io.Reader, len: usize) !void {
-    const command: []const ?[*:0]const u8 = &.{ "tar", "-x", "-C", c.target_root, "-f", "-", null };
+fn packageExtractSelfXz(reader: *std.Io.Reader, len: usize, dest: Destination) !void {
+    const command: []const ?[*:0]const u8 = &.{ "tar", "-x", "-C", dest.root, "-f", "-", null };
 
     const Context = struct {
         reader: *std.Io.Reader,
         limit: std.Io.Limit,
+        filter: ?path_filter.Filter,
         err: ?anyerror = null,
         file_out: std.fs.File = .{ .handle = -1 },
 
@@ -154,7 +229,7 @@ fn packageExtractSelfXz(reader: *std.Io.Reader, len: usize) !void {
                 context.err = err;
                 return;
             };
-            _ = decompress.reader.streamRemaining(&file_out_writer.interface) catch |err| {
+            streamDataTar(&decompress.reader, &file_out_writer.interface, .unlimited, context.filter) catch |err| {
                 context.err = err;
                 return;
             };
@@ -165,7 +240,7 @@ fn packageExtractSelfXz(reader: *std.Io.Reader, len: usize) !void {
         }
     };
 
-    var context: Context = .{ .reader = reader, .limit = .limited(len) };
+    var context: Context = .{ .reader = reader, .limit = .limited(len), .filter = dest.filter };
     defer context.deinit();
 
     const io_info: []const c.execute_io_info = &.{
@@ -203,12 +278,13 @@ fn packageExtractSelfXz(reader: *std.Io.Reader, len: usize) !void {
     };
 }
 
-fn packageExtractSelfNull(reader: *std.Io.Reader, len: usize) !void {
-    const command: []const ?[*:0]const u8 = &.{ "tar", "-x", "-C", c.target_root, "-f", "-", null };
+fn packageExtractSelfNull(reader: *std.Io.Reader, len: usize, dest: Destination) !void {
+    const command: []const ?[*:0]const u8 = &.{ "tar", "-x", "-C", dest.root, "-f", "-", null };
 
     const Context = struct {
         reader: *std.Io.Reader,
         limit: std.Io.Limit,
+        filter: ?path_filter.Filter,
         err: ?anyerror = null,
         file_out: std.fs.File = .{ .handle = -1 },
 
@@ -217,8 +293,7 @@ fn packageExtractSelfNull(reader: *std.Io.Reader, len: usize) !void {
             const context: *@This() = @ptrCast(@alignCast(user_data));
             context.file_out = .{ .handle = c.fileno(file) };
             var file_out_writer = context.file_out.writer(&write_buf);
-            const size = context.limit.toInt().?;
-            _ = context.reader.streamExact(&file_out_writer.interface, size) catch |err| {
+            streamDataTar(context.reader, &file_out_writer.interface, context.limit, context.filter) catch |err| {
                 context.err = err;
                 return;
             };
@@ -229,7 +304,7 @@ fn packageExtractSelfNull(reader: *std.Io.Reader, len: usize) !void {
         }
     };
 
-    var context: Context = .{ .reader = reader, .limit = .limited(len) };
+    var context: Context = .{ .reader = reader, .limit = .limited(len), .filter = dest.filter };
     defer context.deinit();
 
     const io_info: []const c.execute_io_info = &.{
@@ -301,12 +376,13 @@ fn parseMemberSize(slice: []const u8) PackageExtractError!usize {
 /// decompressor based on the member name.
 ///
 /// Parameters:
-///   fd: The C-style file descriptor for the open .deb file.
+///   file: The open .deb file.
+///   dest: Where to extract the data.tar member to.
 ///
 /// Returns:
 ///   The integer result from the specific extraction function on success, or an
 ///   error on failure.
-pub fn packageExtractSelf(file: std.fs.File) !void {
+pub fn packageExtractSelf(file: std.fs.File, dest: Destination) !void {
     var read_buffer: [4 * 1024]u8 = undefined;
     var file_reader = file.reader(&read_buffer);
     const reader = &file_reader.interface;
@@ -330,19 +406,19 @@ pub fn packageExtractSelf(file: std.fs.File) !void {
         } else if (std.mem.eql(u8, f.name, "data.tar.bz2")) {
             found_data_file = true;
             defer it.unread_file_bytes = 0; // we are using reader directly
-            return try packageExtractSelfBz(reader, f.size);
+            return try packageExtractSelfBz(reader, f.size, dest);
         } else if (std.mem.eql(u8, f.name, "data.tar.gz")) {
             found_data_file = true;
             defer it.unread_file_bytes = 0; // we are using reader directly
-            return try packageExtractSelfGz(reader, f.size);
+            return try packageExtractSelfGz(reader, f.size, dest);
         } else if (std.mem.eql(u8, f.name, "data.tar.xz")) {
             found_data_file = true;
             defer it.unread_file_bytes = 0; // we are using reader directly
-            return packageExtractSelfXz(reader, f.size);
+            return packageExtractSelfXz(reader, f.size, dest);
         } else if (std.mem.eql(u8, f.name, "data.tar")) {
             found_data_file = true;
             defer it.unread_file_bytes = 0; // we are using reader directly
-            return try packageExtractSelfNull(reader, f.size);
+            return try packageExtractSelfNull(reader, f.size, dest);
         }
     }
 
@@ -360,10 +436,62 @@ export fn package_get_local_filename(package: [*c]c.di_package) [*c]const u8 {
     return std.fs.path.basename(filename).ptr;
 }
 
+/// Calls `consumer.consume` with a reader for the decompressed data.tar
+/// member of the package in `file`.
+pub fn packageDataTar(file: std.fs.File, consumer: anytype) !void {
+    var read_buffer: [4 * 1024]u8 = undefined;
+    var file_reader = file.reader(&read_buffer);
+    const reader = &file_reader.interface;
+    var it = try ar.Iterator.init(gpa, reader);
+    defer it.deinit();
+
+    while (try it.next()) |f| {
+        if (std.mem.eql(u8, f.name, "data.tar.bz2")) {
+            defer it.unread_file_bytes = 0; // we are using the file directly
+            try file.seekTo(file_reader.logicalPos());
+            const decomp = c.decompress_bz_new(file.handle, f.size) orelse return error.NotBzStream;
+            defer c.decompress_bz_free(decomp);
+            return consumeBz(decomp, consumer);
+        } else if (std.mem.eql(u8, f.name, "data.tar.gz")) {
+            defer it.unread_file_bytes = 0; // we are using reader directly
+            var flate_buffer: [std.compress.flate.max_window_len]u8 = undefined;
+            var decompress: std.compress.flate.Decompress = .init(reader, .gzip, &flate_buffer);
+            return consumer.consume(&decompress.reader);
+        } else if (std.mem.eql(u8, f.name, "data.tar.xz")) {
+            defer it.unread_file_bytes = 0; // we are using reader directly
+            var decompress = try std.compress.xz.Decompress.init(reader, gpa, &.{});
+            defer decompress.deinit();
+            return consumer.consume(&decompress.reader);
+        } else if (std.mem.eql(u8, f.name, "data.tar")) {
+            return consumer.consume(reader);
+        }
+    }
+
+    return error.InvalidDebianPackage;
+}
+
+/// Opens the downloaded package file in the target.
+pub fn packageOpen(package: *c.di_package) !std.fs.File {
+    var buf: [std.fs.max_path_bytes]u8 = undefined;
+    const path = try std.fmt.bufPrint(&buf, "{s}/var/cache/bootstrap/{s}", .{
+        c.target_root,
+        std.fs.path.basename(mem.span(package.filename)),
+    });
+    return std.fs.cwd().openFile(path, .{});
+}
+
 export fn package_extract(package: [*c]c.di_package) c_int {
     const filename = mem.span(package.*.filename);
     log.debug("extract {s} to {s}", .{ filename, c.target_root });
 
+    if (package_store.active()) {
+        package_store.extract(package) catch |err| {
+            log.err("failed to extract '{s}' via package store: {t}", .{ filename, err });
+            return -1;
+        };
+        return 0;
+    }
+
     var buf: [std.fs.max_path_bytes]u8 = undefined;
     const path = std.fmt.bufPrint(&buf, "{s}/var/cache/bootstrap/{s}", .{
         c.target_root,
@@ -379,7 +507,7 @@ export fn package_extract(package: [*c]c.di_package) c_int {
     };
     defer file.close();
 
-    packageExtractSelf(file) catch |err| {
+    packageExtractSelf(file, .target()) catch |err| {
         log.err("failed to extract file '{s}': {t}", .{ path, err });
         return -1;
     };
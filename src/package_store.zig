@@ -0,0 +1,271 @@
+//! Store of extracted packages, shared between bootstraps.
+//!
+//! Every package is extracted once, without path filters, into a directory
+//! of the store named after its SHA256.  The target is then assembled from
+//! this tree: regular files are reflinked, or copied if the file system
+//! can't reflink, while directories, symlinks and special files are created
+//! with the metadata of the stored ones.  Files are never hardlinked, as
+//! any change of the target in place would change the stored tree of all
+//! later bootstraps.  Files below /etc, which includes all conffiles
+//! (Debian policy 10.7.2), are always copied, as they are commonly
+//! modified in place.
+
+const std = @import("std");
+const mem = std.mem;
+const posix = std.posix;
+const linux = std.os.linux;
+const log = std.log.scoped(.package_store);
+const c = @import("c");
+const package = @import("package.zig");
+
+const gpa = std.heap.c_allocator;
+
+/// _IOW(0x94, 9, int) from <linux/fs.h>.
+const FICLONE = 0x40049409;
+
+var store: ?std.fs.Dir = null;
+/// Absolute path of the store, passed to tar.
+var store_path: [:0]const u8 = "";
+/// Cleared after the first failed reflink, it fails the same way for all
+/// other files.
+var reflink_supported = true;
+
+const Stats = struct {
+    reflinked: usize = 0,
+    copied: usize = 0,
+};
+
+pub fn active() bool {
+    return store != null;
+}
+
+/// Turns the result of a libc call into an error.
+fn check(rc: c_int, what: []const u8, path: []const u8) !void {
+    if (rc != -1) return;
+    log.err("{s} '{s}' failed: {t}", .{ what, path, posix.errno(rc) });
+    return error.StoreAssembly;
+}
+
+fn validDigest(sha256: []const u8) bool {
+    if (sha256.len != 64) return false;
+    for (sha256) |ch| if (!std.ascii.isHex(ch)) return false;
+    return true;
+}
+
+/// Returns the tree of `p` in the store, extracting the package first if
+/// it is not stored yet.
+fn entry(dir: std.fs.Dir, p: *c.di_package) !std.fs.Dir {
+    if (p.sha256 == null) return error.MissingChecksum;
+    const sha256 = mem.span(p.sha256);
+    if (!validDigest(sha256)) return error.InvalidChecksum;
+
+    if (dir.openDir(sha256, .{ .iterate = true })) |tree| {
+        return tree;
+    } else |err| switch (err) {
+        error.FileNotFound => {},
+        else => return err,
+    }
+
+    // Extracted under a temporary name, so only complete trees are found.
+    var tmp_buf: [128]u8 = undefined;
+    const tmp_name = try std.fmt.bufPrint(&tmp_buf, ".{s}.{d}", .{ sha256, linux.getpid() });
+    dir.deleteTree(tmp_name) catch {};
+    try dir.makeDir(tmp_name);
+    errdefer dir.deleteTree(tmp_name) catch {};
+
+    var root_buf: [std.fs.max_path_bytes]u8 = undefined;
+    const root = try std.fmt.bufPrintZ(&root_buf, "{s}/{s}", .{ store_path, tmp_name });
+    {
+        var deb = try package.packageOpen(p);
+        defer deb.close();
+        try package.packageExtractSelf(deb, .{ .root = root.ptr, .filter = null });
+    }
+
+    dir.rename(tmp_name, sha256) catch |err| switch (err) {
+        // Stored concurrently by another bootstrap.
+        error.PathAlreadyExists => dir.deleteTree(tmp_name) catch {},
+        else => return err,
+    };
+    return dir.openDir(sha256, .{ .iterate = true });
+}
+
+/// Removes whatever is in the way of a new file, like tar does.
+fn removeExisting(target: std.fs.Dir, sub_path: []const u8) !void {
+    target.deleteFile(sub_path) catch |err| switch (err) {
+        error.FileNotFound => {},
+        else => return err,
+    };
+}
+
+fn setMetadata(target: std.fs.Dir, sub_path: [:0]const u8, st: *const c.struct_stat) !void {
+    try check(c.fchownat(target.fd, sub_path, st.st_uid, st.st_gid, c.AT_SYMLINK_NOFOLLOW), "chown", sub_path);
+    // After chown, which clears the set-id bits.
+    try check(c.fchmodat(target.fd, sub_path, st.st_mode & 0o7777, 0), "chmod", sub_path);
+    const times = [2]c.struct_timespec{ st.st_atim, st.st_mtim };
+    try check(c.utimensat(target.fd, sub_path, &times, c.AT_SYMLINK_NOFOLLOW), "utimensat", sub_path);
+}
+
+fn reflink(src_dir: std.fs.Dir, name: []const u8, target: std.fs.Dir, sub_path: [:0]const u8, st: *const c.struct_stat) !void {
+    var src = try src_dir.openFile(name, .{});
+    defer src.close();
+    var dst = try target.createFile(sub_path, .{ .exclusive = true });
+    defer dst.close();
+    errdefer target.deleteFile(sub_path) catch {};
+
+    const rc = linux.ioctl(dst.handle, FICLONE, @intCast(src.handle));
+    if (linux.E.init(rc) != .SUCCESS) return error.ReflinkUnsupported;
+    try setMetadata(target, sub_path, st);
+}
+
+fn placeFile(
+    src_dir: std.fs.Dir,
+    name: [:0]const u8,
+    target: std.fs.Dir,
+    sub_path: [:0]const u8,
+    st: *const c.struct_stat,
+    copy: bool,
+    stats: *Stats,
+) !void {
+    try removeExisting(target, sub_path);
+    if (!copy and reflink_supported) {
+        if (reflink(src_dir, name, target, sub_path, st)) {
+            stats.reflinked += 1;
+            return;
+        } else |err| switch (err) {
+            error.ReflinkUnsupported => reflink_supported = false,
+            else => return err,
+        }
+    }
+    try src_dir.copyFile(name, target, sub_path, .{});
+    try setMetadata(target, sub_path, st);
+    stats.copied += 1;
+}
+
+/// A directory of the target, whose metadata is set after its entries.
+const Directory = struct {
+    path: [:0]u8,
+    st: c.struct_stat,
+};
+
+fn addDirectory(dirs: *std.ArrayList(Directory), path: []const u8, st: *const c.struct_stat) !void {
+    const path_z = try gpa.dupeZ(u8, path);
+    errdefer gpa.free(path_z);
+    try dirs.append(gpa, .{ .path = path_z, .st = st.* });
+}
+
+/// Creates the parents of `sub_path` that are missing in the target, with
+/// the metadata of the stored ones.  They are missing if an excluded
+/// directory holds an included entry, for which tar creates them as well.
+fn makeParents(tree: std.fs.Dir, target: std.fs.Dir, sub_path: []const u8, dirs: *std.ArrayList(Directory)) !void {
+    const dir_name = std.fs.path.dirname(sub_path) orelse return;
+    var parent_buf: [std.fs.max_path_bytes]u8 = undefined;
+    const parent = try std.fmt.bufPrintZ(&parent_buf, "{s}", .{dir_name});
+
+    var st: c.struct_stat = undefined;
+    if (c.fstatat(target.fd, parent, &st, c.AT_SYMLINK_NOFOLLOW) == 0) return;
+    try makeParents(tree, target, dir_name, dirs);
+
+    try check(c.fstatat(tree.fd, parent, &st, c.AT_SYMLINK_NOFOLLOW), "stat", parent);
+    target.makeDirZ(parent) catch |err| switch (err) {
+        error.PathAlreadyExists => {},
+        else => return err,
+    };
+    try addDirectory(dirs, parent, &st);
+}
+
+/// Recreates the stored tree in the target.
+fn assemble(tree: std.fs.Dir, dest: package.Destination, stats: *Stats) !void {
+    var target = try std.fs.cwd().openDir(mem.span(dest.root), .{});
+    defer target.close();
+
+    var walker = try tree.walk(gpa);
+    defer walker.deinit();
+
+    var dirs: std.ArrayList(Directory) = .empty;
+    defer {
+        for (dirs.items) |d| gpa.free(d.path);
+        dirs.deinit(gpa);
+    }
+
+    while (try walker.next()) |e| {
+        var path_buf: [std.fs.max_path_bytes]u8 = undefined;
+        const path = try std.fmt.bufPrint(&path_buf, "/{s}", .{e.path});
+        if (dest.filter) |filter| {
+            if (filter.excludes(path)) continue;
+            try makeParents(tree, target, e.path, &dirs);
+        }
+
+        var st: c.struct_stat = undefined;
+        try check(c.fstatat(e.dir.fd, e.basename, &st, c.AT_SYMLINK_NOFOLLOW), "stat", e.path);
+
+        switch (e.kind) {
+            .directory => {
+                target.makeDir(e.path) catch |err| switch (err) {
+                    error.PathAlreadyExists => {},
+                    else => return err,
+                };
+                try addDirectory(&dirs, e.path, &st);
+            },
+            .sym_link => {
+                var link_buf: [std.fs.max_path_bytes]u8 = undefined;
+                const link = try e.dir.readLink(e.basename, &link_buf);
+                try removeExisting(target, e.path);
+                try target.symLink(link, e.path, .{});
+                try check(c.fchownat(target.fd, e.path, st.st_uid, st.st_gid, c.AT_SYMLINK_NOFOLLOW), "chown", e.path);
+            },
+            .file => try placeFile(e.dir, e.basename, target, e.path, &st, mem.startsWith(u8, path, "/etc/"), stats),
+            else => {
+                try removeExisting(target, e.path);
+                try check(c.mknodat(target.fd, e.path, st.st_mode, st.st_rdev), "mknod", e.path);
+                try setMetadata(target, e.path, &st);
+            },
+        }
+    }
+
+    // Creating entries changes the mtime of a directory, so like tar the
+    // metadata is set afterwards, deepest first.  The walk lists every
+    // directory before its entries.
+    var i = dirs.items.len;
+    while (i > 0) {
+        i -= 1;
+        try setMetadata(target, dirs.items[i].path, &dirs.items[i].st);
+    }
+}
+
+/// Extracts `p` into the target via the store.
+pub fn extract(p: *c.di_package) !void {
+    const dir = store orelse return error.NotOpen;
+    var tree = try entry(dir, p);
+    defer tree.close();
+
+    var stats: Stats = .{};
+    try assemble(tree, .target(), &stats);
+    log.debug("{s}: reflinked {d}, copied {d} files", .{
+        p.package,
+        stats.reflinked,
+        stats.copied,
+    });
+}
+
+fn open(path: []const u8) !void {
+    var dir = try std.fs.cwd().makeOpenPath(path, .{});
+    errdefer dir.close();
+    const real_path = try dir.realpathAlloc(gpa, ".");
+    defer gpa.free(real_path);
+    store_path = try gpa.dupeZ(u8, real_path);
+    store = dir;
+}
+
+export fn package_store_init(path: ?[*:0]const u8) c_int {
+    open(mem.span(path.?)) catch |err| {
+        c.log_text(c.DI_LOG_LEVEL_WARNING, "Failed to open package store %s: %s", path, @errorName(err).ptr);
+        return -1;
+    };
+    return 0;
+}
+
+test validDigest {
+    try std.testing.expect(validDigest("e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855"));
+    try std.testing.expect(!validDigest("../../etc"));
+    try std.testing.expect(!validDigest("e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b85/"));
+}
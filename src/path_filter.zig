@@ -0,0 +1,238 @@
+//! Path filters, modelled after the dpkg --path-exclude and --path-include
+//! options.
+//!
+//! Filters are applied in the order they were given; the last filter
+//! matching a path decides whether it is excluded.  Patterns use fnmatch(3)
+//! syntax without FNM_PATHNAME, so "*" also matches "/", just like dpkg.
+
+const std = @import("std");
+const mem = std.mem;
+const log = std.log.scoped(.path_filter);
+const c = @import("c");
+const tar_stream = @import("tar_stream.zig");
+
+const gpa = std.heap.c_allocator;
+
+/// Name of the dpkg configuration fragment written into the target.
+const dpkg_config_name = "cdebootstrap-path-filter";
+
+pub const Kind = enum {
+    exclude,
+    include,
+};
+
+pub const Rule = struct {
+    kind: Kind,
+    pattern: []const u8,
+};
+
+pub const Filter = struct {
+    rules: []const Rule,
+
+    /// Returns whether the absolute `path` is excluded.
+    pub fn excludes(filter: Filter, path: []const u8) bool {
+        var excluded = false;
+        for (filter.rules) |rule| {
+            if (match(rule.pattern, path)) excluded = rule.kind == .exclude;
+        }
+        return excluded;
+    }
+
+    /// Returns whether the archive entry is to be dropped.  Hard links to
+    /// an excluded file are dropped as well, as they can't be created.
+    pub fn excludesEntry(filter: Filter, entry: tar_stream.Entry) bool {
+        var buf: [std.fs.max_path_bytes]u8 = undefined;
+        const path = tar_stream.normalizePath(&buf, entry.name) catch return false;
+        if (path.len == 1) return false;
+        if (filter.excludes(path)) return true;
+        if (entry.kind == .hard_link) {
+            const target = tar_stream.normalizePath(&buf, entry.link_name) catch return false;
+            return filter.excludes(target);
+        }
+        return false;
+    }
+
+    /// Copies the tar archive from `reader` to `writer`, dropping all
+    /// entries excluded by the filter.
+    pub fn streamTar(filter: Filter, reader: *std.Io.Reader, writer: *std.Io.Writer) !void {
+        var it: tar_stream.Iterator = .init(gpa, reader);
+        defer it.deinit();
+
+        var skipped: usize = 0;
+        while (try it.next()) |entry| {
+            if (entry.kind != .pax_global and filter.excludesEntry(entry)) {
+                skipped += 1;
+                continue;
+            }
+            try writer.writeAll(entry.header);
+            try it.streamData(writer);
+        }
+        try tar_stream.finish(writer);
+        log.debug("skipped {d} excluded entries", .{skipped});
+    }
+};
+
+var rules: std.ArrayList(Rule) = .empty;
+
+/// Returns the configured filter.
+pub fn get() Filter {
+    return .{ .rules = rules.items };
+}
+
+/// Returns whether any filter is configured.
+pub fn active() bool {
+    return rules.items.len > 0;
+}
+
+/// Matches `name` against the fnmatch(3) style `pattern`.
+pub fn match(pattern: []const u8, name: []const u8) bool {
+    var p: usize = 0;
+    var n: usize = 0;
+    // Position after the last "*" and the name position it matched up to.
+    var star: ?usize = null;
+    var star_n: usize = 0;
+
+    while (n < name.len) {
+        if (p < pattern.len) {
+            switch (pattern[p]) {
+                '*' => {
+                    p += 1;
+                    star = p;
+                    star_n = n;
+                    continue;
+                },
+                '?' => {
+                    p += 1;
+                    n += 1;
+                    continue;
+                },
+                '[' => if (matchBracket(pattern[p..], name[n])) |len| {
+                    p += len;
+                    n += 1;
+                    continue;
+                },
+                '\\' => if (p + 1 < pattern.len and pattern[p + 1] == name[n]) {
+                    p += 2;
+                    n += 1;
+                    continue;
+                },
+                else => |ch| if (ch == name[n]) {
+                    p += 1;
+                    n += 1;
+                    continue;
+                },
+            }
+        }
+        // Mismatch, let the last "*" consume one more character.
+        if (star) |s| {
+            star_n += 1;
+            p = s;
+            n = star_n;
+            continue;
+        }
+        return false;
+    }
+
+    while (p < pattern.len and pattern[p] == '*') p += 1;
+    return p == pattern.len;
+}
+
+/// Matches `ch` against the bracket expression at the start of `pattern`.
+/// Returns the length of the expression if it matches.
+fn matchBracket(pattern: []const u8, ch: u8) ?usize {
+    var i: usize = 1;
+    const negate = i < pattern.len and (pattern[i] == '!' or pattern[i] == '^');
+    if (negate) i += 1;
+
+    const start = i;
+    var matched = false;
+    while (i < pattern.len) : (i += 1) {
+        if (pattern[i] == ']' and i > start)
+            return if (matched != negate) i + 1 else null;
+
+        var low = pattern[i];
+        if (low == '\\' and i + 1 < pattern.len) {
+            i += 1;
+            low = pattern[i];
+        }
+        var high = low;
+        if (i + 2 < pattern.len and pattern[i + 1] == '-' and pattern[i + 2] != ']') {
+            high = pattern[i + 2];
+            i += 2;
+        }
+        if (low <= ch and ch <= high) matched = true;
+    }
+
+    // Without closing bracket the "[" is taken literally.
+    return if (ch == '[') 1 else null;
+}
+
+export fn path_filter_add(kind: c.enum_path_filter_type, pattern: ?[*:0]const u8) c_int {
+    const pattern_slice = mem.span(pattern.?);
+    if (pattern_slice.len == 0 or pattern_slice[0] != '/') return -1;
+
+    rules.append(gpa, .{
+        .kind = switch (kind) {
+            c.PATH_FILTER_EXCLUDE => .exclude,
+            c.PATH_FILTER_INCLUDE => .include,
+            else => return -1,
+        },
+        .pattern = pattern_slice,
+    }) catch return -1;
+    return 0;
+}
+
+fn writeDpkgConfig() !void {
+    var buf: [std.fs.max_path_bytes]u8 = undefined;
+    const path = try std.fmt.bufPrint(&buf, "{s}/etc/dpkg/dpkg.cfg.d", .{c.target_root});
+
+    var dir = try std.fs.cwd().makeOpenPath(path, .{});
+    defer dir.close();
+
+    var file = try dir.createFile(dpkg_config_name, .{});
+    defer file.close();
+
+    var write_buf: [1024]u8 = undefined;
+    var file_writer = file.writer(&write_buf);
+    const writer = &file_writer.interface;
+    try writer.writeAll("# Path filters used by cdebootstrap\n");
+    for (rules.items) |rule| {
+        try writer.print("path-{t}={s}\n", .{ rule.kind, rule.pattern });
+    }
+    try writer.flush();
+}
+
+export fn path_filter_install() c_int {
+    if (!active()) return 0;
+
+    writeDpkgConfig() catch |err| {
+        c.log_text(c.DI_LOG_LEVEL_WARNING, "Failed to write dpkg path filters: %s", @errorName(err).ptr);
+        return -1;
+    };
+    return 0;
+}
+
+test match {
+    try std.testing.expect(match("/usr/share/doc/*", "/usr/share/doc/bash/copyright"));
+    try std.testing.expect(match("/usr/share/doc/*/copyright", "/usr/share/doc/bash/copyright"));
+    try std.testing.expect(!match("/usr/share/doc/*/copyright", "/usr/share/doc/bash/README"));
+    try std.testing.expect(match("/usr/share/locale/*", "/usr/share/locale/de/LC_MESSAGES/dpkg.mo"));
+    try std.testing.expect(!match("/usr/share/locale/*", "/usr/share/locale"));
+    try std.testing.expect(match("/usr/share/man/??/*", "/usr/share/man/de/man1/ls.1.gz"));
+    try std.testing.expect(match("/usr/share/man/[a-z][a-z]_*", "/usr/share/man/pt_BR"));
+    try std.testing.expect(!match("/usr/share/man/[!a-z]*", "/usr/share/man/de"));
+    try std.testing.expect(match("/a\\*b", "/a*b"));
+    try std.testing.expect(!match("/a\\*b", "/axb"));
+    try std.testing.expect(match("/a[b", "/a[b"));
+    try std.testing.expect(match("*", ""));
+}
+
+test Filter {
+    const filter: Filter = .{ .rules = &.{
+        .{ .kind = .exclude, .pattern = "/usr/share/doc/*" },
+        .{ .kind = .include, .pattern = "/usr/share/doc/*/copyright" },
+    } };
+    try std.testing.expect(filter.excludes("/usr/share/doc/bash/README"));
+    try std.testing.expect(!filter.excludes("/usr/share/doc/bash/copyright"));
+    try std.testing.expect(!filter.excludes("/usr/bin/bash"));
+}
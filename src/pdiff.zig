@@ -0,0 +1,381 @@
+//! Incremental updates of the Packages index.
+//!
+//! Packages.diff/Index lists the SHA256 of previous versions of Packages,
+//! together with ed style patches, as written by "diff --ed", from these
+//! versions to the current one.  If the cached Packages file is one of
+//! them, only the patches are retrieved and applied in memory, instead of
+//! retrieving the whole index again.
+
+const std = @import("std");
+const mem = std.mem;
+const Sha256 = std.crypto.hash.sha2.Sha256;
+const log = std.log.scoped(.pdiff);
+const c = @import("c");
+
+const gpa = std.heap.c_allocator;
+
+const Hex = [2 * Sha256.digest_length]u8;
+
+fn hexDigest(data: []const u8) Hex {
+    var digest: [Sha256.digest_length]u8 = undefined;
+    Sha256.hash(data, &digest, .{});
+    return std.fmt.bytesToHex(digest, .lower);
+}
+
+/// File entry of the diff index.
+const Entry = struct {
+    sha256: []const u8,
+    size: u64,
+    name: []const u8,
+};
+
+const Index = struct {
+    current: ?Entry = null,
+    /// Versions, oldest first, each with the name of its patch.
+    history: std.ArrayList(Entry) = .empty,
+    /// Checksums of the uncompressed patches.
+    patches: std.ArrayList(Entry) = .empty,
+    /// Checksums of the compressed patches.
+    download: std.ArrayList(Entry) = .empty,
+    /// Every patch leads to the current version directly, instead of to
+    /// the next one in the history.
+    merged: bool = false,
+
+    fn deinit(index: *Index, allocator: mem.Allocator) void {
+        index.history.deinit(allocator);
+        index.patches.deinit(allocator);
+        index.download.deinit(allocator);
+    }
+
+    fn find(list: []const Entry, name: []const u8) ?Entry {
+        for (list) |e| if (mem.eql(u8, e.name, name)) return e;
+        return null;
+    }
+};
+
+fn parseEntry(line: []const u8) !Entry {
+    var it = mem.tokenizeAny(u8, line, " \t\r");
+    const sha256 = it.next() orelse return error.InvalidIndex;
+    const size = it.next() orelse return error.InvalidIndex;
+    return .{
+        .sha256 = sha256,
+        .size = std.fmt.parseInt(u64, size, 10) catch return error.InvalidIndex,
+        .name = it.next() orelse "",
+    };
+}
+
+/// Parses Packages.diff/Index, the entries point into `data`.
+fn parseIndex(allocator: mem.Allocator, data: []const u8) !Index {
+    var index: Index = .{};
+    errdefer index.deinit(allocator);
+
+    var list: ?*std.ArrayList(Entry) = null;
+    var lines = mem.splitScalar(u8, data, '\n');
+    while (lines.next()) |line| {
+        if (line.len == 0) continue;
+        if (line[0] == ' ' or line[0] == '\t') {
+            if (list) |l| try l.append(allocator, try parseEntry(line));
+            continue;
+        }
+
+        const colon = mem.indexOfScalar(u8, line, ':') orelse return error.InvalidIndex;
+        const field = line[0..colon];
+        const value = mem.trim(u8, line[colon + 1 ..], " \t\r");
+        list = null;
+        if (std.ascii.eqlIgnoreCase(field, "SHA256-Current")) {
+            index.current = try parseEntry(value);
+        } else if (std.ascii.eqlIgnoreCase(field, "SHA256-History")) {
+            list = &index.history;
+        } else if (std.ascii.eqlIgnoreCase(field, "SHA256-Patches")) {
+            list = &index.patches;
+        } else if (std.ascii.eqlIgnoreCase(field, "SHA256-Download")) {
+            list = &index.download;
+        } else if (std.ascii.eqlIgnoreCase(field, "X-Patch-Precedence")) {
+            index.merged = std.ascii.eqlIgnoreCase(value, "merged");
+        }
+    }
+    return index;
+}
+
+const Command = struct {
+    kind: enum { append, change, delete },
+    first: usize,
+    last: usize,
+    /// Lines to insert, including the final newline.
+    text: []const u8,
+};
+
+/// Returns the offset after `count` more lines of `data`.
+fn skipLines(data: []const u8, pos: usize, count: usize) !usize {
+    var p = pos;
+    for (0..count) |_| {
+        if (p >= data.len) return error.InvalidPatch;
+        p = if (mem.indexOfScalarPos(u8, data, p, '\n')) |end| end + 1 else data.len;
+    }
+    return p;
+}
+
+fn parseLine(s: []const u8) !usize {
+    return std.fmt.parseInt(usize, s, 10) catch return error.InvalidPatch;
+}
+
+/// Applies an ed script to `input`.  The commands of such a script are
+/// sorted by descending line numbers, so all of them refer to lines of
+/// the original input, which is copied once in ascending order.
+fn applyPatch(allocator: mem.Allocator, input: []const u8, patch: []const u8) ![]u8 {
+    var commands: std.ArrayList(Command) = .empty;
+    defer commands.deinit(allocator);
+
+    var pos: usize = 0;
+    while (pos < patch.len) {
+        const end = mem.indexOfScalarPos(u8, patch, pos, '\n') orelse return error.InvalidPatch;
+        const line = patch[pos..end];
+        pos = end + 1;
+        if (line.len < 2) return error.InvalidPatch;
+
+        var command: Command = .{
+            .kind = switch (line[line.len - 1]) {
+                'a' => .append,
+                'c' => .change,
+                'd' => .delete,
+                else => return error.InvalidPatch,
+            },
+            .first = undefined,
+            .last = undefined,
+            .text = "",
+        };
+        const range = line[0 .. line.len - 1];
+        if (mem.indexOfScalar(u8, range, ',')) |comma| {
+            command.first = try parseLine(range[0..comma]);
+            command.last = try parseLine(range[comma + 1 ..]);
+        } else {
+            command.first = try parseLine(range);
+            command.last = command.first;
+        }
+        if (command.first > command.last) return error.InvalidPatch;
+        if (command.kind != .append and command.first == 0) return error.InvalidPatch;
+
+        if (command.kind != .delete) {
+            const start = pos;
+            while (true) {
+                const text_end = mem.indexOfScalarPos(u8, patch, pos, '\n') orelse return error.InvalidPatch;
+                if (mem.eql(u8, patch[pos..text_end], ".")) {
+                    command.text = patch[start..pos];
+                    pos = text_end + 1;
+                    break;
+                }
+                pos = text_end + 1;
+            }
+        }
+        try commands.append(allocator, command);
+    }
+
+    var out: std.ArrayList(u8) = try .initCapacity(allocator, input.len + patch.len);
+    errdefer out.deinit(allocator);
+
+    var in_pos: usize = 0;
+    // Lines of the input consumed so far.
+    var line: usize = 0;
+    var i = commands.items.len;
+    while (i > 0) {
+        i -= 1;
+        const command = commands.items[i];
+        const keep = if (command.kind == .append) command.first else command.first - 1;
+        if (keep < line) return error.InvalidPatch;
+
+        const start = in_pos;
+        in_pos = try skipLines(input, in_pos, keep - line);
+        try out.appendSlice(allocator, input[start..in_pos]);
+        line = keep;
+
+        if (command.kind != .append) {
+            in_pos = try skipLines(input, in_pos, command.last - line);
+            line = command.last;
+        }
+        try out.appendSlice(allocator, command.text);
+    }
+    try out.appendSlice(allocator, input[in_pos..]);
+    return out.toOwnedSlice(allocator);
+}
+
+fn readFile(path: []const u8) ![]u8 {
+    var file = try std.fs.cwd().openFile(path, .{});
+    defer file.close();
+    var buf: [64 * 1024]u8 = undefined;
+    var reader = file.reader(&buf);
+    return reader.interface.allocRemaining(gpa, .unlimited);
+}
+
+fn lookup(rel: *c.di_release, file: []const u8) ?*c.di_release_file {
+    var buf: [128]u8 = undefined;
+    const name = std.fmt.bufPrint(&buf, "main/binary-{s}/{s}", .{ c.arch, file }) catch return null;
+    const key: c.di_rstring = .{
+        .size = @intCast(name.len),
+        .string = name.ptr,
+    };
+    const item: ?*c.di_release_file = @ptrCast(@alignCast(c.di_hash_table_lookup(rel.sha256, &key)));
+    if (item == null or item.?.sum[1] == null) return null;
+    return item;
+}
+
+/// Locations of the diff directory on the mirror and in the cache.
+const Location = struct {
+    source: []const u8,
+    target: []const u8,
+
+    /// Retrieves `name` from the diff directory and returns its content,
+    /// after checking it against `sha256`.
+    fn retrieve(loc: Location, name: []const u8, sha256: []const u8) ![]u8 {
+        var source_buf: [512]u8 = undefined;
+        var target_buf: [std.fs.max_path_bytes]u8 = undefined;
+        const source = try std.fmt.bufPrintZ(&source_buf, "{s}{s}", .{ loc.source, name });
+        const target = try std.fmt.bufPrintZ(&target_buf, "{s}{s}", .{ loc.target, name });
+        defer std.fs.cwd().deleteFile(target) catch {};
+
+        c.log_message(c.LOG_MESSAGE_INFO_DOWNLOAD_RETRIEVE, source.ptr);
+        if (c.frontend_download(source.ptr, target.ptr) != 0) return error.DownloadFailed;
+
+        const data = try readFile(target);
+        errdefer gpa.free(data);
+        if (!mem.eql(u8, &hexDigest(data), sha256)) return error.ChecksumMismatch;
+        return data;
+    }
+
+    /// Retrieves a compressed patch and returns it uncompressed.
+    fn retrievePatch(loc: Location, index: *const Index, name: []const u8) ![]u8 {
+        var name_buf: [256]u8 = undefined;
+        const name_gz = try std.fmt.bufPrint(&name_buf, "{s}.gz", .{name});
+        const download = Index.find(index.download.items, name_gz) orelse return error.MissingChecksum;
+        const expected = Index.find(index.patches.items, name) orelse return error.MissingChecksum;
+
+        const compressed = try loc.retrieve(name_gz, download.sha256);
+        defer gpa.free(compressed);
+
+        var reader: std.Io.Reader = .fixed(compressed);
+        var window: [std.compress.flate.max_window_len]u8 = undefined;
+        var decompress: std.compress.flate.Decompress = .init(&reader, .gzip, &window);
+        const patch = try decompress.reader.allocRemaining(gpa, .unlimited);
+        errdefer gpa.free(patch);
+        if (!mem.eql(u8, &hexDigest(patch), expected.sha256)) return error.ChecksumMismatch;
+        return patch;
+    }
+};
+
+fn update(target: []const u8, loc: Location, rel: *c.di_release) !void {
+    const current = lookup(rel, "Packages") orelse return error.MissingChecksum;
+    const index_item = lookup(rel, "Packages.diff/Index") orelse return error.NoDiffIndex;
+
+    var data = try readFile(target);
+    defer gpa.free(data);
+    const sum = hexDigest(data);
+
+    const index_data = try loc.retrieve("Index", mem.span(index_item.sum[1]));
+    defer gpa.free(index_data);
+    var index = try parseIndex(gpa, index_data);
+    defer index.deinit(gpa);
+
+    const start = for (index.history.items, 0..) |e, i| {
+        if (mem.eql(u8, e.sha256, &sum)) break i;
+    } else return error.UnknownVersion;
+    const steps = if (index.merged) index.history.items[start .. start + 1] else index.history.items[start..];
+
+    // Not worth it, if the patches are larger than the compressed index.
+    if (lookup(rel, "Packages.xz")) |xz| {
+        var size: u64 = 0;
+        for (steps) |step| {
+            var name_buf: [256]u8 = undefined;
+            const name_gz = try std.fmt.bufPrint(&name_buf, "{s}.gz", .{step.name});
+            const download = Index.find(index.download.items, name_gz) orelse return error.MissingChecksum;
+            size += download.size;
+        }
+        if (size >= xz.size) return error.PatchesTooLarge;
+    }
+
+    for (steps) |step| {
+        const patch = try loc.retrievePatch(&index, step.name);
+        defer gpa.free(patch);
+        const next = try applyPatch(gpa, data, patch);
+        gpa.free(data);
+        data = next;
+    }
+
+    if (!mem.eql(u8, &hexDigest(data), mem.span(current.sum[1]))) return error.ChecksumMismatch;
+
+    // Written under a temporary name, so the cache is never left truncated.
+    var tmp_buf: [std.fs.max_path_bytes]u8 = undefined;
+    const tmp = try std.fmt.bufPrint(&tmp_buf, "{s}.new", .{target});
+    errdefer std.fs.cwd().deleteFile(tmp) catch {};
+    try std.fs.cwd().writeFile(.{ .sub_path = tmp, .data = data });
+    try std.fs.cwd().rename(tmp, target);
+    log.debug("applied {d} patches", .{steps.len});
+}
+
+/// Brings the outdated Packages file `target` to the version listed in
+/// `rel`.  Patches are retrieved from `source` and stored temporarily at
+/// `target_base`, both are prefixes of the file names.  Returns 0 on
+/// success.
+export fn pdiff_update(
+    target: ?[*:0]const u8,
+    source: ?[*:0]const u8,
+    target_base: ?[*:0]const u8,
+    rel: ?*c.di_release,
+) c_int {
+    const loc: Location = .{ .source = mem.span(source.?), .target = mem.span(target_base.?) };
+    update(mem.span(target.?), loc, rel.?) catch |err| {
+        c.log_text(c.DI_LOG_LEVEL_DEBUG, "Can't patch Packages file: %s", @errorName(err).ptr);
+        return -1;
+    };
+    return 0;
+}
+
+test parseIndex {
+    const data =
+        \\SHA256-Current: 1111 300
+        \\SHA256-History:
+        \\ aaaa 100 T-1
+        \\ bbbb 200 T-2
+        \\SHA256-Patches:
+        \\ cccc 10 T-1
+        \\ dddd 20 T-2
+        \\SHA256-Download:
+        \\ eeee 5 T-1.gz
+        \\ ffff 6 T-2.gz
+        \\X-Patch-Precedence: merged
+        \\
+    ;
+    var index = try parseIndex(std.testing.allocator, data);
+    defer index.deinit(std.testing.allocator);
+
+    try std.testing.expectEqual(@as(u64, 300), index.current.?.size);
+    try std.testing.expectEqual(@as(usize, 2), index.history.items.len);
+    try std.testing.expectEqualStrings("bbbb", index.history.items[1].sha256);
+    try std.testing.expectEqualStrings("T-2", index.history.items[1].name);
+    try std.testing.expectEqual(@as(u64, 6), Index.find(index.download.items, "T-2.gz").?.size);
+    try std.testing.expectEqualStrings("cccc", Index.find(index.patches.items, "T-1").?.sha256);
+    try std.testing.expect(index.merged);
+}
+
+test applyPatch {
+    const allocator = std.testing.allocator;
+    const input = "a\nb\nc\nd\ne\n";
+    const patch =
+        \\5a
+        \\f
+        \\.
+        \\3,4c
+        \\x
+        \\.
+        \\1d
+        \\0a
+        \\0
+        \\.
+        \\
+    ;
+    const result = try applyPatch(allocator, input, patch);
+    defer allocator.free(result);
+    try std.testing.expectEqualStrings("0\nb\nx\ne\nf\n", result);
+
+    try std.testing.expectError(error.InvalidPatch, applyPatch(allocator, input, "7d\n"));
+    try std.testing.expectError(error.InvalidPatch, applyPatch(allocator, input, "1d\n2d\n"));
+    try std.testing.expectError(error.InvalidPatch, applyPatch(allocator, input, "2a\nx\n"));
+}
@@ -0,0 +1,210 @@
+//! SHA256 of downloaded files.
+//!
+//! std.crypto.hash.sha2.Sha256 uses the SHA extensions of x86_64 and the
+//! SHA2 instructions of aarch64 if the target CPU has them.  Zig selects
+//! CPU features at build time, so builds for the native CPU, the default,
+//! or for a CPU with these extensions get them.  Without them, small files
+//! are hashed several at once, one per vector lane, which hashes eight
+//! messages with AVX2.
+
+const std = @import("std");
+const builtin = @import("builtin");
+const mem = std.mem;
+const assert = std.debug.assert;
+const Sha256 = std.crypto.hash.sha2.Sha256;
+
+pub const Digest = [Sha256.digest_length]u8;
+
+/// If Sha256 uses the SHA instructions of the CPU.
+pub const accelerated = switch (builtin.cpu.arch) {
+    .x86_64 => std.Target.x86.featureSetHas(builtin.cpu.features, .sha),
+    .aarch64, .aarch64_be => std.Target.aarch64.featureSetHas(builtin.cpu.features, .sha2),
+    else => false,
+};
+
+/// Messages hashed at once by hashLanes.
+pub const lanes = std.simd.suggestVectorLength(u32) orelse 1;
+
+/// If small files should be collected and hashed with hashLanes.  The SHA
+/// instructions are faster than the vector lanes.
+pub const multi_buffer = !accelerated and lanes >= 4;
+
+/// Largest file hashed with hashLanes, larger ones are read in chunks.
+pub const small_max = 256 * 1024;
+
+pub const read_size = 1024 * 1024;
+
+/// Hashes files, read with a large page aligned buffer, which is reused
+/// for all files.
+pub const FileHasher = struct {
+    buf: []align(std.heap.page_size_min) u8,
+
+    pub fn init() !FileHasher {
+        return .{
+            .buf = try std.heap.page_allocator.alignedAlloc(u8, mem.Alignment.fromByteUnits(std.heap.page_size_min), read_size),
+        };
+    }
+
+    pub fn deinit(h: *FileHasher) void {
+        std.heap.page_allocator.free(h.buf);
+    }
+
+    pub fn hash(h: *FileHasher, file: std.fs.File) !Digest {
+        var hasher: Sha256 = .init(.{});
+        while (true) {
+            const n = try file.read(h.buf);
+            if (n == 0) break;
+            hasher.update(h.buf[0..n]);
+        }
+        return hasher.finalResult();
+    }
+};
+
+const V = @Vector(lanes, u32);
+const Shift = @Vector(lanes, u5);
+
+const k = [64]u32{
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5,
+    0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+    0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc,
+    0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7,
+    0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+    0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3,
+    0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5,
+    0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+    0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+const iv = [8]u32{
+    0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+    0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19,
+};
+
+fn rotr(x: V, comptime n: comptime_int) V {
+    const r: Shift = @splat(n);
+    const l: Shift = @splat(32 - n);
+    return (x >> r) | (x << l);
+}
+
+fn shr(x: V, comptime n: comptime_int) V {
+    const r: Shift = @splat(n);
+    return x >> r;
+}
+
+/// Message of one lane, the full blocks are read in place, the padded
+/// rest is copied.
+const Lane = struct {
+    data: []const u8,
+    full: usize,
+    blocks: usize,
+    tail: [128]u8,
+
+    fn init(lane: *Lane, data: []const u8) void {
+        lane.data = data;
+        lane.full = data.len / 64;
+        const rest = data[lane.full * 64 ..];
+        const tail_blocks: usize = if (rest.len + 9 <= 64) 1 else 2;
+        lane.blocks = lane.full + tail_blocks;
+
+        @memset(&lane.tail, 0);
+        @memcpy(lane.tail[0..rest.len], rest);
+        lane.tail[rest.len] = 0x80;
+        mem.writeInt(u64, lane.tail[tail_blocks * 64 - 8 ..][0..8], @as(u64, data.len) * 8, .big);
+    }
+
+    fn block(lane: *const Lane, i: usize) *const [64]u8 {
+        if (i < lane.full) return lane.data[i * 64 ..][0..64];
+        return lane.tail[(i - lane.full) * 64 ..][0..64];
+    }
+};
+
+/// Hashes up to `lanes` messages at once.  Shorter messages are done
+/// earlier, their state is kept while the others continue.
+pub fn hashLanes(data: []const []const u8, out: []Digest) void {
+    assert(data.len <= lanes and out.len == data.len);
+
+    var lane: [lanes]Lane = undefined;
+    var max_blocks: usize = 0;
+    for (data, 0..) |d, l| {
+        lane[l].init(d);
+        max_blocks = @max(max_blocks, lane[l].blocks);
+    }
+
+    var state: [8]V = undefined;
+    for (&state, iv) |*s, v| s.* = @splat(v);
+
+    for (0..max_blocks) |b| {
+        var active: [lanes]bool = [_]bool{false} ** lanes;
+        var w: [64]V = undefined;
+        for (0..16) |t| {
+            var words: [lanes]u32 = [_]u32{0} ** lanes;
+            for (0..data.len) |l| {
+                if (b >= lane[l].blocks) continue;
+                words[l] = mem.readInt(u32, lane[l].block(b)[t * 4 ..][0..4], .big);
+            }
+            w[t] = words;
+        }
+        for (0..data.len) |l| active[l] = b < lane[l].blocks;
+        for (16..64) |t| {
+            const s0 = rotr(w[t - 15], 7) ^ rotr(w[t - 15], 18) ^ shr(w[t - 15], 3);
+            const s1 = rotr(w[t - 2], 17) ^ rotr(w[t - 2], 19) ^ shr(w[t - 2], 10);
+            w[t] = w[t - 16] +% s0 +% w[t - 7] +% s1;
+        }
+
+        var v = state;
+        for (0..64) |t| {
+            const s1 = rotr(v[4], 6) ^ rotr(v[4], 11) ^ rotr(v[4], 25);
+            const ch = (v[4] & v[5]) ^ (~v[4] & v[6]);
+            const kt: V = @splat(k[t]);
+            const t1 = v[7] +% s1 +% ch +% kt +% w[t];
+            const s0 = rotr(v[0], 2) ^ rotr(v[0], 13) ^ rotr(v[0], 22);
+            const maj = (v[0] & v[1]) ^ (v[0] & v[2]) ^ (v[1] & v[2]);
+            const t2 = s0 +% maj;
+            v[7] = v[6];
+            v[6] = v[5];
+            v[5] = v[4];
+            v[4] = v[3] +% t1;
+            v[3] = v[2];
+            v[2] = v[1];
+            v[1] = v[0];
+            v[0] = t1 +% t2;
+        }
+
+        const mask: @Vector(lanes, bool) = active;
+        for (&state, v) |*s, x| s.* = @select(u32, mask, s.* +% x, s.*);
+    }
+
+    for (out, 0..) |*digest, l| {
+        for (0..8) |i| mem.writeInt(u32, digest[i * 4 ..][0..4], state[i][l], .big);
+    }
+}
+
+test hashLanes {
+    var prng: std.Random.DefaultPrng = .init(0);
+    var buf: [4096]u8 = undefined;
+    prng.random().bytes(&buf);
+
+    // Lengths around the padding boundaries, of different block counts.
+    const lengths = [_]usize{ 0, 1, 55, 56, 63, 64, 65, 119, 120, 128, 1000, 4096 };
+    var start: usize = 0;
+    while (start < lengths.len) : (start += lanes) {
+        const end = @min(start + lanes, lengths.len);
+        var data: [lanes][]const u8 = undefined;
+        var out: [lanes]Digest = undefined;
+        for (lengths[start..end], 0..) |len, l| data[l] = buf[0..len];
+        hashLanes(data[0 .. end - start], out[0 .. end - start]);
+
+        for (data[0 .. end - start], out[0 .. end - start]) |d, digest| {
+            var expected: Digest = undefined;
+            Sha256.hash(d, &expected, .{});
+            try std.testing.expectEqualSlices(u8, &expected, &digest);
+        }
+    }
+}
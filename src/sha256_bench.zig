@@ -0,0 +1,45 @@
+//! Throughput of the SHA256 implementations of sha256.zig, run with
+//! "zig build bench".
+
+const std = @import("std");
+const sha256 = @import("sha256.zig");
+
+const total = 256 * 1024 * 1024;
+
+fn report(name: []const u8, bytes: usize, ns: u64) void {
+    const gbps = @as(f64, @floatFromInt(bytes)) / @as(f64, @floatFromInt(@max(ns, 1)));
+    std.debug.print("{s}: {d:.2} GB/s\n", .{ name, gbps });
+}
+
+pub fn main() !void {
+    const gpa = std.heap.page_allocator;
+    const data = try gpa.alloc(u8, total);
+    defer gpa.free(data);
+    var prng: std.Random.DefaultPrng = .init(0);
+    prng.random().bytes(data);
+
+    std.debug.print("SHA instructions: {}, lanes: {d}, multi-buffer: {}\n", .{
+        sha256.accelerated,
+        sha256.lanes,
+        sha256.multi_buffer,
+    });
+
+    var timer: std.time.Timer = try .start();
+    var digest: sha256.Digest = undefined;
+    std.crypto.hash.sha2.Sha256.hash(data, &digest, .{});
+    std.mem.doNotOptimizeAway(&digest);
+    report("single buffer", total, timer.read());
+
+    // Many small files, as in the package cache.
+    const size = 64 * 1024;
+    var messages: [sha256.lanes][]const u8 = undefined;
+    var digests: [sha256.lanes]sha256.Digest = undefined;
+    timer.reset();
+    var pos: usize = 0;
+    while (pos + size * sha256.lanes <= total) : (pos += size * sha256.lanes) {
+        for (&messages, 0..) |*m, l| m.* = data[pos + l * size ..][0..size];
+        sha256.hashLanes(&messages, &digests);
+        std.mem.doNotOptimizeAway(&digests);
+    }
+    report("multi buffer", pos, timer.read());
+}
@@ -0,0 +1,216 @@
+//! Cache of the target after the essential stages.
+//!
+//! The tree produced by the actions before "install" only depends on the
+//! essential packages, the actions themselves and the helper packages they
+//! install.  After these stages the target is saved as tarball, keyed by a
+//! hash over these, the suite config, the flavour and the version of
+//! cdebootstrap, and restored by later bootstraps of the same set instead
+//! of running the actions.
+
+const std = @import("std");
+const mem = std.mem;
+const Sha256 = std.crypto.hash.sha2.Sha256;
+const log = std.log.scoped(.stage_cache);
+const c = @import("c");
+const path_filter = @import("path_filter.zig");
+const sha256 = @import("sha256.zig");
+
+const gpa = std.heap.c_allocator;
+
+extern const execute_io_log_handler: fn (file: ?*c.FILE, user_data: ?*anyopaque) callconv(.c) void;
+
+/// Changed whenever the hashed input or the snapshot format changes.
+const key_version = "2";
+
+const Key = [2 * Sha256.digest_length]u8;
+
+var cache_dir: ?std.fs.Dir = null;
+/// Absolute path of the cache, passed to tar.
+var cache_path: [:0]const u8 = "";
+var key: ?Key = null;
+
+fn updateString(hasher: *Sha256, s: [*c]const u8) void {
+    if (s != null) hasher.update(mem.span(s));
+    hasher.update("\x00");
+}
+
+/// Hashes the name and the content of a file.
+fn updateFile(hasher: *Sha256, file_hasher: *sha256.FileHasher, path: []const u8) !void {
+    var file = try std.fs.cwd().openFile(path, .{});
+    defer file.close();
+    hasher.update(path);
+    hasher.update("\x00");
+    hasher.update(&try file_hasher.hash(file));
+}
+
+/// Hashes the files of the suite config, which select the essential
+/// packages and the actions.
+fn updateSuiteConfig(hasher: *Sha256, file_hasher: *sha256.FileHasher) !void {
+    updateString(hasher, c.suite.*.name);
+    updateString(hasher, c.suite_get_flavour());
+    for ([_][]const u8{ "action", "sections", "packages" }) |name| {
+        var path_buf: [std.fs.max_path_bytes]u8 = undefined;
+        const path = try std.fmt.bufPrint(&path_buf, "{s}/{s}", .{ mem.span(c.suite.*.dir), name });
+        try updateFile(hasher, file_hasher, path);
+    }
+}
+
+/// Hashes everything the essential stages depend on.
+fn computeKey(packages: *c.struct_suite_packages) !Key {
+    var hasher: Sha256 = .init(.{});
+    var file_hasher: sha256.FileHasher = try .init();
+    defer file_hasher.deinit();
+
+    hasher.update("cdebootstrap stage cache " ++ key_version ++ "\x00");
+    updateString(&hasher, c.PACKAGE_VERSION);
+    updateString(&hasher, c.arch);
+    try updateSuiteConfig(&hasher, &file_hasher);
+    hasher.update("\n");
+
+    var node: ?*c.di_slist_node = packages.essential_include.*.head;
+    while (node) |n| : (node = n.next) {
+        const p: *c.di_package = @ptrCast(@alignCast(n.data));
+        updateString(&hasher, p.package);
+        updateString(&hasher, p.version);
+        updateString(&hasher, p.sha256);
+    }
+    hasher.update("\n");
+
+    node = c.suite.*.actions.head;
+    while (node) |n| : (node = n.next) {
+        const action: *c.suite_config_action = @ptrCast(@alignCast(n.data));
+        if (!action.activate) continue;
+        if (std.ascii.eqlIgnoreCase(mem.span(action.action), "install")) break;
+        updateString(&hasher, action.action);
+        updateString(&hasher, action.what);
+        var flags: [4]u8 = undefined;
+        mem.writeInt(u32, &flags, @intCast(action.flags), .little);
+        hasher.update(&flags);
+
+        // Helper packages are installed from the helper directory.
+        if (std.ascii.eqlIgnoreCase(mem.span(action.action), "helper-install")) {
+            var path_buf: [4096]u8 = undefined;
+            c.install_helper_file(&path_buf, path_buf.len, action.what);
+            try updateFile(&hasher, &file_hasher, mem.sliceTo(&path_buf, 0));
+        }
+    }
+    hasher.update("\n");
+
+    // Filtered paths are missing from the saved tree.
+    for (path_filter.get().rules) |rule| {
+        hasher.update(@tagName(rule.kind));
+        hasher.update("=");
+        hasher.update(rule.pattern);
+        hasher.update("\x00");
+    }
+
+    return std.fmt.bytesToHex(hasher.finalResult(), .lower);
+}
+
+fn runTar(args: []const ?[*:0]const u8) !void {
+    var argv: [16]?[*:0]const u8 = undefined;
+    const common = [_]?[*:0]const u8{ "tar", "--numeric-owner", "-C", mem.span(c.target_root).ptr };
+    @memcpy(argv[0..common.len], &common);
+    @memcpy(argv[common.len..][0..args.len], args);
+    argv[common.len + args.len] = null;
+
+    const io_info: []const c.execute_io_info = &.{
+        .{ .fd = 0, .events = 0, .handler = null, .user_data = null },
+        .{
+            .fd = 1,
+            .events = c.POLLIN,
+            .handler = execute_io_log_handler,
+            .user_data = @ptrFromInt(c.DI_LOG_LEVEL_OUTPUT),
+        },
+        .{
+            .fd = 2,
+            .events = c.POLLIN,
+            .handler = execute_io_log_handler,
+            .user_data = @ptrFromInt(c.LOG_LEVEL_OUTPUT_STDERR),
+        },
+    };
+    if (c.execute_full(&argv, io_info.ptr, @intCast(io_info.len)) != 0) return error.ExecutionFailure;
+}
+
+/// Name of the snapshot in the cache.
+fn snapshotName(buf: []u8, k: *const Key) ![]const u8 {
+    return std.fmt.bufPrint(buf, "{s}.tar", .{k});
+}
+
+fn restore(packages: *c.struct_suite_packages) !bool {
+    const dir = cache_dir orelse return false;
+    key = try computeKey(packages);
+    log.debug("key {s}", .{&key.?});
+
+    var name_buf: [128]u8 = undefined;
+    const name = try snapshotName(&name_buf, &key.?);
+    dir.access(name, .{}) catch |err| switch (err) {
+        error.FileNotFound => return false,
+        else => return err,
+    };
+
+    var path_buf: [std.fs.max_path_bytes]u8 = undefined;
+    const path = try std.fmt.bufPrintZ(&path_buf, "{s}/{s}", .{ cache_path, name });
+    try runTar(&.{ "-x", "-p", "-f", path.ptr });
+    return true;
+}
+
+fn save() !void {
+    const dir = cache_dir orelse return;
+    const k = key orelse return;
+
+    // Written under a temporary name, so only complete snapshots are found.
+    var tmp_buf: [128]u8 = undefined;
+    const tmp_name = try std.fmt.bufPrint(&tmp_buf, ".{s}.{d}", .{ &k, std.os.linux.getpid() });
+    errdefer dir.deleteFile(tmp_name) catch {};
+
+    var path_buf: [std.fs.max_path_bytes]u8 = undefined;
+    const tmp_path = try std.fmt.bufPrintZ(&path_buf, "{s}/{s}", .{ cache_path, tmp_name });
+    // Mounts, like /proc, and the downloaded packages are left out.
+    try runTar(&.{
+        "-c",
+        "--one-file-system",
+        "--exclude=./proc/*",
+        "--exclude=./var/cache/bootstrap/*",
+        "-f",
+        tmp_path.ptr,
+        ".",
+    });
+
+    var name_buf: [128]u8 = undefined;
+    try dir.rename(tmp_name, try snapshotName(&name_buf, &k));
+    log.debug("saved {s}", .{&k});
+}
+
+fn open(path: []const u8) !void {
+    var dir = try std.fs.cwd().makeOpenPath(path, .{});
+    errdefer dir.close();
+    const real_path = try dir.realpathAlloc(gpa, ".");
+    defer gpa.free(real_path);
+    cache_path = try gpa.dupeZ(u8, real_path);
+    cache_dir = dir;
+}
+
+export fn stage_cache_init(path: ?[*:0]const u8) c_int {
+    open(mem.span(path.?)) catch |err| {
+        c.log_text(c.DI_LOG_LEVEL_WARNING, "Failed to open stage cache %s: %s", path, @errorName(err).ptr);
+        return -1;
+    };
+    return 0;
+}
+
+/// Returns 1 if the target was restored from the cache, 0 otherwise.
+export fn stage_cache_restore(packages: ?*c.struct_suite_packages) c_int {
+    const restored = restore(packages.?) catch |err| {
+        c.log_text(c.DI_LOG_LEVEL_WARNING, "Failed to restore stage cache: %s", @errorName(err).ptr);
+        return 0;
+    };
+    if (restored) c.log_text(c.DI_LOG_LEVEL_INFO, "Restored essential stages from cache");
+    return @intFromBool(restored);
+}
+
+export fn stage_cache_save() void {
+    save() catch |err| {
+        c.log_text(c.DI_LOG_LEVEL_WARNING, "Failed to save stage cache: %s", @errorName(err).ptr);
+    };
+}
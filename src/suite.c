@@ -123,4 +123,9 @@ int suite_select (const di_release *release)
   return 0;
 }
 
+const char *suite_get_flavour (void)
+{
+  return flavour;
+}
+
 
@@ -24,6 +24,8 @@
 #include "frontend.h"
 #include "install.h"
 #include "package.h"
+#include "path_filter.h"
+#include "stage_cache.h"
 #include "suite.h"
 #include "suite_action.h"
 #include "suite_config.h"
@@ -35,6 +37,9 @@ static int action_install(
     int _data __attribute__((unused)),
     struct suite_packages *packages)
 {
+  if (path_filter_install())
+    return 1;
+
   return install_apt_install(packages->packages,
      packages->edge_include, packages->edge_exclude);
 }
@@ -68,6 +73,9 @@ static int action_install_essential(
         di_slist *list = NULL;
         int ret = 0;
 
+        if (path_filter_install())
+          return 1;
+
         if (action->what)
         {
           di_package_priority priority = di_package_priority_text_from(action->what);
@@ -179,6 +187,12 @@ suite_install_actions[] =
 
 int suite_action(struct suite_packages *packages)
 {
+  /* Everything before the first install action is the essential stage,
+   * which is saved to or restored from the stage cache.  Mounts are not
+   * part of the snapshot and are always done. */
+  bool cached = stage_cache_restore(packages);
+  bool essential = true;
+
   for (di_slist_node *node = suite->actions.head; node; node = node->next)
   {
     suite_config_action *e = node->data;
@@ -186,6 +200,19 @@ int suite_action(struct suite_packages *packages)
     if (!e->activate)
       continue;
 
+    if (essential && !strcasecmp(e->action, "install"))
+    {
+      essential = false;
+      if (!cached)
+        stage_cache_save();
+    }
+
+    if (cached && essential && strcasecmp(e->action, "mount"))
+    {
+      log_text(DI_LOG_LEVEL_DEBUG, "skip cached action: %s", e->action);
+      continue;
+    }
+
     for (struct suite_install_actions *action = suite_install_actions; action->name; action++)
     {
       if (!strcasecmp(action->name, e->action))
@@ -194,7 +221,10 @@ int suite_action(struct suite_packages *packages)
         {
           log_text(DI_LOG_LEVEL_DEBUG, "call action: %s (what: %s, flags: %x)", e->action, e->what, e->flags);
           if (action->action(e, action->data, packages))
+          {
+            install_list_cache_free();
             return 1;
+          }
         }
         else
           log_text(DI_LOG_LEVEL_WARNING, "Unknown action: %s", e->action);
@@ -203,6 +233,10 @@ int suite_action(struct suite_packages *packages)
     }
   }
 
+  if (essential && !cached)
+    stage_cache_save();
+
+  install_list_cache_free();
   return 0;
 }
 
@@ -393,6 +393,7 @@ static suite_config *suite_config_read (const char *name)
 
   config = suite_config_alloc ();
   config->name = strdup (name);
+  config->dir = strdup (dir);
 
   if (suite_config_read_one (config, dir, "action", suite_config_action_fieldinfo, suite_config_action_new, suite_config_action_finish))
     goto error;
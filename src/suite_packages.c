@@ -28,6 +28,7 @@
 #include <debian-installer.h>
 
 static di_slist *include, *exclude;
+static bool choose_smallest;
 
 void suite_packages_init(di_slist *_include, di_slist *_exclude)
 {
@@ -35,20 +36,62 @@ void suite_packages_init(di_slist *_include, di_slist *_exclude)
   exclude = _exclude;
 }
 
-static int suite_packages_list_cmp(const void *key1, const void *key2)
+void suite_packages_choose_smallest(void)
 {
-  if (key1 < key2)
-    return -1;
-  else if (key1 > key2)
-    return 1;
-  return 0;
+  choose_smallest = true;
 }
 
-static void suite_packages_list_add(di_packages *packages, di_tree *tree, const char *name)
+/* Sets of packages are bitsets over the IDs of the package index. */
+typedef uint64_t suite_packages_set_word;
+
+#define SUITE_PACKAGES_SET_BITS 64
+#define SUITE_PACKAGES_SET_WORDS(index) (((index)->count + SUITE_PACKAGES_SET_BITS - 1) / SUITE_PACKAGES_SET_BITS)
+
+static inline suite_packages_set_word *suite_packages_set_new(di_packages_index *index)
+{
+  return di_new0(suite_packages_set_word, SUITE_PACKAGES_SET_WORDS(index) ? SUITE_PACKAGES_SET_WORDS(index) : 1);
+}
+
+static inline void suite_packages_set_add(suite_packages_set_word *set, uint32_t id)
+{
+  set[id / SUITE_PACKAGES_SET_BITS] |= (suite_packages_set_word) 1 << (id % SUITE_PACKAGES_SET_BITS);
+}
+
+/* Adds all packages with a key of the secondary index. */
+static void suite_packages_set_add_postings(suite_packages_set_word *set, const di_packages_index_postings *postings, uint32_t key)
+{
+  uint32_t n = di_packages_index_postings_size(postings, key);
+  const uint32_t *id = n ? di_packages_index_postings_get(postings, key) : NULL;
+
+  for (uint32_t i = 0; i < n; i++)
+    suite_packages_set_add(set, id[i]);
+}
+
+/* Calls func for every package in the set, in ID order. */
+static void suite_packages_set_foreach(di_packages_index *index, const suite_packages_set_word *set, void (*func)(di_package *p, void *user_data), void *user_data)
+{
+  for (size_t i = 0; i < SUITE_PACKAGES_SET_WORDS(index); i++)
+    for (suite_packages_set_word word = set[i]; word; word &= word - 1)
+      func(index->package[i * SUITE_PACKAGES_SET_BITS + __builtin_ctzll(word)], user_data);
+}
+
+static void suite_packages_set_append(di_package *p, void *user_data)
+{
+  di_slist_append(user_data, p);
+}
+
+static di_slist *suite_packages_set_list(di_packages_index *index, const suite_packages_set_word *set)
+{
+  di_slist *list = di_slist_alloc();
+  suite_packages_set_foreach(index, set, suite_packages_set_append, list);
+  return list;
+}
+
+static void suite_packages_list_add(di_packages *packages, suite_packages_set_word *set, const char *name)
 {
   di_package *p = di_packages_get_package(packages, name, 0);
   if (p)
-    di_tree_insert(tree, p, p);
+    suite_packages_set_add(set, p->id);
   else
     log_text(DI_LOG_LEVEL_MESSAGE, "Can't find package %s", name);
 }
@@ -56,7 +99,7 @@ static void suite_packages_list_add(di_packages *packages, di_tree *tree, const
 struct suite_packages_list_edge_user_data
 {
   di_packages *packages;
-  di_tree *include, *exclude, *dep;
+  suite_packages_set_word *include, *exclude;
   bool select_priority_required;
   bool select_priority_important;
 };
@@ -91,68 +134,23 @@ static void suite_packages_list_edge_sections(void *key __attribute__ ((unused))
   }
 }
 
-static inline bool suite_packages_list_edge_packages_check(di_package *p, struct suite_packages_list_edge_user_data *user_data)
-{
-  if (p->section && !strcmp(p->section, "libs"))
-    return false;
-  if (p->essential)
-    return true;
-  if (user_data->select_priority_required && p->priority == di_package_priority_required)
-    return true;
-  if (user_data->select_priority_important && p->priority == di_package_priority_important)
-    return true;
-  return false;
-}
-
-static void suite_packages_list_edge_packages_dep(void *key __attribute__ ((unused)), void *data, void *_user_data)
-{
-  di_package *p = data;
-  struct suite_packages_list_edge_user_data *user_data = _user_data;
-
-  if (suite_packages_list_edge_packages_check(p, user_data))
-  {
-    for (di_slist_node *node = p->depends.head; node; node = node->next)
-    {
-      di_package_dependency *d = node->data;
-
-      if ((d->type == di_package_dependency_type_depends ||
-           d->type == di_package_dependency_type_pre_depends))
-      {
-        di_tree_insert(user_data->dep, d->ptr, d->ptr);
-      }
-    }
-  }
-}
-
-static void suite_packages_list_edge_packages_include(void *key __attribute__ ((unused)), void *data, void *_user_data)
-{
-  di_package *p = data;
-  struct suite_packages_list_edge_user_data *user_data = _user_data;
-
-  if (suite_packages_list_edge_packages_check(p, user_data) &&
-      !di_tree_lookup(user_data->dep, p) &&
-      !di_tree_lookup(user_data->exclude, p))
-  {
-    log_text(DI_LOG_LEVEL_DEBUG, "Include non-base edge package %s", p->package);
-
-    di_tree_insert(user_data->include, p, p);
-  }
-}
-
-static void suite_packages_list_edge_process(void *key __attribute__((unused)), void *data, void *user_data)
+static void suite_packages_list_edge_include(di_package *p, void *user_data __attribute__((unused)))
 {
-  di_slist_append(user_data, data);
+  log_text(DI_LOG_LEVEL_DEBUG, "Include non-base edge package %s", p->package);
 }
 
-static void suite_packages_list_edge(di_packages *packages, di_slist **include_ret, di_slist **exclude_ret)
+static void suite_packages_list_edge(di_packages *packages, di_packages_index *index, di_slist **include_ret, di_slist **exclude_ret)
 {
   struct suite_packages_list_edge_user_data user_data =
   {
     .packages = packages,
-    .include = di_tree_new(suite_packages_list_cmp),
-    .exclude = di_tree_new(suite_packages_list_cmp),
-    .dep = di_tree_new(suite_packages_list_cmp),
+    .include = suite_packages_set_new(index),
+    .exclude = suite_packages_set_new(index),
   };
+  suite_packages_set_word *select = suite_packages_set_new(index);
+  suite_packages_set_word *dep = suite_packages_set_new(index);
+  suite_packages_set_word *libs = suite_packages_set_new(index);
+  size_t words = SUITE_PACKAGES_SET_WORDS(index);
 
   di_hash_table_foreach(suite->sections, suite_packages_list_edge_sections, &user_data);
 
@@ -163,24 +161,47 @@ static void suite_packages_list_edge(di_packages *packages, di_slist **include_r
     for (di_slist_node *node = exclude->head; node; node = node->next)
       suite_packages_list_add(user_data.packages, user_data.exclude, node->data);
 
-  di_hash_table_foreach(packages->table, suite_packages_list_edge_packages_dep, &user_data);
-  di_hash_table_foreach(packages->table, suite_packages_list_edge_packages_include, &user_data);
+  /* essential or of a selected priority, but not a library */
+  suite_packages_set_add_postings(select, &index->by_essential, 1);
+  if (user_data.select_priority_required)
+    suite_packages_set_add_postings(select, &index->by_priority, di_package_priority_required);
+  if (user_data.select_priority_important)
+    suite_packages_set_add_postings(select, &index->by_priority, di_package_priority_important);
+  suite_packages_set_add_postings(libs, &index->by_section, di_packages_index_section(index, "libs"));
+
+  for (size_t i = 0; i < words; i++)
+  {
+    select[i] &= ~libs[i];
+    for (suite_packages_set_word word = select[i]; word; word &= word - 1)
+    {
+      uint32_t id = i * SUITE_PACKAGES_SET_BITS + __builtin_ctzll(word);
+      for (uint32_t e = index->edge[id]; e < index->edge[id + 1]; e++)
+        suite_packages_set_add(dep, index->edge_target[e]);
+    }
+  }
 
-  *include_ret = di_slist_alloc();
-  *exclude_ret = di_slist_alloc();
+  /* the edge packages nothing else selected depends on */
+  for (size_t i = 0; i < words; i++)
+  {
+    select[i] &= ~dep[i] & ~user_data.exclude[i];
+    user_data.include[i] |= select[i];
+  }
+  suite_packages_set_foreach(index, select, suite_packages_list_edge_include, NULL);
 
-  di_tree_foreach(user_data.include, suite_packages_list_edge_process, *include_ret);
-  di_tree_foreach(user_data.exclude, suite_packages_list_edge_process, *exclude_ret);
+  *include_ret = suite_packages_set_list(index, user_data.include);
+  *exclude_ret = suite_packages_set_list(index, user_data.exclude);
 
-  di_tree_destroy(user_data.include);
-  di_tree_destroy(user_data.exclude);
+  di_free(user_data.include);
+  di_free(user_data.exclude);
+  di_free(select);
+  di_free(dep);
+  di_free(libs);
 }
 
 struct suite_packages_list_essential_user_data
 {
   di_packages *packages;
-  di_tree *include;
-  di_slist list;
+  suite_packages_set_word *include;
 };
 
 static void suite_packages_list_essential_sections(void *key __attribute__ ((unused)), void *data, void *_user_data)
@@ -209,44 +230,97 @@ static void suite_packages_list_essential_sections(void *key __attribute__ ((unu
   }
 }
 
-static void suite_packages_list_essential_packages(void *key __attribute__ ((unused)), void *data, void *_user_data)
-{
-  di_package *p = data;
-  struct suite_packages_list_essential_user_data *user_data = _user_data;
-
-  if (p->essential)
-    /* These packages will automatically be installed */
-    di_tree_insert(user_data->include, p, p);
-}
-
-static void suite_packages_list_essential_process(void *key __attribute__ ((unused)), void *data, void *_user_data)
-{
-  struct suite_packages_list_essential_user_data *user_data = _user_data;
-  di_slist_append(&user_data->list, data);
-}
-
-static void suite_packages_list_essential(di_packages *packages, di_packages_allocator *allocator, di_slist **list)
+static void suite_packages_list_essential(di_packages *packages, di_packages_index *index, di_packages_allocator *allocator, di_slist **list)
 {
   struct suite_packages_list_essential_user_data user_data =
   {
     packages,
-    di_tree_new(suite_packages_list_cmp),
-    { NULL, NULL }
+    suite_packages_set_new(index),
   };
 
   di_hash_table_foreach(suite->sections, suite_packages_list_essential_sections, &user_data);
-  di_hash_table_foreach(packages->table, suite_packages_list_essential_packages, &user_data);
+  /* These packages will automatically be installed */
+  suite_packages_set_add_postings(user_data.include, &index->by_essential, 1);
+
+  di_slist *roots = suite_packages_set_list(index, user_data.include);
+  *list = di_packages_resolve_dependencies(packages, roots, allocator);
+
+  unsigned int count = 0;
+  unsigned long long size = 0, installed_size = 0;
+  for (di_slist_node *node = (*list)->head; node; node = node->next)
+  {
+    di_package *p = node->data;
+    count++;
+    size += p->size;
+    installed_size += (unsigned long long) p->installed_size * 1024;
+  }
+  log_text(DI_LOG_LEVEL_INFO, "Selected %u packages: %llu bytes to download, %llu bytes installed", count, size, installed_size);
+
+  di_slist_destroy(roots, NULL);
+  di_slist_free(roots);
+  di_free(user_data.include);
+}
 
-  di_tree_foreach(user_data.include, suite_packages_list_essential_process, &user_data);
+/* Copies the packages of a list into the compact packages, by name. */
+static di_slist *suite_packages_compact_list(di_packages *compact, di_packages_allocator *allocator, di_slist *list)
+{
+  di_slist *ret = di_slist_alloc();
 
-  *list = di_packages_resolve_dependencies(packages, &user_data.list, allocator);
+  for (di_slist_node *node = list->head; node; node = node->next)
+  {
+    di_package *p = node->data;
+    di_slist_append(ret, di_packages_get_package_new(compact, allocator, p->key.string, p->key.size));
+  }
 
-  di_slist_destroy(&user_data.list, NULL);
-  di_tree_destroy(user_data.include);
+  return ret;
+}
+
+/*
+ * Replaces the index of the whole archive by copies of the packages to
+ * install, which is all later steps use.  The edge packages are installed
+ * by apt and only keep their names.
+ */
+static void suite_packages_compact(struct suite_packages *packages)
+{
+  di_packages_allocator *allocator = di_packages_allocator_alloc_arena();
+  di_packages *compact = di_packages_compact(packages->packages, packages->essential_include, allocator);
+  di_slist *essential_include = suite_packages_compact_list(compact, allocator, packages->essential_include);
+  di_slist *edge_include = suite_packages_compact_list(compact, allocator, packages->edge_include);
+  di_slist *edge_exclude = suite_packages_compact_list(compact, allocator, packages->edge_exclude);
+
+  /* the nodes of resolved lists are in the allocator */
+  di_slist_free(packages->essential_include);
+  di_slist_destroy(packages->edge_include, NULL);
+  di_slist_free(packages->edge_include);
+  di_slist_destroy(packages->edge_exclude, NULL);
+  di_slist_free(packages->edge_exclude);
+  di_packages_free(packages->packages);
+  di_packages_allocator_free(packages->allocator);
+
+  packages->packages = compact;
+  packages->allocator = allocator;
+  packages->essential_include = essential_include;
+  packages->edge_include = edge_include;
+  packages->edge_exclude = edge_exclude;
+
+  di_packages_index *index = di_packages_index_build(compact);
+  if (choose_smallest)
+    di_packages_index_choose_smallest(index);
+
+  di_packages_allocator_stats stats;
+  di_packages_allocator_get_stats(allocator, &stats);
+  log_text(DI_LOG_LEVEL_DEBUG, "Compact package index: %zu bytes, %u packages",
+           stats.total, di_hash_table_size(compact->table));
 }
 
 void suite_packages_list(struct suite_packages *packages)
 {
-  suite_packages_list_essential(packages->packages, packages->allocator, &packages->essential_include);
-  suite_packages_list_edge(packages->packages, &packages->edge_include, &packages->edge_exclude);
+  /* also used by all later dependency resolution */
+  di_packages_index *index = di_packages_index_build(packages->packages);
+  if (choose_smallest)
+    di_packages_index_choose_smallest(index);
+
+  suite_packages_list_essential(packages->packages, index, packages->allocator, &packages->essential_include);
+  suite_packages_list_edge(packages->packages, index, &packages->edge_include, &packages->edge_exclude);
+  suite_packages_compact(packages);
 }
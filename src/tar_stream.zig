@@ -0,0 +1,250 @@
+//! Raw access to the entries of a tar archive stream.
+//!
+//! Unlike `tar.Iterator`, entries are returned together with the header
+//! blocks they were read from (including GNU long name and pax extended
+//! headers), so they can be passed on to another archive without being
+//! re-encoded.
+
+const std = @import("std");
+const mem = std.mem;
+
+pub const block_len = 512;
+
+/// Upper bound for the data of GNU long name and pax extended headers.
+const max_meta_len = 64 * 1024;
+
+pub const Kind = enum(u8) {
+    regular = '0',
+    hard_link = '1',
+    sym_link = '2',
+    character_device = '3',
+    block_device = '4',
+    directory = '5',
+    fifo = '6',
+    contiguous = '7',
+    pax_global = 'g',
+    _,
+};
+
+pub const Entry = struct {
+    /// All header blocks of the entry.
+    header: []const u8,
+    /// Path as stored in the archive.
+    name: []const u8,
+    link_name: []const u8,
+    kind: Kind,
+    /// Size of the entry data, without padding.
+    size: u64,
+};
+
+pub const Iterator = struct {
+    allocator: mem.Allocator,
+    reader: *std.Io.Reader,
+    header: std.ArrayList(u8) = .empty,
+    name: std.ArrayList(u8) = .empty,
+    link_name: std.ArrayList(u8) = .empty,
+    /// Not yet consumed data of the current entry, including padding.
+    unread: u64 = 0,
+
+    pub const Error = std.Io.Reader.Error || mem.Allocator.Error || error{
+        TarHeaderInvalid,
+        TarHeaderTooLong,
+        PaxInvalid,
+    };
+
+    pub fn init(allocator: mem.Allocator, reader: *std.Io.Reader) Iterator {
+        return .{ .allocator = allocator, .reader = reader };
+    }
+
+    pub fn deinit(it: *Iterator) void {
+        it.header.deinit(it.allocator);
+        it.name.deinit(it.allocator);
+        it.link_name.deinit(it.allocator);
+    }
+
+    /// Returns the next entry, or null at the end of the archive.  Data of
+    /// the previous entry not consumed via `streamData` is skipped.
+    pub fn next(it: *Iterator) Error!?Entry {
+        try it.reader.discardAll64(it.unread);
+        it.unread = 0;
+        it.header.clearRetainingCapacity();
+
+        var name_set = false;
+        var link_name_set = false;
+
+        while (true) {
+            var block: [block_len]u8 = undefined;
+            try it.reader.readSliceAll(&block);
+            if (mem.allEqual(u8, &block, 0)) return null;
+
+            const size = try parseSize(block[124..136]);
+            const padded = mem.alignForward(u64, size, block_len);
+            try it.header.appendSlice(it.allocator, &block);
+
+            switch (block[156]) {
+                'L', 'K', 'x' => |kind| {
+                    if (padded > max_meta_len) return error.TarHeaderTooLong;
+                    const start = it.header.items.len;
+                    try it.header.resize(it.allocator, start + @as(usize, @intCast(padded)));
+                    try it.reader.readSliceAll(it.header.items[start..]);
+                    const data = it.header.items[start..][0..@intCast(size)];
+                    switch (kind) {
+                        'L' => {
+                            try setString(it.allocator, &it.name, data);
+                            name_set = true;
+                        },
+                        'K' => {
+                            try setString(it.allocator, &it.link_name, data);
+                            link_name_set = true;
+                        },
+                        else => try it.parsePax(data, &name_set, &link_name_set),
+                    }
+                    continue;
+                },
+                else => {},
+            }
+
+            if (!name_set) {
+                it.name.clearRetainingCapacity();
+                if (mem.eql(u8, block[257..262], "ustar")) {
+                    const prefix = field(block[345..500]);
+                    if (prefix.len > 0) {
+                        try it.name.appendSlice(it.allocator, prefix);
+                        try it.name.append(it.allocator, '/');
+                    }
+                }
+                try it.name.appendSlice(it.allocator, field(block[0..100]));
+            }
+            if (!link_name_set) try setString(it.allocator, &it.link_name, block[157..257]);
+
+            it.unread = padded;
+            return .{
+                .header = it.header.items,
+                .name = it.name.items,
+                .link_name = it.link_name.items,
+                .kind = if (block[156] == 0) .regular else @enumFromInt(block[156]),
+                .size = size,
+            };
+        }
+    }
+
+    /// Copies the data of the current entry, including padding.
+    pub fn streamData(it: *Iterator, writer: *std.Io.Writer) std.Io.Reader.StreamError!void {
+        const len = it.unread;
+        it.unread = 0;
+        try it.reader.streamExact64(writer, len);
+    }
+
+    fn parsePax(it: *Iterator, data: []const u8, name_set: *bool, link_name_set: *bool) Error!void {
+        var rest = data;
+        while (rest.len > 0) {
+            const space = mem.indexOfScalar(u8, rest, ' ') orelse return error.PaxInvalid;
+            const len = std.fmt.parseUnsigned(usize, rest[0..space], 10) catch return error.PaxInvalid;
+            if (len <= space + 1 or len > rest.len or rest[len - 1] != '\n') return error.PaxInvalid;
+            const record = rest[space + 1 .. len - 1];
+            rest = rest[len..];
+
+            const eq = mem.indexOfScalar(u8, record, '=') orelse return error.PaxInvalid;
+            const key = record[0..eq];
+            const value = record[eq + 1 ..];
+            if (mem.eql(u8, key, "path")) {
+                try setString(it.allocator, &it.name, value);
+                name_set.* = true;
+            } else if (mem.eql(u8, key, "linkpath")) {
+                try setString(it.allocator, &it.link_name, value);
+                link_name_set.* = true;
+            }
+        }
+    }
+};
+
+/// Returns the NUL terminated part of a header field.
+fn field(bytes: []const u8) []const u8 {
+    return bytes[0 .. mem.indexOfScalar(u8, bytes, 0) orelse bytes.len];
+}
+
+fn setString(allocator: mem.Allocator, list: *std.ArrayList(u8), bytes: []const u8) !void {
+    list.clearRetainingCapacity();
+    try list.appendSlice(allocator, field(bytes));
+}
+
+/// Parses an octal or base-256 encoded size field.
+fn parseSize(bytes: *const [12]u8) error{TarHeaderInvalid}!u64 {
+    if (bytes[0] & 0x80 != 0) {
+        var value: u64 = bytes[0] & 0x7f;
+        for (bytes[1..]) |b| {
+            if (value >> 56 != 0) return error.TarHeaderInvalid;
+            value = (value << 8) | b;
+        }
+        return value;
+    }
+    const trimmed = mem.trim(u8, bytes, " \x00");
+    if (trimmed.len == 0) return 0;
+    return std.fmt.parseUnsigned(u64, trimmed, 8) catch error.TarHeaderInvalid;
+}
+
+/// Returns the path of an archive member in the absolute form used by dpkg,
+/// e.g. "./usr/bin/" becomes "/usr/bin".
+pub fn normalizePath(buf: []u8, name: []const u8) error{NameTooLong}![]const u8 {
+    var path = mem.trimRight(u8, name, "/");
+    if (mem.startsWith(u8, path, "./")) path = path[2..] else if (mem.eql(u8, path, ".")) path = "";
+    path = mem.trimLeft(u8, path, "/");
+    if (path.len + 1 > buf.len) return error.NameTooLong;
+    buf[0] = '/';
+    @memcpy(buf[1..][0..path.len], path);
+    return buf[0 .. path.len + 1];
+}
+
+/// Writes the end of archive marker.
+pub fn finish(writer: *std.Io.Writer) std.Io.Writer.Error!void {
+    try writer.splatByteAll(0, 2 * block_len);
+}
+
+test parseSize {
+    try std.testing.expectEqual(@as(u64, 0), try parseSize("00000000000\x00"));
+    try std.testing.expectEqual(@as(u64, 0o1234), try parseSize("00000001234\x00"));
+    try std.testing.expectEqual(@as(u64, 0x1_0000_0000), try parseSize("\x80\x00\x00\x00\x00\x00\x00\x01\x00\x00\x00\x00"));
+    try std.testing.expectError(error.TarHeaderInvalid, parseSize("0000000z234\x00"));
+}
+
+test normalizePath {
+    var buf: [64]u8 = undefined;
+    try std.testing.expectEqualStrings("/", try normalizePath(&buf, "./"));
+    try std.testing.expectEqualStrings("/usr/bin", try normalizePath(&buf, "./usr/bin/"));
+    try std.testing.expectEqualStrings("/usr/bin/true", try normalizePath(&buf, "usr/bin/true"));
+}
+
+test Iterator {
+    const tar = @import("tar");
+
+    var archive: std.Io.Writer.Allocating = .init(std.testing.allocator);
+    defer archive.deinit();
+    var writer: tar.Writer = .{ .underlying_writer = &archive.writer };
+    try writer.writeDir("usr", .{});
+    try writer.writeFileBytes("usr/" ++ "a" ** 120, "hello", .{});
+    try writer.writeLink("usr/link", "a", .{});
+    try writer.finishPedantically();
+
+    var reader: std.Io.Reader = .fixed(archive.written());
+    var it: Iterator = .init(std.testing.allocator, &reader);
+    defer it.deinit();
+
+    const dir = (try it.next()).?;
+    try std.testing.expectEqual(Kind.directory, dir.kind);
+    try std.testing.expectEqualStrings("usr", dir.name);
+
+    const file = (try it.next()).?;
+    try std.testing.expectEqual(Kind.regular, file.kind);
+    try std.testing.expectEqualStrings("usr/" ++ "a" ** 120, file.name);
+    try std.testing.expectEqual(@as(u64, 5), file.size);
+    var data: std.Io.Writer.Allocating = .init(std.testing.allocator);
+    defer data.deinit();
+    try it.streamData(&data.writer);
+    try std.testing.expectEqualStrings("hello", data.written()[0..5]);
+
+    const link = (try it.next()).?;
+    try std.testing.expectEqual(Kind.sym_link, link.kind);
+    try std.testing.expectEqualStrings("a", link.link_name);
+
+    try std.testing.expect(try it.next() == null);
+}